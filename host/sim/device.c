@@ -0,0 +1,39 @@
+/** @file   device.c
+ *  @brief  Device and LED support of the host simulation
+ */
+
+#include <device.h>
+#include <led.h>
+
+void device_init(void) {
+    LED_PORT_DIR |= LED | LED2;
+}
+
+void led_init(void) {
+    LED_PORT_DIR |= LED | LED2;
+    LED_PORT &= ~(LED | LED2);
+}
+
+void led_control(int led, char on) {
+    if (on) {
+        LED_PORT |= led;
+    } else {
+        LED_PORT &= ~led;
+    }
+}
+
+void led(char on) {
+    led_control(LED, on);
+}
+
+void led2(char on) {
+    led_control(LED2, on);
+}
+
+void led_on(void) {
+    led(1);
+}
+
+void led_off(void) {
+    led(0);
+}
@@ -0,0 +1,22 @@
+# Example sensor profile for depth_sensor_sim -f, see sim_ms5541_load()
+#
+# A 10 hour dive to about 100 m of sea water with swell at the surface and
+# a few sensor faults on the way.  Times are in seconds.
+#
+# time   pressure mBar  temperature C
+0        1013           20.0
+60       1013           20.0
+1260     11100          8.0
+34200    11100          7.5
+35400    1013           18.0
+36000    1013           20.0
+
+# swell while waiting at the surface, 30 mBar at 8 s
+wave     0      60     30     8
+wave     35400  600    30     8
+
+# a glitch, a stuck adc on the way down and the sensor dropping out on
+# the bottom
+spike    600    0.2    400
+stuck    900    5
+dropout  20000  2
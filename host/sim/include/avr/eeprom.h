@@ -0,0 +1,30 @@
+#ifndef __SIM_AVR_EEPROM_H__
+#define __SIM_AVR_EEPROM_H__
+
+/** @file   avr/eeprom.h
+ *  @brief  Host simulation stand-in for the avr-libc eeprom support
+ *
+ *          Backed by a 4 KiB array (sim_eeprom) that starts erased (0xFF).
+ *          A byte write keeps the eeprom busy for SIM_EEPROM_WRITE_US.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x0FFF
+
+extern uint8_t sim_eeprom[E2END + 1];
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_write_block(const void *src, void *dst, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+int sim_eeprom_ready(void);
+
+#define eeprom_is_ready() sim_eeprom_ready()
+#define eeprom_busy_wait() while (!eeprom_is_ready())
+
+#endif
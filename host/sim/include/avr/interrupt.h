@@ -0,0 +1,41 @@
+#ifndef __SIM_AVR_INTERRUPT_H__
+#define __SIM_AVR_INTERRUPT_H__
+
+/** @file   avr/interrupt.h
+ *  @brief  Host simulation stand-in for avr-libc interrupt support
+ *
+ *          Interrupt handlers become ordinary functions the simulator calls
+ *          when the peripheral event is due and the I flag is set.
+ */
+
+#include <avr/io.h>
+
+#define sei() (SREG |= (1 << SREG_I))
+#define cli() (SREG &= (uint8_t)~(1 << SREG_I))
+
+#define ISR(vector) void vector(void); void vector(void)
+
+/** @name Vectors modelled by the simulator */
+//@{
+#define TIMER3_COMPA_vect sim_vect_timer3_compa
+#define ADC_vect          sim_vect_adc
+#define USART0_RX_vect    sim_vect_usart0_rx
+#define USART0_UDRE_vect  sim_vect_usart0_udre
+#define USART0_TX_vect    sim_vect_usart0_tx
+#define USART1_RX_vect    sim_vect_usart1_rx
+#define USART1_UDRE_vect  sim_vect_usart1_udre
+#define USART1_TX_vect    sim_vect_usart1_tx
+#define SPI_STC_vect      sim_vect_spi_stc
+//@}
+
+void TIMER3_COMPA_vect(void);
+void ADC_vect(void);
+void USART0_RX_vect(void);
+void USART0_UDRE_vect(void);
+void USART0_TX_vect(void);
+void USART1_RX_vect(void);
+void USART1_UDRE_vect(void);
+void USART1_TX_vect(void);
+void SPI_STC_vect(void);
+
+#endif
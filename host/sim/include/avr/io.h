@@ -0,0 +1,120 @@
+#ifndef __SIM_AVR_IO_H__
+#define __SIM_AVR_IO_H__
+
+/** @file   avr/io.h
+ *  @brief  Host simulation stand-in for the avr-libc register definitions
+ *
+ *          The atmega128 registers the firmware touches are plain variables
+ *          owned by the simulator (sim_hw.c and the peripheral models).  Only
+ *          the registers and bits used by the sources in src/ are provided,
+ *          add more as the firmware grows.
+ *
+ *          Registers with access side effects, like UDRn and SPDR, are plain
+ *          variables as well; the drivers using them are built with access
+ *          hooks that pass every volatile access to the models, see
+ *          sim/io.c.
+ */
+
+#include <stdint.h>
+
+/** @name General purpose io */
+//@{
+extern volatile uint8_t PORTA, DDRA, PINA;
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC, PINC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+extern volatile uint8_t PORTE, DDRE, PINE;
+extern volatile uint8_t PORTF, DDRF, PINF;
+extern volatile uint8_t PORTG, DDRG, PING;
+//@}
+
+/** Status register, only the global interrupt flag is modelled */
+extern volatile uint8_t SREG;
+#define SREG_I 7
+
+/** @name Reset cause, set to a power on reset by sim_init() */
+//@{
+extern volatile uint8_t MCUCSR;
+
+#define PORF   0
+#define EXTRF  1
+#define BORF   2
+#define WDRF   3
+#define JTRF   4
+//@}
+
+/** @name Timer 3 */
+//@{
+extern volatile uint8_t TCCR3A, TCCR3B, ETIFR, ETIMSK;
+extern volatile uint16_t TCNT3, OCR3A;
+
+#define WGM32  3
+#define CS32   2
+#define CS31   1
+#define CS30   0
+#define OCF3A  4
+#define OCIE3A 4
+//@}
+
+/** @name ADC, free running mode only */
+//@{
+extern volatile uint8_t ADMUX, ADCSRA;
+extern volatile uint16_t ADCW;
+#define ADC ADCW
+
+#define REFS1  7
+#define REFS0  6
+#define ADEN   7
+#define ADSC   6
+#define ADFR   5
+#define ADIF   4
+#define ADIE   3
+#define ADPS2  2
+#define ADPS1  1
+#define ADPS0  0
+//@}
+
+/** @name USART 0 and 1, asynchronous 8N1 only, see sim/uart.c */
+//@{
+extern volatile uint8_t UDR0, UCSR0A, UCSR0B, UCSR0C, UBRR0L, UBRR0H;
+extern volatile uint8_t UDR1, UCSR1A, UCSR1B, UCSR1C, UBRR1L, UBRR1H;
+
+#define RXC    7
+#define TXC    6
+#define UDRE   5
+#define FE     4
+#define DOR    3
+#define UPE    2
+#define U2X    1
+#define MPCM   0
+
+#define RXCIE  7
+#define TXCIE  6
+#define UDRIE  5
+#define RXEN   4
+#define TXEN   3
+#define UCSZ2  2
+
+#define UCSZ1  2
+#define UCSZ0  1
+//@}
+
+/** @name SPI, master mode only, see sim/spi.c */
+//@{
+extern volatile uint8_t SPCR, SPSR, SPDR;
+
+#define SPIE   7
+#define SPE    6
+#define DORD   5
+#define MSTR   4
+#define CPOL   3
+#define CPHA   2
+#define SPR1   1
+#define SPR0   0
+
+#define SPIF   7
+#define WCOL   6
+#define SPI2X  0
+//@}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __SIM_AVR_PGMSPACE_H__
+#define __SIM_AVR_PGMSPACE_H__
+
+/** @file   avr/pgmspace.h
+ *  @brief  Host simulation stand-in, program memory is ordinary memory
+ */
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#define pgm_read_word(addr) (*(const unsigned short *)(addr))
+#define strcmp_P  strcmp
+#define strncmp_P strncmp
+
+#endif
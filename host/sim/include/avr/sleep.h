@@ -0,0 +1,20 @@
+#ifndef __SIM_AVR_SLEEP_H__
+#define __SIM_AVR_SLEEP_H__
+
+/** @file   avr/sleep.h
+ *  @brief  Host simulation stand-in for avr-libc sleep support
+ *
+ *          sleep_cpu() advances the virtual clock to the next event.
+ */
+
+#define SLEEP_MODE_IDLE 0
+
+void sim_sleep(void);
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()   sim_sleep()
+#define sleep_mode()  sim_sleep()
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __SIM_AVR_WDT_H__
+#define __SIM_AVR_WDT_H__
+
+/** @file   avr/wdt.h
+ *  @brief  Host simulation stand-in for the avr-libc watchdog support
+ *
+ *          The simulator counts watchdog timeouts instead of resetting.
+ */
+
+#define WDTO_15MS   0
+#define WDTO_30MS   1
+#define WDTO_60MS   2
+#define WDTO_120MS  3
+#define WDTO_250MS  4
+#define WDTO_500MS  5
+#define WDTO_1S     6
+#define WDTO_2S     7
+
+void sim_wdt_enable(unsigned char timeout);
+void sim_wdt_disable(void);
+void sim_wdt_reset(void);
+
+#define wdt_enable(timeout) sim_wdt_enable(timeout)
+#define wdt_disable()       sim_wdt_disable()
+#define wdt_reset()         sim_wdt_reset()
+
+#endif
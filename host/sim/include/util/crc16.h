@@ -0,0 +1,30 @@
+#ifndef __SIM_UTIL_CRC16_H__
+#define __SIM_UTIL_CRC16_H__
+
+/** @file   util/crc16.h
+ *  @brief  Host simulation stand-in, C versions of the avr-libc CRC helpers
+ */
+
+#include <stdint.h>
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+    int i;
+
+    crc ^= (uint16_t)data << 8;
+    for (i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data) {
+    int i;
+
+    crc ^= data;
+    for (i = 0; i < 8; i++) {
+        crc = (crc & 0x01) ? (uint8_t)((crc >> 1) ^ 0x8C) : (uint8_t)(crc >> 1);
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __SIM_UTIL_DELAY_H__
+#define __SIM_UTIL_DELAY_H__
+
+/** @file   util/delay.h
+ *  @brief  Host simulation stand-in, delays advance the virtual clock
+ */
+
+void sim_delay_us(double us);
+
+#define _delay_us(us) sim_delay_us(us)
+#define _delay_ms(ms) sim_delay_us((ms) * 1000.0)
+
+#endif
@@ -0,0 +1,123 @@
+/** @file   io.c
+ *  @brief  Register access hooks of the host simulation
+ *
+ *          Some registers have side effects on access: writing UDRn starts a
+ *          transmission, reading it takes the received byte, writing a one
+ *          to TXC clears it, and reading SPSR then accessing SPDR clears
+ *          SPIF.  Plain variables cannot model that, the
+ *          write of a value the register already holds leaves no trace.  The
+ *          drivers touching such registers are therefore compiled with gcc's
+ *          thread sanitizer instrumentation (SIM_IO_CFLAGS in the Makefile),
+ *          which calls a hook before every memory access and tells volatile
+ *          accesses apart.  No sanitizer runtime is linked, this file
+ *          provides the hooks: plain accesses are ignored, volatile ones are
+ *          passed to the peripheral models.
+ *
+ *          The hook runs before the access.  A read lets the model set the
+ *          register first.  A write is only complete once the store is done,
+ *          so it is handed to the model at the next hook, or when control
+ *          returns to the simulator through sim_io_sync().
+ */
+
+#include "sim.h"
+
+#include <stddef.h>
+
+/** Register written by the firmware, handed to the model at the next sync */
+static volatile void *pending_write;
+
+/** Test hook of sim_io_on_write() */
+static volatile void *hook_addr;
+static void (*hook_fn)(void);
+
+void sim_io_on_write(volatile void *addr, void (*fn)(void)) {
+    hook_addr = addr;
+    hook_fn = fn;
+}
+
+void sim_io_sync(void) {
+    volatile void *addr = pending_write;
+    void (*fn)(void) = hook_fn;
+
+    if (addr) {
+        pending_write = 0;
+        sim_uart_io_write(addr);
+        sim_spi_io_write(addr);
+        if (fn && addr == hook_addr) {
+            hook_fn = 0;
+            fn();
+        }
+    }
+}
+
+static void sim_io_read(volatile void *addr) {
+    sim_io_sync();
+    sim_uart_io_read(addr);
+    sim_spi_io_read(addr);
+}
+
+static void sim_io_write(volatile void *addr) {
+    sim_io_sync();
+    pending_write = addr;
+}
+
+/* Thread sanitizer entry points, as called by the instrumented code */
+
+void __tsan_init(void);
+void __tsan_func_entry(void *pc);
+void __tsan_func_exit(void);
+void __tsan_read_range(void *addr, unsigned long size);
+void __tsan_write_range(void *addr, unsigned long size);
+
+void __tsan_init(void) {
+}
+
+void __tsan_func_entry(void *pc) {
+    (void)pc;
+}
+
+void __tsan_func_exit(void) {
+}
+
+void __tsan_read_range(void *addr, unsigned long size) {
+    (void)addr;
+    (void)size;
+}
+
+void __tsan_write_range(void *addr, unsigned long size) {
+    (void)addr;
+    (void)size;
+}
+
+/** Plain accesses of size bytes */
+#define SIM_IO_PLAIN(size)                                                  \
+    void __tsan_read##size(void *addr);                                     \
+    void __tsan_write##size(void *addr);                                    \
+    void __tsan_unaligned_read##size(void *addr);                           \
+    void __tsan_unaligned_write##size(void *addr);                          \
+    void __tsan_read##size(void *addr) { (void)addr; }                      \
+    void __tsan_write##size(void *addr) { (void)addr; }                     \
+    void __tsan_unaligned_read##size(void *addr) { (void)addr; }            \
+    void __tsan_unaligned_write##size(void *addr) { (void)addr; }
+
+/** Volatile accesses of size bytes */
+#define SIM_IO_VOLATILE(size)                                               \
+    void __tsan_volatile_read##size(void *addr);                            \
+    void __tsan_volatile_write##size(void *addr);                           \
+    void __tsan_unaligned_volatile_read##size(void *addr);                  \
+    void __tsan_unaligned_volatile_write##size(void *addr);                 \
+    void __tsan_volatile_read##size(void *addr) { sim_io_read(addr); }      \
+    void __tsan_volatile_write##size(void *addr) { sim_io_write(addr); }    \
+    void __tsan_unaligned_volatile_read##size(void *addr) { sim_io_read(addr); }   \
+    void __tsan_unaligned_volatile_write##size(void *addr) { sim_io_write(addr); }
+
+SIM_IO_PLAIN(1)
+SIM_IO_PLAIN(2)
+SIM_IO_PLAIN(4)
+SIM_IO_PLAIN(8)
+SIM_IO_PLAIN(16)
+SIM_IO_VOLATILE(1)
+SIM_IO_VOLATILE(2)
+SIM_IO_VOLATILE(4)
+SIM_IO_VOLATILE(8)
+SIM_IO_VOLATILE(16)
@@ -0,0 +1,459 @@
+/** @file   ms5541.c
+ *  @brief  Virtual Intersema MS5541 for the host simulation
+ *
+ *          Decodes the command words the driver clocks out over SPI:
+ *          the 0x15 0x55 0x40 reset sequence, D1/D2 conversion starts and
+ *          the W1-W4 calibration word reads.  The result of the last command
+ *          is returned msb first by the following reads, a conversion result
+ *          read before SIM_MS5541_CONVERSION_US reads as 0 like an unfinished
+ *          one.  The SPI model (spi.c) tells command bytes from result reads
+ *          by the clock phase, the extra clocks of the real 3-wire protocol
+ *          are not modelled.
+ *
+ *          The conversion results come from a constant, a trace of counts or
+ *          a profile in mBar and degree C, and scheduled events add spikes,
+ *          waves, a stuck adc, dropouts and a bad calibration on top.
+ *
+ *          The same pressure, with the waves but none of the sensor faults,
+ *          drives the analog transducer on the MCU ADC (sim_hw.c), which has
+ *          its own offset events.
+ */
+
+#include "sim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @name Sensor commands, as sent by src/depth.c */
+//@{
+#define MS5541_CMD_D1   0x0F40
+#define MS5541_CMD_D2   0x0F20
+#define MS5541_CMD_W1   0x1D50
+#define MS5541_CMD_W2   0x1D60
+#define MS5541_CMD_W3   0x1D90
+#define MS5541_CMD_W4   0x1DA0
+//@}
+
+/** Longest line of a profile file */
+#define MS5541_LINE_MAX 256
+
+/** Default calibration, C1-C6 = 2800, 5000, 300, 250, 2000, 50
+ *
+ *  With the default D1 = 15465 and D2 = 26000 this reads 1999 mBar
+ *  (about 10 m of sea water) at 20.0 deg C.
+ */
+static const uint16_t ms5541_default_cal[4] = {0x5784, 0xE21F, 0x4B10, 0x7D32};
+
+static uint16_t calibration[4];
+static uint16_t value[2];
+static const uint16_t *trace[2];
+static size_t trace_len[2];
+static size_t trace_pos[2];
+static uint16_t last_value[2];
+
+static const struct SimMs5541Point *profile;
+static size_t profile_len;
+static size_t profile_pos;
+static struct SimMs5541Point *loaded_profile;
+
+static struct SimMs5541Event events[SIM_MS5541_MAX_EVENTS];
+static int event_cnt;
+static unsigned int bad_cal_reads;
+
+static uint8_t command[3];
+static unsigned char command_len;
+static uint16_t result;
+static unsigned char result_bytes;
+static uint64_t result_ready_us;
+static char result_early;
+
+static struct SimMs5541Stats stats;
+
+void sim_ms5541_reset(void) {
+    memcpy(calibration, ms5541_default_cal, sizeof(calibration));
+    value[SIM_MS5541_D1] = 15465;
+    value[SIM_MS5541_D2] = 26000;
+    last_value[SIM_MS5541_D1] = value[SIM_MS5541_D1];
+    last_value[SIM_MS5541_D2] = value[SIM_MS5541_D2];
+    trace[0] = trace[1] = 0;
+    profile = 0;
+    profile_len = 0;
+    event_cnt = 0;
+    bad_cal_reads = 0;
+    command_len = 0;
+    result_bytes = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_ms5541_set_calibration(const uint16_t word[4]) {
+    memcpy(calibration, word, sizeof(calibration));
+}
+
+void sim_ms5541_set_value(int channel, uint16_t v) {
+    value[channel] = v;
+    trace[channel] = 0;
+}
+
+void sim_ms5541_set_trace(int channel, const uint16_t *t, size_t len) {
+    trace[channel] = len ? t : 0;
+    trace_len[channel] = len;
+    trace_pos[channel] = 0;
+}
+
+void sim_ms5541_set_profile(const struct SimMs5541Point *points, size_t len) {
+    profile = len ? points : 0;
+    profile_len = len;
+    profile_pos = 0;
+}
+
+int sim_ms5541_add_event(const struct SimMs5541Event *event) {
+    if (event_cnt >= SIM_MS5541_MAX_EVENTS) {
+        return 0;
+    }
+    events[event_cnt++] = *event;
+    return 1;
+}
+
+const struct SimMs5541Stats *sim_ms5541_stats(void) {
+    return &stats;
+}
+
+/** @return The first event of a type active now, 0 if none */
+static const struct SimMs5541Event *ms5541_event(int type, uint64_t now) {
+    int i;
+
+    for (i = 0; i < event_cnt; i++) {
+        if (events[i].type == type && now >= events[i].start_us &&
+            now - events[i].start_us < events[i].duration_us) {
+            return &events[i];
+        }
+    }
+    return 0;
+}
+
+/** @return Sum of the offsets of a sensor active now, in mBar
+ *  @param analog 1 for the analog transducer, 0 for the MS5541 */
+static double ms5541_pressure_offset(uint64_t now, int analog) {
+    const struct SimMs5541Event *e;
+    double offset = 0;
+    int i;
+
+    for (i = 0; i < event_cnt; i++) {
+        e = &events[i];
+        if (now < e->start_us || now - e->start_us >= e->duration_us) {
+            continue;
+        }
+        if (e->type == (analog ? SIM_MS5541_EVENT_ANALOG : SIM_MS5541_EVENT_SPIKE)) {
+            offset += e->value;
+        } else if (e->type == SIM_MS5541_EVENT_WAVE && e->period_us > 0) {
+            offset += e->value * sin(2 * M_PI * (now - e->start_us) / e->period_us);
+        }
+    }
+    return offset;
+}
+
+/** Compensation coefficients, as unpacked by the firmware */
+static void ms5541_coefficients(long c[6]) {
+    c[0] = calibration[0] >> 3;
+    c[1] = ((calibration[0] & 0x0007) << 10) | (calibration[1] >> 6);
+    c[2] = calibration[2] >> 6;
+    c[3] = calibration[3] >> 7;
+    c[4] = ((calibration[1] & 0x003F) << 6) | (calibration[2] & 0x003F);
+    c[5] = calibration[3] & 0x007F;
+}
+
+/** Offset and sensitivity of the firmware compensation at a D2 */
+static void ms5541_off_sens(uint16_t d2, long *off, long *sens) {
+    long c[6];
+    long dt;
+
+    ms5541_coefficients(c);
+    dt = (long)d2 - (8L * c[4] + 10000);
+    *off = c[1] + (((c[3] - 250) * dt) >> 12) + 10000;
+    *sens = (c[0] >> 1) + (((c[2] + 200) * dt) >> 13) + 3000;
+}
+
+static uint16_t ms5541_clamp(double counts) {
+    if (counts < 0) {
+        return 0;
+    }
+    if (counts > 0xFFFF) {
+        return 0xFFFF;
+    }
+    return (uint16_t)lround(counts);
+}
+
+/** D2 for a temperature, the inverse of the firmware compensation */
+static uint16_t ms5541_d2(double temp_C) {
+    long c[6];
+
+    ms5541_coefficients(c);
+    return ms5541_clamp((temp_C * 10 - 200) * 2048 / (c[5] + 100) + 8 * c[4] + 10000);
+}
+
+/** D1 for a pressure at a D2, the inverse of the firmware compensation */
+static uint16_t ms5541_d1(double pressure_mBar, uint16_t d2) {
+    long off, sens;
+
+    ms5541_off_sens(d2, &off, &sens);
+    return ms5541_clamp(off + (pressure_mBar - 1000) * 2048 / (sens > 0 ? sens : 1));
+}
+
+/** Interpolate the profile at a time */
+static void ms5541_profile_at(uint64_t now, double *pressure_mBar, double *temp_C) {
+    const struct SimMs5541Point *a, *b;
+    double f;
+
+    if (profile_pos && now < profile[profile_pos].time_us) {
+        profile_pos = 0;
+    }
+    while (profile_pos + 1 < profile_len && profile[profile_pos + 1].time_us <= now) {
+        profile_pos++;
+    }
+    a = &profile[profile_pos];
+    if (profile_pos + 1 >= profile_len || now <= a->time_us) {
+        *pressure_mBar = a->pressure_mBar;
+        *temp_C = a->temp_C;
+        return;
+    }
+    b = a + 1;
+    f = (double)(now - a->time_us) / (b->time_us - a->time_us);
+    *pressure_mBar = a->pressure_mBar + f * (b->pressure_mBar - a->pressure_mBar);
+    *temp_C = a->temp_C + f * (b->temp_C - a->temp_C);
+}
+
+/** Result of a conversion started now, the pressure is that of the middle
+ *  of the conversion as a sigma-delta converter averages over it */
+static uint16_t ms5541_next_value(int channel) {
+    uint64_t now = sim_time_us() + SIM_MS5541_CONVERSION_US / 2;
+    double offset, pressure, temp;
+    long off, sens;
+    uint16_t v;
+
+    if (ms5541_event(SIM_MS5541_EVENT_STUCK, now)) {
+        stats.faulted++;
+        return last_value[channel];
+    }
+
+    if (trace[channel]) {
+        v = trace[channel][trace_pos[channel]];
+        if (++trace_pos[channel] >= trace_len[channel]) {
+            trace_pos[channel] = 0;
+        }
+    } else if (profile) {
+        ms5541_profile_at(now, &pressure, &temp);
+        v = ms5541_d2(temp);
+        if (channel == SIM_MS5541_D1) {
+            v = ms5541_d1(pressure, v);
+        }
+    } else {
+        v = value[channel];
+    }
+
+    if (channel == SIM_MS5541_D1 && (offset = ms5541_pressure_offset(now, 0)) != 0) {
+        ms5541_off_sens(last_value[SIM_MS5541_D2], &off, &sens);
+        v = ms5541_clamp(v + offset * 2048 / (sens > 0 ? sens : 1));
+        stats.faulted++;
+    }
+    last_value[channel] = v;
+    return v;
+}
+
+double sim_ms5541_analog_mBar(uint64_t now) {
+    double pressure, temp;
+    long off, sens;
+    uint16_t d1 = trace[SIM_MS5541_D1] ? last_value[SIM_MS5541_D1] : value[SIM_MS5541_D1];
+    uint16_t d2 = trace[SIM_MS5541_D2] ? last_value[SIM_MS5541_D2] : value[SIM_MS5541_D2];
+
+    if (profile) {
+        ms5541_profile_at(now, &pressure, &temp);
+    } else {
+        /* constant counts or a trace, read back through the compensation */
+        ms5541_off_sens(d2, &off, &sens);
+        pressure = (sens * ((long)d1 - off)) / 2048.0 + 1000;
+    }
+    return pressure + ms5541_pressure_offset(now, 1);
+}
+
+static void ms5541_result(uint16_t v, uint64_t ready_us) {
+    result = v;
+    result_bytes = 2;
+    result_ready_us = ready_us;
+}
+
+/** Calibration word, one that never reads the same twice during a bad
+ *  calibration event */
+static void ms5541_calibration_result(int i) {
+    uint16_t word = calibration[i];
+
+    stats.calibration_reads++;
+    if (ms5541_event(SIM_MS5541_EVENT_BAD_CAL, sim_time_us())) {
+        stats.faulted++;
+        word ^= ++bad_cal_reads;
+    }
+    ms5541_result(word, 0);
+}
+
+static void ms5541_command(uint16_t cmd) {
+    switch (cmd) {
+        case MS5541_CMD_D1:
+        case MS5541_CMD_D2: {
+            int channel = cmd == MS5541_CMD_D1 ? SIM_MS5541_D1 : SIM_MS5541_D2;
+            stats.conversions[channel]++;
+            ms5541_result(ms5541_next_value(channel), sim_time_us() + SIM_MS5541_CONVERSION_US);
+            break;
+        }
+        case MS5541_CMD_W1: ms5541_calibration_result(0); break;
+        case MS5541_CMD_W2: ms5541_calibration_result(1); break;
+        case MS5541_CMD_W3: ms5541_calibration_result(2); break;
+        case MS5541_CMD_W4: ms5541_calibration_result(3); break;
+        default:
+            stats.protocol_errors++;
+            result_bytes = 0;
+            break;
+    }
+}
+
+void sim_ms5541_write(uint8_t byte) {
+    command[command_len++] = byte;
+
+    if (command[0] == 0x15) {
+        if (command_len < 3) {
+            return;
+        }
+        if (command[1] == 0x55 && command[2] == 0x40) {
+            stats.resets++;
+            result_bytes = 0;
+        } else {
+            stats.protocol_errors++;
+        }
+    } else if (command_len == 2) {
+        ms5541_command((command[0] << 8) | command[1]);
+    } else {
+        return;
+    }
+    command_len = 0;
+}
+
+uint8_t sim_ms5541_read(void) {
+    if (ms5541_event(SIM_MS5541_EVENT_DROPOUT, sim_time_us())) {
+        stats.faulted++;
+        if (result_bytes) {
+            result_bytes--;
+        }
+        return 0xFF;
+    }
+    if (!result_bytes) {
+        stats.protocol_errors++;
+        return 0xFF;
+    }
+    if (result_bytes == 2) {
+        result_early = sim_time_us() < result_ready_us;
+        if (result_early) {
+            stats.early_reads++;
+        }
+    }
+    result_bytes--;
+    return result_early ? 0 : (result >> (8 * result_bytes)) & 0xFF;
+}
+
+/** Parse one line of a profile file
+ *  @return 0 if the line is not valid */
+static int ms5541_parse_line(const char *line, struct SimMs5541Point *point, int *is_point) {
+    struct SimMs5541Event e;
+    char name[16];
+    double start, duration, t, p, c;
+    int n;
+
+    *is_point = 0;
+    if (sscanf(line, "%lf %lf %lf", &t, &p, &c) == 3) {
+        if (t < 0) {
+            return 0;
+        }
+        point->time_us = (uint64_t)(t * 1e6);
+        point->pressure_mBar = p;
+        point->temp_C = c;
+        *is_point = 1;
+        return 1;
+    }
+
+    memset(&e, 0, sizeof(e));
+    n = sscanf(line, "%15s %lf %lf %lf %lf", name, &start, &duration, &e.value, &e.period_us);
+    if (n < 3 || start < 0 || duration < 0) {
+        return 0;
+    }
+    if (strcmp(name, "spike") == 0 && n == 4) {
+        e.type = SIM_MS5541_EVENT_SPIKE;
+    } else if (strcmp(name, "wave") == 0 && n == 5) {
+        e.type = SIM_MS5541_EVENT_WAVE;
+        e.period_us *= 1e6;
+    } else if (strcmp(name, "stuck") == 0 && n == 3) {
+        e.type = SIM_MS5541_EVENT_STUCK;
+    } else if (strcmp(name, "dropout") == 0 && n == 3) {
+        e.type = SIM_MS5541_EVENT_DROPOUT;
+    } else if (strcmp(name, "badcal") == 0 && n == 3) {
+        e.type = SIM_MS5541_EVENT_BAD_CAL;
+    } else if (strcmp(name, "analog") == 0 && n == 4) {
+        e.type = SIM_MS5541_EVENT_ANALOG;
+    } else {
+        return 0;
+    }
+    e.start_us = (uint64_t)(start * 1e6);
+    e.duration_us = (uint64_t)(duration * 1e6);
+    return sim_ms5541_add_event(&e);
+}
+
+int sim_ms5541_load(const char *path) {
+    char line[MS5541_LINE_MAX];
+    struct SimMs5541Point point, *points = 0, *grown;
+    size_t len = 0, size = 0;
+    int line_no = 0;
+    int is_point;
+    char *hash;
+    FILE *f;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        if ((hash = strchr(line, '#')) != NULL) {
+            *hash = 0;
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (!ms5541_parse_line(line, &point, &is_point) ||
+            (is_point && len && point.time_us < points[len - 1].time_us)) {
+            fprintf(stderr, "%s:%d: bad line\n", path, line_no);
+            fclose(f);
+            free(points);
+            return -1;
+        }
+        if (!is_point) {
+            continue;
+        }
+        if (len == size) {
+            size = size ? 2 * size : 64;
+            if ((grown = realloc(points, size * sizeof(*points))) == NULL) {
+                fprintf(stderr, "%s: out of memory\n", path);
+                fclose(f);
+                free(points);
+                return -1;
+            }
+            points = grown;
+        }
+        points[len++] = point;
+    }
+    fclose(f);
+
+    if (len) {
+        sim_ms5541_set_profile(points, len);
+        free(loaded_profile);
+        loaded_profile = points;
+    }
+    return 0;
+}
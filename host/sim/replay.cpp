@@ -0,0 +1,228 @@
+/** @file   replay.cpp
+ *  @brief  Replays a raw capture through the host simulation
+ *
+ *          Reads the frames a node sent with output format 2 (raw capture,
+ *          see telemetry.h), feeds the conversions back to the virtual
+ *          MS5541 with the captured calibration, and runs the unmodified
+ *          firmware over them with the captured filter and fluid settings.
+ *          The tether output, $PVRDT and $PVRDF sentences for every sample,
+ *          goes to stdout, counters to stderr.  A change to the compensation
+ *          or the filter can so be checked against recorded dives.
+ *
+ *          usage: depth_sensor_replay [-n conversions] [-q] capture
+ *
+ *          -n  stop after this many conversions, default the whole capture
+ *          -q  do not print the counters
+ *
+ *          Conversions lost in the capture, seen as sequence gaps, are not
+ *          made up, the replay closes the gap.  The settings are those of
+ *          the first setup frame.  The sample times are those of the
+ *          simulation, not the captured ones.  The firmware must have been
+ *          built with the temperature interval of the capture.  Only a
+ *          capture of an MS5541, 4 calibration words and 16 bit
+ *          conversions, can be played to the virtual part.
+ */
+
+#include "../telemetry_decoder.h"
+
+extern "C" {
+#include "sim.h"
+}
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/** COMM_PORT_TETHER of the platform header, whose types.h clashes with <stdint.h> */
+#define REPLAY_PORT_TETHER 0
+
+/** Virtual time the firmware gets to apply the settings */
+#define REPLAY_SETTLE_US 1000000ULL
+
+/** Virtual time run between checks of the conversion count */
+#define REPLAY_STEP_US 100000ULL
+
+/** Calibration words and widest conversion of the virtual MS5541 */
+#define REPLAY_CAL_WORDS 4
+#define REPLAY_RAW_MAX   0xFFFFUL
+
+namespace {
+
+/** What a capture file holds */
+struct Capture {
+    bool have_setup = false;
+    uint8_t calibration_count = 0;
+    uint16_t calibration[REPLAY_CAL_WORDS] = {};
+    uint8_t oversample = 1;
+    uint8_t median = 1;
+    uint8_t alpha = 0;
+    uint8_t beta = 0;
+    int32_t zero_cmbar = 0;
+    uint16_t density_kgm3 = 0;
+    int8_t latitude_deg = 0;
+    uint8_t temp_interval = 1;
+    std::vector<uint16_t> d1;
+    std::vector<uint16_t> d2;       ///< fresh temperature conversions only
+    unsigned long gaps = 0;         ///< conversions missing from the capture
+    unsigned long too_wide = 0;     ///< conversions beyond REPLAY_RAW_MAX
+};
+
+bool load_capture(const char *path, Capture &cap) {
+    FILE *f = std::fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    bool have_seq = false;
+    uint16_t last_seq = 0;
+
+    telemetry::Decoder decoder{telemetry::Decoder::FrameHandler()};
+    decoder.set_setup_handler([&](const telemetry::SetupFrameView &s) {
+        if (cap.have_setup) {
+            return;     /* the settings of the start of the capture are used */
+        }
+        cap.have_setup = true;
+        cap.calibration_count = s.calibration_count();
+        for (int i = 0; i < REPLAY_CAL_WORDS; i++) {
+            cap.calibration[i] = s.calibration(i);
+        }
+        cap.oversample = s.oversample();
+        cap.median = s.median();
+        cap.alpha = s.alpha();
+        cap.beta = s.beta();
+        cap.zero_cmbar = s.zero_cmbar();
+        cap.density_kgm3 = s.density_kgm3();
+        cap.latitude_deg = s.latitude_deg();
+        cap.temp_interval = s.temp_interval();
+    });
+    decoder.set_raw_handler([&](const telemetry::RawFrameView &r) {
+        if (!cap.have_setup) {
+            return;     /* no calibration yet to make sense of it */
+        }
+        if (have_seq) {
+            cap.gaps += static_cast<uint16_t>(r.seq() - last_seq - 1);
+        }
+        have_seq = true;
+        last_seq = r.seq();
+        if (r.d1() > REPLAY_RAW_MAX || r.d2() > REPLAY_RAW_MAX) {
+            cap.too_wide++;
+        }
+        cap.d1.push_back(static_cast<uint16_t>(r.d1()));
+        if (r.temp_age() == 0) {
+            cap.d2.push_back(static_cast<uint16_t>(r.d2()));
+        }
+    });
+
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+        decoder.feed(buf, n);
+    }
+    std::fclose(f);
+    return true;
+}
+
+void send_command(const std::string &command) {
+    std::string line = command + "\r\n";
+    sim_uart_rx(REPLAY_PORT_TETHER, line.data(), line.size());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    unsigned long limit = 0;
+    bool quiet = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:q")) != -1) {
+        switch (opt) {
+            case 'n':
+                limit = std::strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                std::fprintf(stderr, "usage: %s [-n conversions] [-q] capture\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        std::fprintf(stderr, "usage: %s [-n conversions] [-q] capture\n", argv[0]);
+        return 2;
+    }
+
+    Capture cap;
+    if (!load_capture(argv[optind], cap)) {
+        std::fprintf(stderr, "%s: cannot open\n", argv[optind]);
+        return 1;
+    }
+    if (!cap.have_setup || cap.d1.empty()) {
+        std::fprintf(stderr, "%s: no setup frame or no raw frames\n", argv[optind]);
+        return 1;
+    }
+    if (cap.calibration_count != REPLAY_CAL_WORDS || cap.too_wide) {
+        std::fprintf(stderr, "%s: %u calibration words, %lu conversions over 16 bits, not an MS5541\n",
+                     argv[optind], cap.calibration_count, cap.too_wide);
+        return 1;
+    }
+    if (limit == 0 || limit > cap.d1.size()) {
+        limit = cap.d1.size();
+    }
+
+    /* hold the first conversion while the settings are applied */
+    sim_init();
+    sim_ms5541_set_calibration(cap.calibration);
+    sim_ms5541_set_value(SIM_MS5541_D1, cap.d1[0]);
+    sim_ms5541_set_value(SIM_MS5541_D2, cap.d2.empty() ? 0 : cap.d2[0]);
+
+    sim_run(REPLAY_SETTLE_US / 2);
+    send_command("$PVRAZ,0");
+    send_command("$PVROS," + std::to_string(cap.oversample));
+    send_command("$PVRFL,1," + std::to_string(cap.median) + "," +
+                 std::to_string(cap.alpha) + "," + std::to_string(cap.beta));
+    send_command("$PVRDN," + std::to_string(cap.density_kgm3) + "," +
+                 std::to_string(cap.latitude_deg));
+    if (cap.zero_cmbar) {
+        send_command("$PVRZO," + std::to_string(cap.zero_cmbar));
+    }
+    send_command("$PVRFM,0,0,0");
+    send_command("$PVRSR,0,0,0,0");
+    sim_run(REPLAY_SETTLE_US / 2);
+    sim_uart_clear_output(REPLAY_PORT_TETHER);
+
+    /* then play the capture from its first conversion */
+    const struct SimMs5541Stats *ms = sim_ms5541_stats();
+    unsigned long d1_start = ms->conversions[SIM_MS5541_D1];
+    uint64_t start_us = sim_time_us();
+    auto wall_start = std::chrono::steady_clock::now();
+
+    sim_ms5541_set_trace(SIM_MS5541_D1, cap.d1.data(), cap.d1.size());
+    if (!cap.d2.empty()) {
+        sim_ms5541_set_trace(SIM_MS5541_D2, cap.d2.data(), cap.d2.size());
+    }
+    while (ms->conversions[SIM_MS5541_D1] - d1_start < limit) {
+        sim_run(REPLAY_STEP_US);
+
+        size_t len;
+        const char *out = sim_uart_output(REPLAY_PORT_TETHER, &len);
+        std::fwrite(out, 1, len, stdout);
+        sim_uart_clear_output(REPLAY_PORT_TETHER);
+    }
+
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    double virtual_s = (sim_time_us() - start_us) / 1e6;
+    if (!quiet) {
+        std::fprintf(stderr, "capture: %zu conversions, %zu temperatures, %lu lost, temp interval %u\n",
+                     cap.d1.size(), cap.d2.size(), cap.gaps, cap.temp_interval);
+        std::fprintf(stderr, "replay: %lu conversions, %.3f s virtual in %.3f s, %.0fx real time\n",
+                     ms->conversions[SIM_MS5541_D1] - d1_start, virtual_s, wall_s,
+                     wall_s > 0 ? virtual_s / wall_s : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+/** @file   sim.h
+ *  @brief  Host simulation of the depth sensor hardware
+ *
+ *          Runs the unmodified firmware sources (src/) on the build host.
+ *          The AVR peripherals the firmware uses are replaced by models
+ *          driven from a virtual clock:
+ *
+ *          - virtual clock: time only advances while the firmware sleeps
+ *            (sleep_cpu()) or waits (_delay_ms(), sysclk_wait_mS()), code
+ *            itself runs in zero virtual time.  get_time() follows the
+ *            sysclk format, 24 bit mS and 230 Timer 2 counts per mS.
+ *          - Timer 3 compare A, fires TIMER3_COMPA_vect in CTC mode
+ *          - MCU ADC in free running mode, fires ADC_vect, with the analog
+ *            pressure transducer on ADC_PRESSURE
+ *          - SPI transfer chains, paced at the bus clock and completed
+ *            from the virtual clock
+ *          - a virtual MS5541 on the SPI port, answering the calibration,
+ *            D1 and D2 commands from configurable words, traces or a
+ *            pressure and temperature profile, with timed faults
+ *          - the SPI master at the register level under the firmware
+ *            driver, bytes take the SCK byte time
+ *          - USART 0 and 1 at the register level under the firmware
+ *            driver, transmit is paced at the line rate and captured,
+ *            receive bytes are injected
+ *          - watchdog, counts timeouts instead of resetting
+ *          - eeprom, a 4 KiB array with the 8.5 mS byte write time
+ *
+ *          The firmware main() is compiled as firmware_main() and runs as a
+ *          coroutine: sim_run() resumes it until the virtual clock reaches
+ *          the requested time, so a test can inspect state and inject
+ *          commands between runs.  There is a single simulated device per
+ *          process.
+ *
+ * @code Example:
+         sim_init();
+         sim_ms5541_set_value(SIM_MS5541_D1, 15465);
+         sim_run(2000000UL);
+         sim_uart_rx(COMM_PORT_TETHER, "$PVRSR,0,0\r\n", 12);
+         sim_run(1000000UL);
+         printf("%.*s", (int)len, sim_uart_output(COMM_PORT_TETHER, &len));
+   @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Firmware entry point, main() of src/depth_sensor.c */
+int firmware_main(void);
+
+/** @name Simulation control */
+//@{
+
+/** Reset the simulated hardware to power up state
+ *
+ *  Must be called once before sim_run().  The firmware itself can only be
+ *  started once per process, its static state is not reset.
+ */
+void sim_init(void);
+
+/** Run the firmware for a span of virtual time
+ *
+ *  Starts firmware_main() on the first call and resumes it afterwards.
+ *
+ *  @param us virtual microseconds to run
+ */
+void sim_run(uint64_t us);
+
+/** Advance the virtual clock, servicing peripherals and interrupts, without
+ *  running the firmware main loop.  Used by the drivers' blocking waits. */
+void sim_advance_us(uint64_t us);
+
+/** @return Virtual time since sim_init() in microseconds */
+uint64_t sim_time_us(void);
+
+/** @return Virtual time spent in sleep_cpu() */
+uint64_t sim_sleep_us(void);
+
+/** @return Number of watchdog timeouts, each would have been a reset */
+unsigned long sim_wdt_timeouts(void);
+
+/** Call fn once, as soon as the firmware has written the register at addr
+ *
+ *  Only the drivers built with the register access hooks (sim/io.c) are
+ *  seen.  Lets a test advance the clock between two register accesses of
+ *  a driver, into the window an interrupt could fire in on the part.
+ */
+void sim_io_on_write(volatile void *addr, void (*fn)(void));
+//@}
+
+/** @name Virtual MS5541 */
+//@{
+#define SIM_MS5541_D1 0   ///< pressure channel
+#define SIM_MS5541_D2 1   ///< temperature channel
+
+/** Conversion time of the model, reading earlier counts an early read */
+#define SIM_MS5541_CONVERSION_US 35000UL
+
+/** Counters of the sensor model */
+struct SimMs5541Stats
+{
+    unsigned long conversions[2];   ///< D1 and D2 conversions started
+    unsigned long early_reads;      ///< results read before the conversion finished, read as 0
+    unsigned long faulted;          ///< conversions and reads changed by an event
+    unsigned long calibration_reads;///< calibration words read
+    unsigned long resets;           ///< reset sequences received
+    unsigned long protocol_errors;  ///< unknown commands or reads with no data
+};
+
+/** Set the four calibration words W1-W4 */
+void sim_ms5541_set_calibration(const uint16_t word[4]);
+
+/** Set a constant conversion result for a channel */
+void sim_ms5541_set_value(int channel, uint16_t value);
+
+/** Play a trace of conversion results on a channel
+ *
+ *  Every conversion takes the next value, the trace repeats when it ends.
+ *  The trace is not copied and must stay valid.
+ */
+void sim_ms5541_set_trace(int channel, const uint16_t *trace, size_t len);
+
+/** One point of a pressure and temperature profile */
+struct SimMs5541Point
+{
+    uint64_t time_us;               ///< virtual time of the point
+    double pressure_mBar;           ///< absolute pressure
+    double temp_C;                  ///< temperature in degree C
+};
+
+/** Play a profile on both channels
+ *
+ *  The conversions follow the profile, linearly interpolated between the
+ *  points and held before the first and after the last one.  The counts are
+ *  the inverse of the firmware compensation with the current calibration,
+ *  so the firmware reads the profile back to within a count.  A trace set
+ *  on a channel takes precedence.  The points must be in time order, are
+ *  not copied and must stay valid.  len 0 ends the profile.
+ */
+void sim_ms5541_set_profile(const struct SimMs5541Point *points, size_t len);
+
+/* Sensor events */
+#define SIM_MS5541_EVENT_SPIKE   0  ///< pressure offset by value mBar
+#define SIM_MS5541_EVENT_WAVE    1  ///< pressure offset by a sine of value mBar amplitude
+#define SIM_MS5541_EVENT_STUCK   2  ///< conversions repeat the last result
+#define SIM_MS5541_EVENT_DROPOUT 3  ///< the sensor does not answer, reads return 0xFF
+#define SIM_MS5541_EVENT_BAD_CAL 4  ///< calibration reads never repeat
+#define SIM_MS5541_EVENT_ANALOG  5  ///< analog transducer offset by value mBar, see sim_adc_set_value()
+#define SIM_MS5541_MAX_EVENTS    32
+
+/** A fault or disturbance active for a span of virtual time */
+struct SimMs5541Event
+{
+    int type;                       ///< SIM_MS5541_EVENT_*
+    uint64_t start_us;              ///< virtual time the event starts
+    uint64_t duration_us;           ///< how long it lasts
+    double value;                   ///< offset or amplitude in mBar
+    double period_us;               ///< period of a wave
+};
+
+/** Schedule an event, events may overlap
+ *  @return 0 if SIM_MS5541_MAX_EVENTS are already scheduled
+ */
+int sim_ms5541_add_event(const struct SimMs5541Event *event);
+
+/** Load a profile and events from a text file
+ *
+ *  One item per line, times in seconds of virtual time, '#' starts a
+ *  comment:
+ *  @code
+    <time> <pressure mBar> <temperature C>     profile point
+    spike <start> <duration> <mBar>
+    wave <start> <duration> <amplitude mBar> <period>
+    stuck <start> <duration>
+    dropout <start> <duration>
+    badcal <start> <duration>
+    analog <start> <duration> <mBar>
+    @endcode
+ *
+ *  @return 0 on success, -1 with a message on stderr otherwise
+ */
+int sim_ms5541_load(const char *path);
+
+const struct SimMs5541Stats *sim_ms5541_stats(void);
+//@}
+
+/** @name Virtual MCU ADC */
+//@{
+
+/** Transducer on ADC_PRESSURE at reset, 0.5-4.5 V on AVCC for 0-14 bar.
+ *  The firmware has to be told with "$PVRAT,102,819,14000". */
+//@{
+#define SIM_ADC_PRESSURE_ZERO       102     ///< counts at 0 mBar
+#define SIM_ADC_PRESSURE_SPAN       819     ///< counts from 0 to SIM_ADC_PRESSURE_SPAN_mBar
+#define SIM_ADC_PRESSURE_SPAN_mBar  14000
+//@}
+
+/** Set a constant reading of an ADC channel in counts, 0 at reset
+ *
+ *  ADC_PRESSURE instead follows the MS5541 pressure, with its waves but not
+ *  its faults, through the transducer of sim_adc_set_transducer() plus a
+ *  count of noise, and is offset by SIM_MS5541_EVENT_ANALOG events.
+ */
+void sim_adc_set_value(int channel, uint16_t counts);
+
+/** Set the transducer on ADC_PRESSURE, one that is not the part the
+ *  firmware was told of checks its span correction
+ *
+ *  @param zero      counts at 0 mBar
+ *  @param span      counts from zero to span_mBar
+ *  @param span_mBar pressure of the span
+ */
+void sim_adc_set_transducer(double zero, double span, double span_mBar);
+
+/** @return Conversions made since sim_init() */
+unsigned long sim_adc_conversions(void);
+//@}
+
+/** @name Virtual UARTs */
+//@{
+
+/** Counters of one virtual uart, the driver counts its own losses
+ *  (uart_get_stats()) */
+struct SimUartStats
+{
+    unsigned long tx_bytes;       ///< bytes put on the line
+    unsigned long tx_ignored;     ///< UDR writes ignored because UDRE was clear
+    unsigned long rx_bytes;       ///< bytes received
+    unsigned long rx_overruns;    ///< bytes lost because UDR was not read in time
+};
+
+/** Send bytes to the firmware, they arrive one by one at the line rate */
+void sim_uart_rx(int port, const char *data, size_t len);
+
+/** @return Everything the firmware transmitted since the last clear,
+ *          len receives the byte count */
+const char *sim_uart_output(int port, size_t *len);
+
+/** Discard the captured output */
+void sim_uart_clear_output(int port);
+
+/** @return Baudrate set by the firmware in UBRR */
+unsigned long sim_uart_baudrate(int port);
+
+const struct SimUartStats *sim_uart_stats(int port);
+//@}
+
+/** @name Virtual SPI */
+//@{
+
+/** Counters of the SPI model */
+struct SimSpiStats
+{
+    unsigned long bytes;          ///< bytes shifted
+    unsigned long collisions;     ///< SPDR writes ignored while shifting (WCOL)
+};
+
+const struct SimSpiStats *sim_spi_stats(void);
+//@}
+
+/** @name Eeprom */
+//@{
+
+/** Time the eeprom stays busy after a byte write */
+#define SIM_EEPROM_WRITE_US 8500UL
+
+/** Counters of the eeprom model */
+struct SimEepromStats
+{
+    unsigned long writes;       ///< bytes written
+    unsigned long stalls;       ///< writes that had to wait for the previous one
+    uint64_t stall_us;          ///< time spent waiting
+};
+
+const struct SimEepromStats *sim_eeprom_stats(void);
+//@}
+
+/** @name Model hooks, used by the peripheral models */
+//@{
+
+/** Run an interrupt handler the way the AVR does, with I cleared */
+void sim_interrupt(void (*vector)(void));
+
+/** Hand a register write of the firmware to its model, see sim/io.c */
+void sim_io_sync(void);
+void sim_ms5541_reset(void);
+void sim_ms5541_write(uint8_t byte);
+double sim_ms5541_analog_mBar(uint64_t now);
+uint8_t sim_ms5541_read(void);
+void sim_spi_reset(void);
+uint64_t sim_spi_next_event(void);
+void sim_spi_service(uint64_t now);
+void sim_spi_io_read(volatile void *addr);
+void sim_spi_io_write(volatile void *addr);
+void sim_uart_reset(void);
+uint64_t sim_uart_next_event(void);
+void sim_uart_service(uint64_t now);
+void sim_uart_io_read(volatile void *addr);
+void sim_uart_io_write(volatile void *addr);
+//@}
+
+#endif
@@ -0,0 +1,396 @@
+/** @file   sim_hw.c
+ *  @brief  Virtual clock, registers, Timer 3, ADC, watchdog and eeprom of
+ *          the host simulation
+ */
+
+#include "sim.h"
+
+#include <device.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+volatile uint8_t PORTA, DDRA, PINA;
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+volatile uint8_t PORTE, DDRE, PINE;
+volatile uint8_t PORTF, DDRF, PINF;
+volatile uint8_t PORTG, DDRG, PING;
+volatile uint8_t SREG;
+volatile uint8_t MCUCSR;
+volatile uint8_t TCCR3A, TCCR3B, ETIFR, ETIMSK;
+volatile uint16_t TCNT3, OCR3A;
+volatile uint8_t ADMUX, ADCSRA;
+volatile uint16_t ADCW;
+
+uint8_t sim_eeprom[E2END + 1];
+static uint64_t eeprom_busy_until_us;
+static struct SimEepromStats eeprom_stats;
+
+/** Firmware coroutine stack */
+#define SIM_STACK_SIZE (256 * 1024)
+
+static uint64_t now_us;
+static uint64_t run_end_us;
+static uint64_t slept_us;
+
+static ucontext_t host_ctx;
+static ucontext_t firmware_ctx;
+static char *firmware_stack;
+static char firmware_started;
+
+static char timer3_armed;
+static char timer3_flag;
+static uint64_t timer3_next_us;
+
+static char wdt_enabled;
+static uint64_t wdt_timeout_us;
+static uint64_t wdt_last_us;
+static unsigned long wdt_timeouts;
+
+static const unsigned int timer3_prescale[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+static char adc_armed;
+static char adc_flag;
+static uint64_t adc_start_us;
+static unsigned long adc_count;
+static unsigned long adc_conversions;
+static uint16_t adc_value[8];
+static uint32_t adc_noise;
+static double adc_pressure_zero;
+static double adc_pressure_counts_per_mBar;
+
+void sim_init(void) {
+    PORTA = DDRA = PINA = 0;
+    PORTB = DDRB = PINB = 0;
+    PORTC = DDRC = PINC = 0;
+    PORTD = DDRD = PIND = 0;
+    PORTE = DDRE = PINE = 0;
+    PORTF = DDRF = PINF = 0;
+    PORTG = DDRG = PING = 0;
+    SREG = 0;
+    MCUCSR = (1 << PORF);
+    TCCR3A = TCCR3B = ETIFR = ETIMSK = 0;
+    TCNT3 = OCR3A = 0;
+    ADMUX = ADCSRA = 0;
+    ADCW = 0;
+    adc_armed = 0;
+    adc_conversions = 0;
+    memset(adc_value, 0, sizeof(adc_value));
+    adc_noise = 1;
+    sim_adc_set_transducer(SIM_ADC_PRESSURE_ZERO, SIM_ADC_PRESSURE_SPAN,
+                           SIM_ADC_PRESSURE_SPAN_mBar);
+    memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+    eeprom_busy_until_us = 0;
+    memset(&eeprom_stats, 0, sizeof(eeprom_stats));
+
+    now_us = 0;
+    run_end_us = 0;
+    slept_us = 0;
+    timer3_armed = 0;
+    wdt_enabled = 0;
+    wdt_timeouts = 0;
+
+    sim_ms5541_reset();
+    sim_spi_reset();
+    sim_uart_reset();
+}
+
+uint64_t sim_time_us(void) {
+    return now_us;
+}
+
+uint64_t sim_sleep_us(void) {
+    return slept_us;
+}
+
+unsigned long sim_wdt_timeouts(void) {
+    return wdt_timeouts;
+}
+
+void sim_interrupt(void (*vector)(void)) {
+    SREG &= (uint8_t)~(1 << SREG_I);
+    vector();
+    sim_io_sync();
+    SREG |= (1 << SREG_I);
+}
+
+/** Timer 3 in CTC mode on OCR3A, the only mode the firmware uses.  The
+ *  registers are sampled whenever the clock advances, a configuration
+ *  change takes effect from the current virtual time.
+ *
+ *  Interrupt flags are write-one-to-clear on the AVR, which a plain variable
+ *  cannot model, so the compare flag is kept here and ETIFR is ignored. */
+static uint64_t sim_timer3_period_us(void) {
+    unsigned int prescale = timer3_prescale[TCCR3B & 0x07];
+
+    if (!prescale || !(TCCR3B & (1 << WGM32))) {
+        return 0;
+    }
+    return ((uint64_t)OCR3A + 1) * prescale * 1000000ULL / F_CPU;
+}
+
+static uint64_t sim_timer3_next_event(void) {
+    uint64_t period = sim_timer3_period_us();
+
+    if (!period) {
+        timer3_armed = 0;
+        return UINT64_MAX;
+    }
+    if (!timer3_armed) {
+        timer3_armed = 1;
+        timer3_flag = 0;
+        timer3_next_us = now_us + period;
+    }
+    return timer3_next_us;
+}
+
+static void sim_timer3_service(void) {
+    if (timer3_armed && now_us >= timer3_next_us) {
+        timer3_flag = 1;
+        timer3_next_us += sim_timer3_period_us();
+    }
+    if (timer3_flag && (ETIMSK & (1 << OCIE3A)) && (SREG & (1 << SREG_I))) {
+        timer3_flag = 0;
+        sim_interrupt(TIMER3_COMPA_vect);
+    }
+}
+
+void sim_adc_set_value(int channel, uint16_t counts) {
+    adc_value[channel & 7] = counts;
+}
+
+void sim_adc_set_transducer(double zero, double span, double span_mBar) {
+    adc_pressure_zero = zero;
+    adc_pressure_counts_per_mBar = span / span_mBar;
+}
+
+unsigned long sim_adc_conversions(void) {
+    return adc_conversions;
+}
+
+/** Free running mode: 13 ADC clocks per conversion at the prescaler of
+ *  ADPS.  Like Timer 3 the registers are sampled as the clock advances,
+ *  and the interrupt flag is kept here. */
+static uint64_t sim_adc_conversion_at(unsigned long n) {
+    unsigned int prescale = 1 << (ADCSRA & 0x07);
+
+    if (prescale == 1) {
+        prescale = 2;
+    }
+    return adc_start_us + (uint64_t)n * 13 * prescale * 1000000ULL / F_CPU;
+}
+
+static uint64_t sim_adc_next_event(void) {
+    if ((ADCSRA & ((1 << ADEN) | (1 << ADFR))) != ((1 << ADEN) | (1 << ADFR))) {
+        adc_armed = 0;
+        return UINT64_MAX;
+    }
+    if (!adc_armed) {
+        adc_armed = 1;
+        adc_flag = 0;
+        adc_start_us = now_us;
+        adc_count = 0;
+    }
+    return sim_adc_conversion_at(adc_count + 1);
+}
+
+/** Reading of the selected channel, the pressure transducer follows the
+ *  MS5541 model */
+static uint16_t sim_adc_reading(void) {
+    unsigned char channel = ADMUX & 0x07;
+    double counts;
+
+    if (channel != ADC_PRESSURE) {
+        return adc_value[channel];
+    }
+    adc_noise = adc_noise * 1103515245 + 12345;
+    counts = adc_pressure_zero + sim_ms5541_analog_mBar(now_us) * adc_pressure_counts_per_mBar +
+             ((adc_noise >> 16) & 0x7FFF) / 16383.5 - 1.0;
+    if (counts < 0) {
+        return 0;
+    }
+    return counts > 1023 ? 1023 : (uint16_t)lround(counts);
+}
+
+static void sim_adc_service(void) {
+    if (adc_armed && now_us >= sim_adc_conversion_at(adc_count + 1)) {
+        adc_count++;
+        adc_conversions++;
+        ADCW = sim_adc_reading();
+        adc_flag = 1;
+    }
+    if (adc_flag && (ADCSRA & (1 << ADIE)) && (SREG & (1 << SREG_I))) {
+        adc_flag = 0;
+        sim_interrupt(ADC_vect);
+    }
+}
+
+static void sim_wdt_service(void) {
+    if (wdt_enabled && now_us - wdt_last_us > wdt_timeout_us) {
+        wdt_timeouts++;
+        wdt_last_us = now_us;
+    }
+}
+
+void sim_advance_us(uint64_t us) {
+    uint64_t end = now_us + us;
+    uint64_t next;
+
+    sim_io_sync();
+    for (;;) {
+        sim_timer3_service();
+        sim_adc_service();
+        sim_uart_service(now_us);
+        sim_spi_service(now_us);
+        sim_wdt_service();
+
+        next = sim_timer3_next_event();
+        if (sim_adc_next_event() < next) {
+            next = sim_adc_next_event();
+        }
+        if (sim_uart_next_event() < next) {
+            next = sim_uart_next_event();
+        }
+        if (sim_spi_next_event() < next) {
+            next = sim_spi_next_event();
+        }
+        if (next > end) {
+            break;
+        }
+        //an event held off by a cleared I flag must not stall the clock
+        now_us = next > now_us ? next : now_us + 1;
+    }
+    now_us = end;
+}
+
+/** Hand control back to sim_run() once the run is over */
+static void sim_yield_if_done(void) {
+    if (now_us >= run_end_us) {
+        swapcontext(&firmware_ctx, &host_ctx);
+    }
+}
+
+/** Sleep until the next interrupt, at the latest the next 1 mS sysclk tick */
+void sim_sleep(void) {
+    uint64_t next_tick = (now_us / 1000 + 1) * 1000;
+    uint64_t next = next_tick;
+
+    sim_io_sync();
+    if (sim_timer3_next_event() < next) {
+        next = sim_timer3_next_event();
+    }
+    if (sim_adc_next_event() < next) {
+        next = sim_adc_next_event();
+    }
+    if (sim_uart_next_event() < next) {
+        next = sim_uart_next_event();
+    }
+    if (sim_spi_next_event() < next) {
+        next = sim_spi_next_event();
+    }
+    if (next < now_us) {
+        next = now_us;
+    }
+    slept_us += next - now_us;
+    sim_advance_us(next - now_us);
+    sim_yield_if_done();
+}
+
+void sim_delay_us(double us) {
+    sim_advance_us((uint64_t)us);
+    sim_yield_if_done();
+}
+
+static void sim_firmware_entry(void) {
+    firmware_main();
+    fprintf(stderr, "sim: firmware main() returned\n");
+    exit(1);
+}
+
+void sim_run(uint64_t us) {
+    run_end_us = now_us + us;
+
+    if (!firmware_started) {
+        firmware_started = 1;
+        firmware_stack = malloc(SIM_STACK_SIZE);
+        getcontext(&firmware_ctx);
+        firmware_ctx.uc_stack.ss_sp = firmware_stack;
+        firmware_ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+        firmware_ctx.uc_link = 0;
+        makecontext(&firmware_ctx, sim_firmware_entry, 0);
+    }
+    swapcontext(&host_ctx, &firmware_ctx);
+}
+
+void sim_wdt_enable(unsigned char timeout) {
+    wdt_enabled = 1;
+    wdt_timeout_us = 15000ULL << timeout;
+    wdt_last_us = now_us;
+}
+
+void sim_wdt_disable(void) {
+    wdt_enabled = 0;
+}
+
+void sim_wdt_reset(void) {
+    wdt_last_us = now_us;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+    return sim_eeprom[(uintptr_t)addr & E2END];
+}
+
+int sim_eeprom_ready(void) {
+    return now_us >= eeprom_busy_until_us;
+}
+
+/** Like avr-libc, waits for the previous write to finish first */
+void eeprom_write_byte(uint8_t *addr, uint8_t value) {
+    if (!sim_eeprom_ready()) {
+        eeprom_stats.stalls++;
+        eeprom_stats.stall_us += eeprom_busy_until_us - now_us;
+        sim_advance_us(eeprom_busy_until_us - now_us);
+    }
+    sim_eeprom[(uintptr_t)addr & E2END] = value;
+    eeprom_busy_until_us = now_us + SIM_EEPROM_WRITE_US;
+    eeprom_stats.writes++;
+}
+
+const struct SimEepromStats *sim_eeprom_stats(void) {
+    return &eeprom_stats;
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value) {
+    eeprom_write_byte(addr, value);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    while (n--) {
+        *d++ = eeprom_read_byte(s++);
+    }
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t n) {
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+
+    while (n--) {
+        eeprom_write_byte(d++, *s++);
+    }
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+    eeprom_write_block(src, dst, n);
+}
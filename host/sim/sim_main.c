@@ -0,0 +1,160 @@
+/** @file   sim_main.c
+ *  @brief  Command line runner for the host simulation
+ *
+ *          Runs the firmware for a span of virtual time and writes what it
+ *          sent on the tether to stdout, counters go to stderr.
+ *
+ *          usage: depth_sensor_sim [-t seconds] [-c command]... [-e file] [-a file] [-p d1]
+ *                                  [-f profile] [-q]
+ *
+ *          -t  virtual run time, default 5 s
+ *          -c  tether command sent one second into the run, "\r\n" is
+ *              appended, may be repeated
+ *          -e  eeprom image, loaded before the run if it exists and saved
+ *              after it, so settings persist between runs
+ *          -a  file to write what was sent on the accessory port to
+ *          -p  constant raw pressure datum D1
+ *          -f  pressure and temperature profile with sensor events, see
+ *              sim_ms5541_load(), e.g. a 10 hour dive runs in seconds
+ *          -q  do not print the counters
+ */
+
+#include "sim.h"
+
+#include <device.h>
+#include <depth.h>
+#include <fusion.h>
+#include <uart.h>
+
+#include <avr/eeprom.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_MAX_COMMANDS 16
+
+int main(int argc, char **argv) {
+    const char *commands[SIM_MAX_COMMANDS];
+    const char *eeprom_file = NULL;
+    const char *accessory_file = NULL;
+    const char *profile_file = NULL;
+    FILE *f;
+    int command_cnt = 0;
+    double seconds = 5.0;
+    int quiet = 0;
+    long d1 = -1;
+    int opt, i;
+    const char *out;
+    size_t len;
+    const struct SimMs5541Stats *ms;
+    const struct SimUartStats *us;
+    struct UART_Stats ds;
+    const struct SimEepromStats *es;
+
+    while ((opt = getopt(argc, argv, "t:c:e:a:p:f:q")) != -1) {
+        switch (opt) {
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'c':
+                if (command_cnt < SIM_MAX_COMMANDS) {
+                    commands[command_cnt++] = optarg;
+                }
+                break;
+            case 'e':
+                eeprom_file = optarg;
+                break;
+            case 'a':
+                accessory_file = optarg;
+                break;
+            case 'p':
+                d1 = strtol(optarg, NULL, 0);
+                break;
+            case 'f':
+                profile_file = optarg;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-c command]... [-e file] [-a file] [-p d1]"
+                        " [-f profile] [-q]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    sim_init();
+    if (d1 >= 0) {
+        sim_ms5541_set_value(SIM_MS5541_D1, (uint16_t)d1);
+    }
+    if (profile_file && sim_ms5541_load(profile_file) < 0) {
+        return 1;
+    }
+
+    if (eeprom_file && (f = fopen(eeprom_file, "rb")) != NULL) {
+        if (fread(sim_eeprom, 1, sizeof(sim_eeprom), f) != sizeof(sim_eeprom)) {
+            fprintf(stderr, "%s: short eeprom image\n", eeprom_file);
+        }
+        fclose(f);
+    }
+
+    if (command_cnt && seconds > 1.0) {
+        sim_run(1000000ULL);
+        for (i = 0; i < command_cnt; i++) {
+            sim_uart_rx(COMM_PORT_TETHER, commands[i], strlen(commands[i]));
+            sim_uart_rx(COMM_PORT_TETHER, "\r\n", 2);
+        }
+        seconds -= 1.0;
+    }
+    sim_run((uint64_t)(seconds * 1000000.0));
+
+    if (eeprom_file) {
+        if ((f = fopen(eeprom_file, "wb")) == NULL ||
+            fwrite(sim_eeprom, 1, sizeof(sim_eeprom), f) != sizeof(sim_eeprom)) {
+            fprintf(stderr, "%s: cannot save eeprom image\n", eeprom_file);
+        }
+        if (f) {
+            fclose(f);
+        }
+    }
+
+    out = sim_uart_output(COMM_PORT_TETHER, &len);
+    fwrite(out, 1, len, stdout);
+
+    if (accessory_file && (f = fopen(accessory_file, "wb")) != NULL) {
+        out = sim_uart_output(COMM_PORT_ACCESSORY, &len);
+        fwrite(out, 1, len, f);
+        fclose(f);
+    }
+
+    if (!quiet) {
+        ms = sim_ms5541_stats();
+        us = sim_uart_stats(COMM_PORT_TETHER);
+        fprintf(stderr, "time %.3f s, asleep %.1f %%\n", sim_time_us() / 1e6,
+                100.0 * sim_sleep_us() / (sim_time_us() ? sim_time_us() : 1));
+        fprintf(stderr, "ms5541: d1 %lu d2 %lu early reads %lu cal reads %lu resets %lu errors %lu faulted %lu\n",
+                ms->conversions[SIM_MS5541_D1], ms->conversions[SIM_MS5541_D2],
+                ms->early_reads, ms->calibration_reads, ms->resets, ms->protocol_errors,
+                ms->faulted);
+        fprintf(stderr, "depth: %.2f mBar, status 0x%02X, rejected %u, read errors %u\n",
+                depth_cmBar() / 100.0, depth_status(), depth_reject_count(), depth_read_errors());
+        if (fusion_enabled()) {
+            fprintf(stderr, "fusion: %.2f mBar, analog %.2f mBar, bias %.2f mBar, span %+.2f %%,"
+                    " status 0x%02X, disagreements %u, adc conversions %lu\n",
+                    fusion_cmBar() / 100.0, fusion_analog_cmBar() / 100.0,
+                    fusion_bias_cmBar() / 100.0, fusion_span_correction() / 100.0,
+                    fusion_status(), fusion_disagree_count(), sim_adc_conversions());
+        }
+        uart_get_stats(COMM_PORT_TETHER, &ds);
+        fprintf(stderr, "tether: %lu baud, tx %lu dropped %u, rx %lu overruns %lu dropped %u\n",
+                sim_uart_baudrate(COMM_PORT_TETHER), us->tx_bytes, ds.tx_dropped,
+                us->rx_bytes, us->rx_overruns, ds.rx_dropped);
+        es = sim_eeprom_stats();
+        fprintf(stderr, "eeprom: writes %lu, stalled %lu for %.1f mS\n",
+                es->writes, es->stalls, es->stall_us / 1e3);
+        fprintf(stderr, "watchdog timeouts %lu\n", sim_wdt_timeouts());
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+/** @file   spi.c
+ *  @brief  SPI master of the host simulation, the only device on the bus is
+ *          the virtual MS5541
+ *
+ *          Register level model of the atmega128 SPI in master mode, driven
+ *          by the firmware driver src/spi.c.  A byte written to SPDR is
+ *          shifted for 8 clocks at the rate set by SPR1:0 and SPI2X, a write
+ *          while a byte is shifting is ignored and sets WCOL.  When the byte
+ *          is done SPDR holds the received byte and SPIF is set; SPIF is
+ *          cleared by reading SPSR with it set and then accessing SPDR, or by
+ *          running the transfer complete vector.  Reading SPSR while a byte
+ *          is shifting advances the clock to its end, so the driver's
+ *          busy-wait on SPIF takes the byte time.
+ *
+ *          The MS5541 is half duplex and the driver clocks its commands
+ *          with data sampled on the leading edge and reads its results on
+ *          the trailing edge, so a byte sent with CPHA clear goes to the
+ *          model as a command byte and a byte sent with CPHA set reads a
+ *          result byte.  With the enable line low MISO reads all ones.
+ */
+
+#include "sim.h"
+
+#include <device.h>
+
+#include <avr/interrupt.h>
+
+#include <string.h>
+
+volatile uint8_t SPCR, SPSR, SPDR;
+
+struct SimSpi
+{
+    char busy;                  ///< a byte is shifting
+    uint64_t done_us;
+    uint8_t out;                ///< byte being shifted out
+    uint8_t rx;                 ///< receive buffer, read through SPDR
+    char spi2x;                 ///< writable bit of SPSR
+    char spif;
+    char spif_seen;             ///< SPSR read with SPIF set, the next SPDR access clears it
+    char wcol;
+    struct SimSpiStats stats;
+};
+
+static struct SimSpi spi;
+
+/** @return Time to shift one byte at the set SCK rate */
+static uint64_t sim_spi_byte_us(void) {
+    static const unsigned char divisor[4] = {4, 16, 64, 128};
+    unsigned long clocks = 8UL * divisor[SPCR & ((1 << SPR1) | (1 << SPR0))];
+
+    if (spi.spi2x) {
+        clocks /= 2;
+    }
+    return (clocks * 1000000ULL + F_CPU / 2) / F_CPU;
+}
+
+/** Publish the flags of the model in SPSR */
+static void sim_spi_update(void) {
+    SPSR = (spi.spif ? (1 << SPIF) : 0) |
+           (spi.wcol ? (1 << WCOL) : 0) |
+           (spi.spi2x ? (1 << SPI2X) : 0);
+}
+
+void sim_spi_reset(void) {
+    memset(&spi, 0, sizeof(spi));
+    SPCR = 0;
+    SPDR = 0;
+    sim_spi_update();
+}
+
+/** A SPDR access after SPSR was read with SPIF set clears SPIF and WCOL */
+static void sim_spi_data_access(void) {
+    if (spi.spif_seen) {
+        spi.spif_seen = 0;
+        spi.spif = 0;
+        spi.wcol = 0;
+        sim_spi_update();
+    }
+}
+
+/** Exchange the byte that has been shifted with the device */
+static void sim_spi_exchange(uint8_t out) {
+    if (!(DEPTH_ENABLE_PORT & DEPTH_ENABLE)) {
+        spi.rx = 0xFF;
+    } else if (SPCR & (1 << CPHA)) {
+        spi.rx = sim_ms5541_read();
+    } else {
+        sim_ms5541_write(out);
+        spi.rx = 0;
+    }
+}
+
+void sim_spi_io_read(volatile void *addr) {
+    if (addr == &SPSR) {
+        if (spi.busy) {
+            /* a busy-wait on SPIF, let the byte finish */
+            sim_advance_us(spi.done_us - sim_time_us());
+        }
+        if (spi.spif) {
+            spi.spif_seen = 1;
+        }
+    } else if (addr == &SPDR) {
+        SPDR = spi.rx;
+        sim_spi_data_access();
+    }
+}
+
+void sim_spi_io_write(volatile void *addr) {
+    if (addr == &SPDR) {
+        sim_spi_data_access();
+        if (!(SPCR & (1 << SPE)) || !(SPCR & (1 << MSTR))) {
+            return;
+        }
+        if (spi.busy) {
+            spi.wcol = 1;
+            spi.stats.collisions++;
+            sim_spi_update();
+            return;
+        }
+        spi.out = SPDR;
+        spi.busy = 1;
+        spi.done_us = sim_time_us() + sim_spi_byte_us();
+    } else if (addr == &SPSR) {
+        spi.spi2x = (SPSR & (1 << SPI2X)) != 0;
+        sim_spi_update();
+    }
+}
+
+uint64_t sim_spi_next_event(void) {
+    if (spi.spif && (SPCR & (1 << SPIE)) && (SREG & (1 << SREG_I))) {
+        return sim_time_us();
+    }
+    return spi.busy ? spi.done_us : UINT64_MAX;
+}
+
+void sim_spi_service(uint64_t now) {
+    if (spi.busy && spi.done_us <= now) {
+        spi.busy = 0;
+        sim_spi_exchange(spi.out);
+        spi.stats.bytes++;
+        SPDR = spi.rx;
+        spi.spif = 1;
+        sim_spi_update();
+    }
+    if (spi.spif && (SPCR & (1 << SPIE)) && (SREG & (1 << SREG_I))) {
+        /* the vector clears SPIF */
+        spi.spif = 0;
+        spi.spif_seen = 0;
+        sim_spi_update();
+        sim_interrupt(SPI_STC_vect);
+    }
+}
+
+const struct SimSpiStats *sim_spi_stats(void) {
+    return &spi.stats;
+}
@@ -0,0 +1,27 @@
+/** @file   sysclk.c
+ *  @brief  System clock of the host simulation, derived from the virtual clock
+ */
+
+#include "sim.h"
+
+#include <sysclk.h>
+
+/** Timer 2 counts per mS, OCR2 = 230 at F_CPU/64 on the real hardware */
+#define SYSCLK_COUNTS_PER_mS 230
+
+void sysclk_init(void) {
+}
+
+unsigned long get_time(void) {
+    uint64_t us = sim_time_us();
+
+    return (unsigned long)(((us / 1000) << 8) | ((us % 1000) * SYSCLK_COUNTS_PER_mS / 1000));
+}
+
+void sysclk_wait_mS(unsigned int mS) {
+    sim_advance_us((uint64_t)mS * 1000);
+}
+
+unsigned long get_sysclk_ticks(void) {
+    return get_time() & ~0xFFUL;
+}
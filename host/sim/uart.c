@@ -0,0 +1,310 @@
+/** @file   uart.c
+ *  @brief  USART 0 and 1 of the host simulation
+ *
+ *          Register level model of the atmega128 usarts, driven by the
+ *          firmware driver src/uart.c.  The line runs at the baudrate set in
+ *          UBRRn (and U2X) with 10 bit times per byte, the character size and
+ *          parity settings are not modelled.
+ *
+ *          Transmit is double buffered like the part: a byte written to UDRn
+ *          moves on to the shift register as soon as that is free, leaves it
+ *          a byte time later and is captured.  A write while UDRE is clear is
+ *          ignored.  Injected receive bytes arrive one byte time apart into
+ *          the two byte receive fifo; a byte arriving with the fifo full is
+ *          lost and flags a data overrun (DOR) until UDRn is read.
+ *
+ *          The receive complete, data register empty and transmit complete
+ *          interrupts fire while their flag and enable bit are set.  TXC is
+ *          cleared by its vector or by writing a one to it.
+ */
+
+#include "sim.h"
+
+#include <device.h>
+#include <uart.h>
+
+#include <avr/interrupt.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+volatile uint8_t UDR0, UCSR0A, UCSR0B, UCSR0C, UBRR0L, UBRR0H;
+volatile uint8_t UDR1, UCSR1A, UCSR1B, UCSR1C, UBRR1L, UBRR1H;
+
+/** Depth of the receive fifo, UDRn and one byte behind it */
+#define SIM_UART_RX_FIFO 2
+
+/** Interrupts handled per port and service call, a handler that never
+ *  clears its condition would spin the real part forever */
+#define SIM_UART_MAX_IRQS 8
+
+/** Registers and vectors of one usart */
+struct SimUartPort
+{
+    volatile uint8_t *udr;
+    volatile uint8_t *ucsra;
+    volatile uint8_t *ucsrb;
+    volatile uint8_t *ucsrc;
+    volatile uint8_t *ubrrl;
+    volatile uint8_t *ubrrh;
+    void (*rx_vect)(void);
+    void (*udre_vect)(void);
+    void (*tx_vect)(void);
+};
+
+static const struct SimUartPort ports[MAX_UARTS] = {
+    { &UDR0, &UCSR0A, &UCSR0B, &UCSR0C, &UBRR0L, &UBRR0H,
+      USART0_RX_vect, USART0_UDRE_vect, USART0_TX_vect },
+    { &UDR1, &UCSR1A, &UCSR1B, &UCSR1C, &UBRR1L, &UBRR1H,
+      USART1_RX_vect, USART1_UDRE_vect, USART1_TX_vect },
+};
+
+struct SimUart
+{
+    uint8_t ucsra;              ///< writable bits of UCSRnA, U2X and MPCM
+
+    uint8_t tdr;                ///< transmit data register
+    char tdr_full;              ///< UDRE clear
+    char shift_busy;            ///< a byte is on the line
+    uint8_t shift;
+    uint64_t shift_done_us;
+    char txc;                   ///< transmit complete flag
+
+    uint8_t rx_fifo[SIM_UART_RX_FIFO];
+    unsigned char rx_cnt;       ///< RXC while non zero
+    char dor;                   ///< a byte was lost since UDRn was last read
+
+    char *rx_pending;           ///< injected bytes not yet on the line
+    size_t rx_pending_len;
+    size_t rx_pending_pos;
+    uint64_t rx_next_us;
+
+    char *output;               ///< captured transmit data
+    size_t output_len;
+    size_t output_size;
+
+    struct SimUartStats stats;
+};
+
+static struct SimUart uarts[MAX_UARTS];
+
+/** @return Bit rate divisor of the port, 16 or 8 clocks per bit times UBRR + 1 */
+static unsigned long sim_uart_divisor(int port) {
+    const struct SimUartPort *p = &ports[port];
+    unsigned long ubrr = ((*p->ubrrh & 0x0F) << 8) | *p->ubrrl;
+
+    return (uarts[port].ucsra & (1 << U2X) ? 8 : 16) * (ubrr + 1);
+}
+
+static uint64_t sim_uart_byte_us(int port) {
+    return (10ULL * sim_uart_divisor(port) * 1000000ULL + F_CPU / 2) / F_CPU;
+}
+
+/** Publish the flags of the model in UCSRnA */
+static void sim_uart_update(int port) {
+    struct SimUart *u = &uarts[port];
+
+    *ports[port].ucsra = u->ucsra |
+                         (u->rx_cnt ? (1 << RXC) : 0) |
+                         (u->txc ? (1 << TXC) : 0) |
+                         (u->tdr_full ? 0 : (1 << UDRE)) |
+                         (u->rx_cnt && u->dor ? (1 << DOR) : 0);
+}
+
+void sim_uart_reset(void) {
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        free(uarts[i].rx_pending);
+        free(uarts[i].output);
+        memset(&uarts[i], 0, sizeof(uarts[i]));
+        *ports[i].udr = 0;
+        *ports[i].ucsrb = 0;
+        *ports[i].ucsrc = (1 << UCSZ1) | (1 << UCSZ0);
+        *ports[i].ubrrl = 0;
+        *ports[i].ubrrh = 0;
+        sim_uart_update(i);
+    }
+}
+
+static void sim_uart_capture(struct SimUart *u, char c) {
+    if (u->output_len == u->output_size) {
+        u->output_size = u->output_size ? 2 * u->output_size : 4096;
+        u->output = realloc(u->output, u->output_size);
+    }
+    u->output[u->output_len++] = c;
+    u->stats.tx_bytes++;
+}
+
+/** Move the transmit data register to the idle shift register */
+static void sim_uart_tx_start(int port, uint64_t now) {
+    struct SimUart *u = &uarts[port];
+
+    u->shift = u->tdr;
+    u->tdr_full = 0;
+    u->shift_busy = 1;
+    u->shift_done_us = now + sim_uart_byte_us(port);
+}
+
+void sim_uart_io_read(volatile void *addr) {
+    struct SimUart *u;
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        if (addr != ports[i].udr) {
+            continue;
+        }
+        u = &uarts[i];
+        if (u->rx_cnt) {
+            *ports[i].udr = u->rx_fifo[0];
+            u->rx_fifo[0] = u->rx_fifo[1];
+            u->rx_cnt--;
+        }
+        u->dor = 0;
+        sim_uart_update(i);
+    }
+}
+
+void sim_uart_io_write(volatile void *addr) {
+    struct SimUart *u;
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        u = &uarts[i];
+        if (addr == ports[i].udr) {
+            if (!(*ports[i].ucsrb & (1 << TXEN))) {
+                continue;
+            }
+            if (u->tdr_full) {
+                u->stats.tx_ignored++;
+                continue;
+            }
+            u->tdr = *ports[i].udr;
+            u->tdr_full = 1;
+            if (!u->shift_busy) {
+                sim_uart_tx_start(i, sim_time_us());
+            }
+            sim_uart_update(i);
+        } else if (addr == ports[i].ucsra) {
+            if (*ports[i].ucsra & (1 << TXC)) {
+                u->txc = 0;
+            }
+            u->ucsra = *ports[i].ucsra & ((1 << U2X) | (1 << MPCM));
+            sim_uart_update(i);
+        }
+    }
+}
+
+/** @return 1 if an enabled interrupt of the port is pending */
+static char sim_uart_irq_pending(int port) {
+    const struct SimUart *u = &uarts[port];
+    uint8_t ucsrb = *ports[port].ucsrb;
+
+    return (u->rx_cnt && (ucsrb & (1 << RXCIE))) ||
+           (!u->tdr_full && (ucsrb & (1 << UDRIE))) ||
+           (u->txc && (ucsrb & (1 << TXCIE)));
+}
+
+/** Run the highest priority pending interrupt of a port, receive first
+ *  like the vector table */
+static void sim_uart_irq(int port) {
+    struct SimUart *u = &uarts[port];
+    uint8_t ucsrb = *ports[port].ucsrb;
+
+    if (u->rx_cnt && (ucsrb & (1 << RXCIE))) {
+        sim_interrupt(ports[port].rx_vect);
+    } else if (!u->tdr_full && (ucsrb & (1 << UDRIE))) {
+        sim_interrupt(ports[port].udre_vect);
+    } else if (u->txc && (ucsrb & (1 << TXCIE))) {
+        u->txc = 0;
+        sim_uart_update(port);
+        sim_interrupt(ports[port].tx_vect);
+    }
+}
+
+uint64_t sim_uart_next_event(void) {
+    uint64_t next = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        if ((SREG & (1 << SREG_I)) && sim_uart_irq_pending(i)) {
+            return sim_time_us();
+        }
+        if (uarts[i].shift_busy && uarts[i].shift_done_us < next) {
+            next = uarts[i].shift_done_us;
+        }
+        if (uarts[i].rx_pending_pos < uarts[i].rx_pending_len && uarts[i].rx_next_us < next) {
+            next = uarts[i].rx_next_us;
+        }
+    }
+    return next;
+}
+
+void sim_uart_service(uint64_t now) {
+    struct SimUart *u;
+    int i, n;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        u = &uarts[i];
+
+        while (u->shift_busy && u->shift_done_us <= now) {
+            sim_uart_capture(u, u->shift);
+            u->shift_busy = 0;
+            if (u->tdr_full) {
+                sim_uart_tx_start(i, u->shift_done_us);
+            } else {
+                u->txc = 1;
+            }
+        }
+
+        while (u->rx_pending_pos < u->rx_pending_len && u->rx_next_us <= now) {
+            if (*ports[i].ucsrb & (1 << RXEN)) {
+                if (u->rx_cnt < SIM_UART_RX_FIFO) {
+                    u->rx_fifo[u->rx_cnt++] = u->rx_pending[u->rx_pending_pos];
+                    u->stats.rx_bytes++;
+                } else {
+                    u->dor = 1;
+                    u->stats.rx_overruns++;
+                }
+            }
+            u->rx_pending_pos++;
+            u->rx_next_us += sim_uart_byte_us(i);
+        }
+        sim_uart_update(i);
+
+        for (n = 0; n < SIM_UART_MAX_IRQS && (SREG & (1 << SREG_I)) && sim_uart_irq_pending(i); n++) {
+            sim_uart_irq(i);
+        }
+    }
+}
+
+void sim_uart_rx(int port, const char *data, size_t len) {
+    struct SimUart *u = &uarts[port];
+    size_t left = u->rx_pending_len - u->rx_pending_pos;
+
+    if (left == 0) {
+        u->rx_next_us = sim_time_us() + sim_uart_byte_us(port);
+    }
+    memmove(u->rx_pending, u->rx_pending + u->rx_pending_pos, left);
+    u->rx_pending = realloc(u->rx_pending, left + len);
+    memcpy(u->rx_pending + left, data, len);
+    u->rx_pending_len = left + len;
+    u->rx_pending_pos = 0;
+}
+
+const char *sim_uart_output(int port, size_t *len) {
+    *len = uarts[port].output_len;
+    return uarts[port].output;
+}
+
+void sim_uart_clear_output(int port) {
+    uarts[port].output_len = 0;
+}
+
+unsigned long sim_uart_baudrate(int port) {
+    return (F_CPU + sim_uart_divisor(port) / 2) / sim_uart_divisor(port);
+}
+
+const struct SimUartStats *sim_uart_stats(int port) {
+    return &uarts[port].stats;
+}
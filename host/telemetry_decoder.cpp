@@ -0,0 +1,164 @@
+/** @file   telemetry_decoder.cpp
+ *  @brief  Host side streaming decoder for the binary telemetry frames
+ */
+
+#include "telemetry_decoder.h"
+
+#include <cstring>
+
+namespace telemetry {
+
+Decoder::Decoder(FrameHandler handler, FilterHandler filter_handler)
+    : handler_(handler), filter_handler_(filter_handler), carry_len_(0) {
+    std::memset(&stats_, 0, sizeof(stats_));
+}
+
+void Decoder::reset() {
+    carry_len_ = 0;
+}
+
+uint16_t Decoder::crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = TELEMETRY_CRC_INIT;
+
+    while (len--) {
+        crc ^= static_cast<uint16_t>(*data++) << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021)
+                                 : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* Total length of a frame type, 0 for unknown types */
+size_t Decoder::frame_len(uint8_t type) {
+    switch (type) {
+    case TELEMETRY_TYPE_DEPTH:  return TELEMETRY_DEPTH_FRAME_LEN;
+    case TELEMETRY_TYPE_FILTER: return TELEMETRY_FILTER_FRAME_LEN;
+    case TELEMETRY_TYPE_RAW:    return TELEMETRY_RAW_FRAME_LEN;
+    case TELEMETRY_TYPE_SETUP:  return TELEMETRY_SETUP_FRAME_LEN;
+    default:                    return 0;
+    }
+}
+
+/* Check as much of a candidate frame as is available, so garbage is
+ * rejected as early as possible instead of waiting for a full frame. */
+Decoder::Check Decoder::check(const uint8_t *p, size_t avail) {
+    if (p[0] != TELEMETRY_SYNC1) {
+        return FRAME_INVALID;
+    }
+    if (avail > 1 && p[1] != TELEMETRY_SYNC2) {
+        return FRAME_INVALID;
+    }
+    if (avail <= TELEMETRY_OFS_TYPE) {
+        return FRAME_INCOMPLETE;
+    }
+    size_t len = frame_len(p[TELEMETRY_OFS_TYPE]);
+    if (len == 0) {
+        return FRAME_INVALID;
+    }
+    if (avail > TELEMETRY_OFS_LEN &&
+        p[TELEMETRY_OFS_LEN] != len - TELEMETRY_HEADER_LEN - TELEMETRY_CRC_LEN) {
+        return FRAME_INVALID;
+    }
+    if (avail < len) {
+        return FRAME_INCOMPLETE;
+    }
+
+    size_t crc_ofs = len - TELEMETRY_CRC_LEN;
+    uint16_t crc = static_cast<uint16_t>(p[crc_ofs] | (p[crc_ofs + 1] << 8));
+    if (crc16(p + TELEMETRY_OFS_TYPE, crc_ofs - TELEMETRY_OFS_TYPE) != crc) {
+        stats_.crc_errors++;
+        return FRAME_INVALID;
+    }
+    return FRAME_VALID;
+}
+
+void Decoder::deliver(const uint8_t *p) {
+    stats_.frames++;
+    switch (p[TELEMETRY_OFS_TYPE]) {
+    case TELEMETRY_TYPE_DEPTH:
+        if (handler_) {
+            handler_(DepthFrameView(p));
+        }
+        break;
+    case TELEMETRY_TYPE_FILTER:
+        if (filter_handler_) {
+            filter_handler_(FilterFrameView(p));
+        }
+        break;
+    case TELEMETRY_TYPE_RAW:
+        if (raw_handler_) {
+            raw_handler_(RawFrameView(p));
+        }
+        break;
+    case TELEMETRY_TYPE_SETUP:
+        if (setup_handler_) {
+            setup_handler_(SetupFrameView(p));
+        }
+        break;
+    }
+}
+
+void Decoder::drop_carry_byte() {
+    std::memmove(carry_, carry_ + 1, --carry_len_);
+    stats_.skipped_bytes++;
+}
+
+/* Resolve the carry buffer as far as possible, returns frames delivered */
+size_t Decoder::drain_carry() {
+    size_t frames = 0;
+
+    while (carry_len_ > 0) {
+        Check c = check(carry_, carry_len_);
+        if (c == FRAME_INCOMPLETE) {
+            break;
+        }
+        if (c == FRAME_VALID) {
+            frames++;
+            deliver(carry_);
+            carry_len_ = 0;
+        } else {
+            drop_carry_byte();
+        }
+    }
+    return frames;
+}
+
+size_t Decoder::feed(const uint8_t *data, size_t len) {
+    size_t frames = 0;
+    size_t i = 0;
+
+    /* finish a frame split across chunks, one byte at a time */
+    while (carry_len_ > 0 && i < len) {
+        carry_[carry_len_++] = data[i++];
+        frames += drain_carry();
+    }
+
+    /* frames fully inside the chunk are decoded in place */
+    while (i < len) {
+        if (data[i] != TELEMETRY_SYNC1) {
+            stats_.skipped_bytes++;
+            i++;
+            continue;
+        }
+
+        size_t avail = len - i;
+        Check c = check(data + i, avail);
+        if (c == FRAME_VALID) {
+            frames++;
+            deliver(data + i);
+            i += frame_len(data[i + TELEMETRY_OFS_TYPE]);
+        } else if (c == FRAME_INCOMPLETE) {
+            std::memcpy(carry_, data + i, avail);
+            carry_len_ = avail;
+            i = len;
+        } else {
+            stats_.skipped_bytes++;
+            i++;
+        }
+    }
+    return frames;
+}
+
+} // namespace telemetry
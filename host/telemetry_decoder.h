@@ -0,0 +1,169 @@
+#ifndef __TELEMETRY_DECODER_H__
+#define __TELEMETRY_DECODER_H__
+
+/** @file   telemetry_decoder.h
+ *  @brief  Host side streaming decoder for the binary telemetry frames
+ *
+ *          Bytes are fed in whatever chunks the serial port delivers them.
+ *          Frames that lie entirely inside a chunk are decoded in place, only
+ *          a frame split across two chunks is copied into a small carry
+ *          buffer.  On a sync or CRC failure the decoder drops one byte and
+ *          searches for the next sync pattern.
+ *
+ *          The frame layout is defined in the firmware header telemetry.h.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <stdint.h>
+
+extern "C" {
+#include <telemetry.h>
+}
+
+namespace telemetry {
+
+/** Read only view of a validated frame
+ *
+ *  The view points into the buffer passed to Decoder::feed() (or the decoder
+ *  carry buffer) and is only valid for the duration of the frame callback.
+ */
+class FrameView {
+public:
+    explicit FrameView(const uint8_t *frame) : p_(frame) {}
+
+    uint8_t type() const           { return p_[TELEMETRY_OFS_TYPE]; }
+    uint16_t seq() const           { return get16(TELEMETRY_OFS_SEQ); }
+    uint32_t time() const          { return get32(TELEMETRY_OFS_TIME); }
+    /** Node time in milliseconds (24 MSb of the system time) */
+    uint32_t time_ms() const       { return time() >> 8; }
+    const uint8_t *data() const    { return p_; }
+
+protected:
+    uint16_t get16(int ofs) const {
+        return static_cast<uint16_t>(p_[ofs] | (p_[ofs + 1] << 8));
+    }
+    uint32_t get24(int ofs) const {
+        return get16(ofs) | (static_cast<uint32_t>(p_[ofs + 2]) << 16);
+    }
+    uint32_t get32(int ofs) const {
+        return get16(ofs) | (static_cast<uint32_t>(get16(ofs + 2)) << 16);
+    }
+
+    const uint8_t *p_;
+};
+
+/** Depth frame, raw data and compensated pressure and temperature */
+class DepthFrameView : public FrameView {
+public:
+    explicit DepthFrameView(const uint8_t *frame) : FrameView(frame) {}
+
+    uint32_t raw_d1() const        { return get24(TELEMETRY_OFS_RAW_D1); }
+    uint32_t raw_d2() const        { return get24(TELEMETRY_OFS_RAW_D2); }
+    uint16_t pressure_mbar() const { return get16(TELEMETRY_OFS_PRESSURE); }
+    int16_t temp_cC() const        { return static_cast<int16_t>(get16(TELEMETRY_OFS_TEMP)); }
+    uint8_t status() const         { return p_[TELEMETRY_OFS_STATUS]; }
+    /** Depth below the surface reference in mm */
+    int32_t depth_mm() const       { return static_cast<int32_t>(get32(TELEMETRY_OFS_DEPTH_MM)); }
+};
+
+/** Filter frame, filtered depth and depth rate */
+class FilterFrameView : public FrameView {
+public:
+    explicit FilterFrameView(const uint8_t *frame) : FrameView(frame) {}
+
+    /** Filtered depth in mBar/100 */
+    int32_t depth_cmbar() const    { return static_cast<int32_t>(get32(TELEMETRY_OFS_FILTER_DEPTH)); }
+    /** Depth rate in mBar/100 per second, positive descending */
+    int32_t rate_cmbar_s() const   { return static_cast<int32_t>(get32(TELEMETRY_OFS_FILTER_RATE)); }
+};
+
+/** Raw frame, one conversion as read from the sensor */
+class RawFrameView : public FrameView {
+public:
+    explicit RawFrameView(const uint8_t *frame) : FrameView(frame) {}
+
+    uint32_t d1() const            { return get24(TELEMETRY_OFS_RAW_FRAME_D1); }
+    uint32_t d2() const            { return get24(TELEMETRY_OFS_RAW_FRAME_D2); }
+    /** Conversions D2 has been reused for, 0 if fresh */
+    uint8_t temp_age() const       { return p_[TELEMETRY_OFS_RAW_TEMP_AGE]; }
+};
+
+/** Setup frame, calibration and processing settings of a raw capture */
+class SetupFrameView : public FrameView {
+public:
+    explicit SetupFrameView(const uint8_t *frame) : FrameView(frame) {}
+
+    /** Calibration words of the sensor driver */
+    uint8_t calibration_count() const { return p_[TELEMETRY_OFS_SETUP_CAL_COUNT]; }
+    /** Calibration word i, 0 to TELEMETRY_CAL_WORDS - 1 */
+    uint16_t calibration(int i) const { return get16(TELEMETRY_OFS_SETUP_CAL + 2 * i); }
+    uint8_t oversample() const     { return p_[TELEMETRY_OFS_SETUP_OVERSAMPLE]; }
+    uint8_t median() const         { return p_[TELEMETRY_OFS_SETUP_MEDIAN]; }
+    uint8_t alpha() const          { return p_[TELEMETRY_OFS_SETUP_ALPHA]; }
+    uint8_t beta() const           { return p_[TELEMETRY_OFS_SETUP_BETA]; }
+    /** Surface reference in mBar/100 */
+    int32_t zero_cmbar() const     { return static_cast<int32_t>(get32(TELEMETRY_OFS_SETUP_ZERO)); }
+    uint16_t density_kgm3() const  { return get16(TELEMETRY_OFS_SETUP_DENSITY); }
+    int8_t latitude_deg() const    { return static_cast<int8_t>(p_[TELEMETRY_OFS_SETUP_LATITUDE]); }
+    uint8_t temp_interval() const  { return p_[TELEMETRY_OFS_SETUP_TEMP_INTERVAL]; }
+};
+
+/** Decoder statistics */
+struct DecoderStats {
+    unsigned long frames;         ///< valid frames delivered
+    unsigned long crc_errors;     ///< candidate frames with a bad CRC
+    unsigned long skipped_bytes;  ///< bytes discarded while searching for sync
+};
+
+/** Streaming, resynchronising frame decoder */
+class Decoder {
+public:
+    typedef std::function<void(const DepthFrameView &)> FrameHandler;
+    typedef std::function<void(const FilterFrameView &)> FilterHandler;
+    typedef std::function<void(const RawFrameView &)> RawHandler;
+    typedef std::function<void(const SetupFrameView &)> SetupHandler;
+
+    /** @param handler called for every depth frame
+     *  @param filter_handler called for every filter frame, may be empty */
+    explicit Decoder(FrameHandler handler, FilterHandler filter_handler = FilterHandler());
+
+    /** Feed received bytes, calls the frame handler for every valid frame
+     *
+     *  @return number of frames decoded from this chunk
+     */
+    size_t feed(const uint8_t *data, size_t len);
+
+    /** Handlers of a raw capture, frames without a handler are dropped */
+    void set_raw_handler(RawHandler handler)     { raw_handler_ = handler; }
+    void set_setup_handler(SetupHandler handler) { setup_handler_ = handler; }
+
+    /** Discard any partially received frame */
+    void reset();
+
+    const DecoderStats &stats() const { return stats_; }
+
+    /** CRC used by the frames, exposed for encoders and tests */
+    static uint16_t crc16(const uint8_t *data, size_t len);
+
+private:
+    enum Check { FRAME_VALID, FRAME_INVALID, FRAME_INCOMPLETE };
+
+    static size_t frame_len(uint8_t type);
+    Check check(const uint8_t *p, size_t avail);
+    void deliver(const uint8_t *p);
+    size_t drain_carry();
+    void drop_carry_byte();
+
+    FrameHandler handler_;
+    FilterHandler filter_handler_;
+    RawHandler raw_handler_;
+    SetupHandler setup_handler_;
+    DecoderStats stats_;
+    uint8_t carry_[TELEMETRY_MAX_FRAME_LEN];
+    size_t carry_len_;
+};
+
+} // namespace telemetry
+
+#endif
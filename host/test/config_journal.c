@@ -0,0 +1,156 @@
+/** @file   config_journal.c
+ *  @brief  Loading of eeprom records written by older and newer firmware
+ *
+ *          Runs src/config.c on the simulated eeprom.  Journal slots are
+ *          written by hand as a shortened and as a lengthened current
+ *          record, and config_load() must take the fields each record
+ *          shares with struct Config over the defaults and leave the rest
+ *          alone.  Corrupt records and records of another CONFIG_VERSION
+ *          must be passed over.
+ */
+
+#include "sim.h"
+#include "test.h"
+
+#include <config.h>
+#include <device.h>
+#include <sysclk.h>
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include <stddef.h>
+#include <string.h>
+
+/** Size of a record written before fusion_enabled was appended */
+#define SHORT_LEN  offsetof(struct Config, fusion_enabled)
+
+/** Write a journal slot, the CRC broken if corrupt is set */
+static void put_slot(unsigned char slot, uint16_t seq, uint8_t version,
+                     const void *rec, uint8_t len, char corrupt) {
+    uint8_t *p = sim_eeprom + ((uintptr_t)CONFIG_JOURNAL_ADDR & E2END) + slot * CONFIG_SLOT_SIZE;
+    uint16_t crc = 0xFFFF;
+    unsigned char i;
+
+    p[0] = seq & 0xFF;
+    p[1] = seq >> 8;
+    p[2] = version;
+    p[3] = len;
+    memcpy(p + 4, rec, len);
+    for (i = 0; i < 4 + len; i++) {
+        crc = _crc_xmodem_update(crc, p[i]);
+    }
+    if (corrupt) {
+        crc ^= 1;
+    }
+    p[4 + len] = crc & 0xFF;
+    p[5 + len] = crc >> 8;
+}
+
+static void erase(void) {
+    memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+}
+
+static void defaults(struct Config *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->tether_baudrate = 115200;
+    cfg->accessory_baudrate = 9600;
+    cfg->output_period_mS = 100;
+    cfg->fluid_density_kgm3 = 1025;
+    cfg->latitude_deg = 45;
+    cfg->fusion_enabled = 1;
+}
+
+/** All fields different from the defaults */
+static void settings(struct Config *cfg) {
+    memset(cfg, 0x5A, sizeof(*cfg));
+    cfg->zero_cmBar = -1234;
+    cfg->tether_baudrate = 38400;
+    cfg->accessory_baudrate = 57600;
+    cfg->fusion_enabled = 0;
+}
+
+/** Compare the first shared bytes with the record, the rest with the
+ *  defaults */
+static void check_merge(const char *what, const struct Config *cfg,
+                        const struct Config *rec, size_t shared) {
+    struct Config expect;
+
+    defaults(&expect);
+    memcpy(&expect, rec, shared);
+    TEST_CHECK(memcmp(cfg, &expect, sizeof(expect)) == 0,
+               "%s: fields beyond byte %u not defaulted or shared fields lost",
+               what, (unsigned)shared);
+}
+
+/** A record written before fields were appended only lacks those */
+static void test_appended(void) {
+    struct Config cfg, rec;
+
+    settings(&rec);
+
+    erase();
+    put_slot(1, 1, CONFIG_VERSION, &rec, SHORT_LEN, 0);
+    defaults(&cfg);
+    TEST_CHECK(config_load(&cfg), "short record not found");
+    check_merge("short record", &cfg, &rec, SHORT_LEN);
+    TEST_CHECK(cfg.fusion_enabled == 1, "fusion switch not defaulted");
+}
+
+/** A longer record from a newer firmware loads the known fields */
+static void test_longer(void) {
+    uint8_t buf[sizeof(struct Config) + 8];
+    struct Config cfg, rec;
+
+    settings(&rec);
+    memset(buf, 0xA5, sizeof(buf));
+    memcpy(buf, &rec, sizeof(rec));
+
+    erase();
+    put_slot(1, 3, CONFIG_VERSION, buf, sizeof(buf), 0);
+    defaults(&cfg);
+    TEST_CHECK(config_load(&cfg), "longer record not found");
+    check_merge("longer record", &cfg, &rec, sizeof(rec));
+}
+
+/** The newest valid record wins, corrupt and unknown ones are passed over */
+static void test_journal(void) {
+    struct Config cfg, older, newer;
+
+    settings(&older);
+    settings(&newer);
+    newer.zero_cmBar = 99;
+
+    erase();
+    put_slot(0, 10, CONFIG_VERSION, &older, sizeof(older), 0);
+    put_slot(1, 11, CONFIG_VERSION, &newer, sizeof(newer), 1);
+    put_slot(2, 12, CONFIG_VERSION + 1, &newer, sizeof(newer), 0);
+    defaults(&cfg);
+    TEST_CHECK(config_load(&cfg), "valid record not found");
+    check_merge("journal", &cfg, &older, sizeof(older));
+
+    /* a save goes to the slot after the one loaded */
+    config_save(&newer, 0);
+    while (config_busy()) {
+        config_service(SYS_CLK_MS_2_TICKS(CONFIG_SAVE_DELAY_mS));
+        sim_advance_us(SIM_EEPROM_WRITE_US);
+    }
+    defaults(&cfg);
+    TEST_CHECK(config_load(&cfg), "saved record not found");
+    check_merge("saved", &cfg, &newer, sizeof(newer));
+
+    erase();
+    defaults(&cfg);
+    TEST_CHECK(!config_load(&cfg), "record found in an erased eeprom");
+    check_merge("erased", &cfg, &cfg, 0);
+}
+
+int main(void) {
+    sim_init();
+
+    test_appended();
+    test_longer();
+    test_journal();
+
+    return test_result("config_journal");
+}
@@ -0,0 +1,181 @@
+/** @file   fusion_track.c
+ *  @brief  Analog cross-check of the whole firmware on the simulation
+ *
+ *          Runs the firmware with fused output on the tether and an analog
+ *          transducer whose span is 3 % larger than the one the node is
+ *          told of.  The cross-check must stay off until the transducer is
+ *          set, then track the bias at the surface and the span over two
+ *          descents to 5 bar below it.  The $PVRDX records must come with
+ *          their times in order and a sample age within a depth sensor
+ *          period.
+ */
+
+#include "sim.h"
+#include "test.h"
+
+#include <depth.h>
+#include <device.h>
+#include <fusion.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Span of the simulated part against the set one */
+#define SPAN_RATIO      1.03
+/** Span correction expected, 0.01 % */
+#define SPAN_EXPECTED   ((1.0 / SPAN_RATIO - 1.0) * 10000)
+#define SPAN_TOL        20
+/** Analog channel against the depth sensor at 5 bar, mBar/100, it is off
+ *  by 15000 without the span correction */
+#define ANALOG_TOL_cmBar 500
+/** Largest age of a fused sample, mS */
+#define AGE_MAX_mS      100
+/** Run time of the tracking test, s */
+#define TRACK_S         530
+/** Records expected with every fused sample sent, at least 100 a second */
+#define RECORDS_MIN     (100UL * TRACK_S)
+
+/** Two descents, the span is only told from the bias by a change of depth */
+static const struct SimMs5541Point profile[] = {
+    {0,          1013, 20.0},
+    {20000000,   1013, 20.0},
+    {140000000,  6013, 15.0},
+    {200000000,  6013, 15.0},
+    {320000000,  1013, 20.0},
+    {360000000,  1013, 20.0},
+    {480000000,  6013, 15.0},
+    {600000000,  6013, 15.0},
+};
+
+/** $PVRDX records checked, and the last one */
+static unsigned long records;
+static unsigned long last_time;
+static unsigned int last_seq;
+
+static void command(const char *cmd) {
+    sim_uart_rx(COMM_PORT_TETHER, cmd, strlen(cmd));
+    sim_uart_rx(COMM_PORT_TETHER, "\r\n", 2);
+    sim_run(100000);
+}
+
+/** Check the order and age of a $PVRDX record, other lines are passed over */
+static void check_record(const char *line) {
+    unsigned long time_mS, age_mS;
+    unsigned int seq;
+    long fused, analog;
+    int status;
+
+    if (strncmp(line, "$PVRDX,", 7) != 0) {
+        return;
+    }
+    if (sscanf(line, "$PVRDX,%ld,%ld,%d,%lu,%u,%lu", &fused, &analog, &status,
+               &time_mS, &seq, &age_mS) != 6) {
+        TEST_CHECK(0, "record %lu cut short: %s", records, line);
+        return;
+    }
+    if (records) {
+        TEST_CHECK(time_mS >= last_time, "record %u at %lu mS after one at %lu mS",
+                   seq, time_mS, last_time);
+        TEST_CHECK(seq != last_seq, "record %u sent twice", seq);
+    }
+    TEST_CHECK(age_mS <= AGE_MAX_mS, "record %u %lu mS old", seq, age_mS);
+    last_time = time_mS;
+    last_seq = seq;
+    records++;
+}
+
+/** Check the lines sent since the last call, one cut short by the end of
+ *  the run is finished on the next */
+static void check_records(void) {
+    static char line[96];
+    static size_t line_len;
+    size_t len, pos;
+    const char *out = sim_uart_output(COMM_PORT_TETHER, &len);
+
+    for (pos = 0; pos < len; pos++) {
+        if (out[pos] != '\n') {
+            if (line_len < sizeof(line) - 1) {
+                line[line_len++] = out[pos];
+            }
+            continue;
+        }
+        line[line_len] = 0;
+        line_len = 0;
+        check_record(line);
+    }
+    sim_uart_clear_output(COMM_PORT_TETHER);
+}
+
+/** Without the transducer the ADC stays off and nothing is fused */
+static void test_unset(void) {
+    TEST_CHECK(!fusion_set_transducer(900, 200, 14000), "span past 1023 counts accepted");
+    TEST_CHECK(!fusion_set_transducer(102, 819, 0), "span of 0 mBar accepted");
+    TEST_CHECK(!fusion_set_transducer(102, 100, 14000), "140 mBar per count accepted");
+    TEST_CHECK(!fusion_set_transducer(102, 819, 800), "under 1 mBar per count accepted");
+    TEST_CHECK(!fusion_set_transducer(102, FUSION_SPAN_MIN_COUNTS - 1, 1000), "short span accepted");
+    TEST_CHECK(fusion_transducer_span() == 0, "transducer set by a refused setting");
+
+    command("$PVRFM,3");
+    command("$PVRSR,0");
+    command("$PVRFU,1");
+    sim_run(2000000);
+    TEST_CHECK(fusion_enabled(), "fusion not enabled");
+    TEST_CHECK(fusion_status() & FUSION_STATUS_UNSET, "status 0x%02X, unset not flagged",
+               fusion_status());
+    TEST_CHECK(sim_adc_conversions() == 0, "%lu conversions with the transducer unset",
+               sim_adc_conversions());
+    TEST_CHECK(fusion_sample_seq() == 0, "%u samples fused with the transducer unset",
+               fusion_sample_seq());
+    sim_uart_clear_output(COMM_PORT_TETHER);
+}
+
+/** Bias at the surface, span on the way down */
+static void test_track(void) {
+    char cmd[32];
+    long diff;
+    int span;
+    int s;
+
+    sprintf(cmd, "$PVRAT,%d,%d,%d", SIM_ADC_PRESSURE_ZERO, SIM_ADC_PRESSURE_SPAN,
+            SIM_ADC_PRESSURE_SPAN_mBar);
+    command(cmd);
+    TEST_CHECK(fusion_transducer_zero() == SIM_ADC_PRESSURE_ZERO &&
+               fusion_transducer_span() == SIM_ADC_PRESSURE_SPAN &&
+               fusion_transducer_span_mBar() == SIM_ADC_PRESSURE_SPAN_mBar,
+               "$PVRAT not applied");
+
+    sim_run(10000000);
+    TEST_CHECK(!(fusion_status() & (FUSION_STATUS_UNSET | FUSION_STATUS_UNLOCKED)),
+               "status 0x%02X at the surface", fusion_status());
+    TEST_CHECK(fusion_span_correction() == 0, "span tracked at the pivot, %d",
+               fusion_span_correction());
+    check_records();
+
+    /* to the bottom of the second descent */
+    for (s = 0; s < TRACK_S; s += 10) {
+        sim_run(10000000);
+        check_records();
+    }
+    span = fusion_span_correction();
+    diff = fusion_analog_cmBar() - depth_cmBar();
+    TEST_CHECK(abs(span - (int)SPAN_EXPECTED) <= SPAN_TOL,
+               "span correction %d, expected %.0f", span, SPAN_EXPECTED);
+    TEST_CHECK(labs(diff) <= ANALOG_TOL_cmBar, "analog %ld off the depth sensor at 5 bar", diff);
+    TEST_CHECK(fusion_status() == 0 && fusion_disagree_count() == 0,
+               "status 0x%02X, %u disagreements", fusion_status(), fusion_disagree_count());
+    TEST_CHECK(records >= RECORDS_MIN, "%lu records", records);
+}
+
+int main(void) {
+    sim_init();
+    sim_ms5541_set_profile(profile, sizeof(profile) / sizeof(profile[0]));
+    sim_adc_set_transducer(SIM_ADC_PRESSURE_ZERO, SIM_ADC_PRESSURE_SPAN * SPAN_RATIO,
+                           SIM_ADC_PRESSURE_SPAN_mBar);
+    sim_run(1000000);
+
+    test_unset();
+    test_track();
+
+    return test_result("fusion_track");
+}
@@ -0,0 +1,138 @@
+/** @file   hydro_vectors.c
+ *  @brief  Pressure to depth conversion against the UNESCO 1983 formulas
+ *
+ *          Checks src/hydro.c in double precision against:
+ *          - the UNESCO normal gravity at every degree of latitude, 0, 45
+ *            and 90 degrees included
+ *          - hydrostatic depth P / (rho * g) for the fresh and salt
+ *            presets and the ends of the density range, down to 200 m
+ *          - the UNESCO 1983 seawater depth formula (Fofonoff and Millard)
+ *            at 1028 kg/m^3 over the sensor range, whose own check value is
+ *            verified first
+ */
+
+#include "test.h"
+
+#include <hydro.h>
+
+#include <math.h>
+
+/** Tolerance of the gravity table, 1e-5 m/s^2 */
+#define G_TOL          10
+/** Tolerance of the depth against P / (rho * g), mm: the interpolated
+ *  gravity is within 1e-5 at latitudes between the table points */
+#define DEPTH_TOL_MM   3.0
+/** Deepest pressure checked, Pa (200 m) */
+#define P_MAX_PA       2000000L
+/** Relative tolerance against the seawater formula, see hydro.h */
+#define UNESCO_TOL     5e-4
+/** Deepest pressure of the seawater comparison, dbar */
+#define UNESCO_MAX_DBAR 140
+
+/** UNESCO normal gravity, m/s^2 */
+static double unesco_gravity(double lat_deg) {
+    double x = sin(lat_deg * M_PI / 180.0);
+
+    x *= x;
+    return 9.780318 * (1.0 + (5.2788e-3 + 2.36e-5 * x) * x);
+}
+
+/** UNESCO 1983 depth of sea water, m
+ *
+ *  @param p pressure in dbar
+ */
+static double unesco_depth(double p, double lat_deg) {
+    double g = unesco_gravity(lat_deg) + 1.092e-6 * p;
+
+    return (((-1.82e-15 * p + 2.279e-10) * p - 2.2512e-5) * p + 9.72659) * p / g;
+}
+
+static void test_gravity(void) {
+    double ref, err;
+    int lat;
+
+    for (lat = -90; lat <= 90; lat++) {
+        TEST_CHECK(hydro_set_latitude(lat), "latitude %d refused", lat);
+        ref = unesco_gravity(lat) * 1e5;
+        err = (double)hydro_gravity() - ref;
+        TEST_CHECK(fabs(err) <= G_TOL, "latitude %d: g %lu, UNESCO %.1f",
+                   lat, hydro_gravity(), ref);
+    }
+
+    /* the table ends, exact to the last digit */
+    hydro_set_latitude(0);
+    TEST_CHECK(hydro_gravity() == 978032, "g at the equator %lu", hydro_gravity());
+    hydro_set_latitude(45);
+    TEST_CHECK(hydro_gravity() == 980619, "g at 45 deg %lu", hydro_gravity());
+    hydro_set_latitude(90);
+    TEST_CHECK(hydro_gravity() == 983218, "g at the pole %lu", hydro_gravity());
+
+    TEST_CHECK(!hydro_set_latitude(-91) && !hydro_set_latitude(91),
+               "latitude out of range accepted");
+    TEST_CHECK(hydro_latitude() == 90, "latitude changed by a refused set");
+}
+
+static void test_hydrostatic(void) {
+    static const unsigned int density[] = {
+        HYDRO_DENSITY_FRESH, HYDRO_DENSITY_SALT, HYDRO_DENSITY_MIN, HYDRO_DENSITY_MAX
+    };
+    static const signed char latitude[] = { 0, 45, 90, -45, 37, -78 };
+    double ref, err;
+    long p, mm;
+    unsigned int d, l;
+
+    for (d = 0; d < sizeof(density) / sizeof(density[0]); d++) {
+        TEST_CHECK(hydro_set_density(density[d]), "density %u refused", density[d]);
+        for (l = 0; l < sizeof(latitude); l++) {
+            hydro_set_latitude(latitude[l]);
+            for (p = -P_MAX_PA / 20; p <= P_MAX_PA; p += 997) {
+                mm = hydro_depth_mm(p);
+                ref = p * 1000.0 / (density[d] * unesco_gravity(latitude[l]));
+                err = mm - ref;
+                TEST_CHECK(fabs(err) <= DEPTH_TOL_MM,
+                           "rho %u lat %d P %ld Pa: %ld mm, expected %.2f",
+                           density[d], latitude[l], p, mm, ref);
+                TEST_CHECK(hydro_depth_mm(-p) == -mm, "P %ld Pa not symmetric", p);
+            }
+        }
+    }
+
+    TEST_CHECK(!hydro_set_density(HYDRO_DENSITY_MIN - 1) &&
+               !hydro_set_density(HYDRO_DENSITY_MAX + 1), "density out of range accepted");
+    TEST_CHECK(hydro_density() == HYDRO_DENSITY_MAX, "density changed by a refused set");
+}
+
+static void test_seawater(void) {
+    static const signed char latitude[] = { 0, 30, 45, 90 };
+    double ref, err;
+    long p;
+    unsigned int l;
+
+    /* check value of the UNESCO 1983 report */
+    ref = unesco_depth(10000, 30);
+    TEST_CHECK(fabs(ref - 9712.653) < 0.001, "UNESCO check value %.3f m, expected 9712.653", ref);
+
+    hydro_set_density(1028);
+    for (l = 0; l < sizeof(latitude); l++) {
+        hydro_set_latitude(latitude[l]);
+        for (p = 1; p <= UNESCO_MAX_DBAR; p++) {
+            ref = unesco_depth(p, latitude[l]) * 1000.0;
+            err = hydro_depth_mm(p * 10000L) - ref;
+            TEST_CHECK(fabs(err) <= ref * UNESCO_TOL,
+                       "lat %d %ld dbar: %ld mm, UNESCO %.1f", latitude[l], p,
+                       hydro_depth_mm(p * 10000L), ref);
+        }
+    }
+}
+
+int main(void) {
+    hydro_init();
+    TEST_CHECK(hydro_density() == HYDRO_DENSITY_FRESH &&
+               hydro_latitude() == HYDRO_LATITUDE_DEFAULT, "defaults");
+
+    test_gravity();
+    test_hydrostatic();
+    test_seawater();
+
+    return test_result("hydro_vectors");
+}
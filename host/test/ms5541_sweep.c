@@ -0,0 +1,211 @@
+/** @file   ms5541_sweep.c
+ *  @brief  MS5541 compensation against the datasheet algorithm
+ *
+ *          Sweeps D1 and D2 across the 16 bit range for a set of
+ *          calibration words and checks sensor_compensate() and
+ *          sensor_compensate_fine() (inc/ms5541.h) for exact equality with
+ *          a reference written straight from the datasheet:
+ *  @code
+        UT1  = 8 * C5 + 10000            dT = D2 - UT1
+        TEMP = 200 + dT * (C6 + 100) / 2^11
+        OFF  = C2 + (C4 - 250) * dT / 2^12 + 10000
+        SENS = C1 / 2 + (C3 + 200) * dT / 2^13 + 3000
+        P    = SENS * (D1 - OFF) / 2^11 + 1000
+    @endcode
+ *          with the divisions rounding down, in 64 bit arithmetic.  The
+ *          reference also checks every intermediate fits 32 bits, so the
+ *          32 bit long of the avr gives the same results as the 64 bit long
+ *          of the host.
+ *
+ *          The deviation of the same formulas in float without rounding,
+ *          as the libpam driver computed them, is reported for comparison.
+ */
+
+#include <sensor.h>
+
+#include "test.h"
+
+#include <math.h>
+#include <stdint.h>
+
+/** The driver's completion callback, unused by the compensation */
+static void depth_sensor_done(char read) {
+    (void)read;
+}
+
+/** Calibration words, the host simulation defaults first */
+static const uint16_t cal_words[][SENSOR_CAL_WORDS] = {
+    {0x5784, 0xE21F, 0x4B10, 0x7D32},
+    {0x0000, 0x0000, 0x0000, 0x0000},
+    {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF},
+    {0x0007, 0xFFC0, 0x003F, 0xFF80},
+    {0xFFF8, 0x003F, 0xFFC0, 0x007F},
+};
+
+/** Random calibration sets on top of cal_words */
+#define RANDOM_SETS 8
+
+/** @name Sweep steps, the last code of each range is always included */
+//@{
+#define D1_STEP 13
+#define D2_STEP 61
+//@}
+
+/** Calibration coefficients C1-C6 */
+struct Reference {
+    int64_t c[6];
+};
+
+static int64_t floor_div(int64_t n, int64_t d) {
+    int64_t q = n / d;
+    return (n % d != 0 && (n < 0) != (d < 0)) ? q - 1 : q;
+}
+
+#define FITS_32(x)  ((x) >= INT32_MIN && (x) <= INT32_MAX)
+
+/** Datasheet word layout
+ *
+ *  C1 = W1[15:3], C2 = W1[2:0] W2[15:6], C3 = W3[15:6], C4 = W4[15:7],
+ *  C5 = W2[5:0] W3[5:0], C6 = W4[6:0]
+ */
+static void reference_coefficients(struct Reference *r, const uint16_t w[4]) {
+    r->c[0] = (w[0] & 0xFFF8) / 8;
+    r->c[1] = (w[0] & 0x0007) * 1024 + (w[1] & 0xFFC0) / 64;
+    r->c[2] = (w[2] & 0xFFC0) / 64;
+    r->c[3] = (w[3] & 0xFF80) / 128;
+    r->c[4] = (w[1] & 0x003F) * 64 + (w[2] & 0x003F);
+    r->c[5] = w[3] & 0x007F;
+}
+
+static int64_t reference_dt(const struct Reference *r, unsigned int d2) {
+    return (int64_t)d2 - (8 * r->c[4] + 10000);
+}
+
+static int64_t reference_temperature(const struct Reference *r, unsigned int d2) {
+    int64_t dt = reference_dt(r, d2);
+    int64_t prod = dt * (r->c[5] + 100);
+
+    TEST_CHECK(FITS_32(prod), "dT * (C6 + 100) = %lld overflows 32 bits", (long long)prod);
+    return 200 + floor_div(prod, 2048);
+}
+
+static void reference_off_sens(const struct Reference *r, unsigned int d2,
+                               int64_t *off, int64_t *sens) {
+    int64_t dt = reference_dt(r, d2);
+
+    *off = r->c[1] + floor_div((r->c[3] - 250) * dt, 4096) + 10000;
+    *sens = floor_div(r->c[0], 2) + floor_div((r->c[2] + 200) * dt, 8192) + 3000;
+}
+
+static int64_t reference_pressure(const struct Reference *r, unsigned int d1, unsigned int d2) {
+    int64_t off, sens, prod;
+
+    reference_off_sens(r, d2, &off, &sens);
+    prod = sens * ((int64_t)d1 - off);
+    TEST_CHECK(FITS_32(prod), "SENS * (D1 - OFF) = %lld overflows 32 bits", (long long)prod);
+    return floor_div(prod, 2048) + 1000;
+}
+
+/** The same with D1 in 1/256 counts, result in mBar/100 */
+static int64_t reference_pressure_fine(const struct Reference *r, int64_t d1_q8, unsigned int d2) {
+    int64_t off, sens, p_q8;
+
+    reference_off_sens(r, d2, &off, &sens);
+    p_q8 = floor_div(sens * (d1_q8 - off * 256), 2048);
+    return floor_div(p_q8 * 100, 256) + 100000;
+}
+
+/** The formulas in float, divisions not rounded */
+static void float_compensate(const struct Reference *r, unsigned int d1, unsigned int d2,
+                             float *p, float *t) {
+    float dt = (float)d2 - (8.0f * r->c[4] + 10000.0f);
+    float off = r->c[1] + (r->c[3] - 250.0f) * dt / 4096.0f + 10000.0f;
+    float sens = r->c[0] / 2.0f + (r->c[2] + 200.0f) * dt / 8192.0f + 3000.0f;
+
+    *p = sens * ((float)d1 - off) / 2048.0f + 1000.0f;
+    *t = 200.0f + dt * (r->c[5] + 100.0f) / 2048.0f;
+}
+
+static unsigned int next_code(unsigned int d, unsigned int step) {
+    if (d == 0xFFFF) {
+        return 0x10000;
+    }
+    return d + step > 0xFFFF ? 0xFFFF : d + step;
+}
+
+static double max_p_error, max_t_error;
+
+static void sweep(const uint16_t w[4]) {
+    SensorCalibration cal;
+    struct Reference r;
+    unsigned int d1, d2;
+    int i;
+
+    MS5535_calculate_calibration_coefficents(&cal, w[0], w[1], w[2], w[3]);
+    reference_coefficients(&r, w);
+    for (i = 0; i < 6; i++) {
+        TEST_CHECK(cal.c[i] == r.c[i], "words %04X %04X %04X %04X: C%d %d, expected %lld",
+                   w[0], w[1], w[2], w[3], i + 1, cal.c[i], (long long)r.c[i]);
+    }
+
+    for (d2 = 0; d2 <= 0xFFFF; d2++) {
+        long t;
+        int64_t ref = reference_temperature(&r, d2);
+
+        sensor_compensate(&cal, 0, &t, 0, d2);
+        TEST_CHECK(t == ref, "C5 %d C6 %d D2 %u: T %ld, expected %lld",
+                   cal.c[4], cal.c[5], d2, t, (long long)ref);
+    }
+
+    for (d2 = 0; d2 <= 0xFFFF; d2 = next_code(d2, D2_STEP)) {
+        for (d1 = 0; d1 <= 0xFFFF; d1 = next_code(d1, D1_STEP)) {
+            long p, t, fine;
+            long d1_q8 = ((long)d1 << 8) | ((d1 * 37 + d2) & 0xFF);
+            int64_t ref = reference_pressure(&r, d1, d2);
+            int64_t ref_fine = reference_pressure_fine(&r, d1_q8, d2);
+            float fp, ft;
+
+            sensor_compensate(&cal, &p, &t, d1, d2);
+            TEST_CHECK(p == ref, "words %04X %04X %04X %04X D1 %u D2 %u: P %ld, expected %lld",
+                       w[0], w[1], w[2], w[3], d1, d2, p, (long long)ref);
+
+            fine = sensor_compensate_fine(&cal, d1_q8, d2);
+            TEST_CHECK(fine == ref_fine, "words %04X %04X %04X %04X D1 %ld/256 D2 %u: P %ld, expected %lld",
+                       w[0], w[1], w[2], w[3], d1_q8, d2, fine, (long long)ref_fine);
+
+            /* without a fraction the fine result rounds down to the coarse one */
+            fine = sensor_compensate_fine(&cal, (long)d1 << 8, d2);
+            TEST_CHECK(floor_div(fine - 100000, 100) + 1000 == p, "D1 %u D2 %u: fine %ld, coarse %ld",
+                       d1, d2, fine, p);
+
+            float_compensate(&r, d1, d2, &fp, &ft);
+            if (fabs(fp - p) > max_p_error) {
+                max_p_error = fabs(fp - p);
+            }
+            if (fabs(ft - t) > max_t_error) {
+                max_t_error = fabs(ft - t);
+            }
+        }
+    }
+}
+
+int main(void) {
+    unsigned long seed = 1;
+    unsigned int i, j;
+    uint16_t w[SENSOR_CAL_WORDS];
+
+    for (i = 0; i < sizeof(cal_words) / sizeof(cal_words[0]); i++) {
+        sweep(cal_words[i]);
+    }
+    for (i = 0; i < RANDOM_SETS; i++) {
+        for (j = 0; j < SENSOR_CAL_WORDS; j++) {
+            seed = seed * 1103515245UL + 12345;
+            w[j] = seed >> 16;
+        }
+        sweep(w);
+    }
+
+    printf("ms5541_sweep: float path deviates up to %.1f mBar, %.2f C\n",
+           max_p_error, max_t_error / 10);
+    return test_result("ms5541_sweep");
+}
@@ -0,0 +1,49 @@
+#ifndef __MS5541_VECTORS_H__
+#define __MS5541_VECTORS_H__
+
+/** @file   ms5541_vectors.h
+ *  @brief  Compensation vectors of the MS5541 driver, see sensor_vectors.c
+ *
+ *          Computed from the datasheet algorithm as stated in
+ *          ms5541_sweep.c, outside the firmware code, with the divisions
+ *          rounding down.  The first set is
+ *          the default calibration of the host simulation.
+ */
+
+#define SENSOR_VECTOR_DRIVER "ms5541"
+
+/** Calibration words W1-W4 */
+static const uint16_t sensor_vector_words[][SENSOR_CAL_WORDS] = {
+    {0x5784, 0xE21F, 0x4B10, 0x7D32},   /* C1-C6 2800 5000 300 250 2000 50 */
+    {0x8C29, 0xB4E4, 0x9A93, 0x66C4},   /* C1-C6 4485 1747 618 205 2323 68 */
+    {0x5D1B, 0x8A8E, 0xC2AB, 0x8E06},   /* C1-C6 2979 3626 778 284 939 6 */
+};
+
+static const struct SensorVector sensor_vectors[] = {
+    /* cal   D1     D2  frac    mBar  dC      Pa */
+    { 0, 15465, 26000,   0,   1999,  200,   199902 },
+    { 0, 15465, 26000, 128,   1999,  200,   200009 },
+    { 0, 12000, 22000,  64,  -5087,  -93,  -508593 },
+    { 0, 22000, 31000, 255,  17081,  566,  1708382 },
+    { 0, 20000, 24000,   1,  11441,   53,  1144190 },
+    { 0, 16500, 27500, 200,   4289,  309,   429101 },
+    { 1, 15465, 26000,   0,   9978,  -12,   997815 },
+    { 1, 15465, 26000, 128,   9978,  -12,   997937 },
+    { 1, 12000, 22000,  64,   1405, -341,   140568 },
+    { 1, 22000, 31000, 255,  28522,  398,  2852475 },
+    { 1, 20000, 24000,   1,  20161, -177,  2016170 },
+    { 1, 16500, 27500, 200,  12885,  111,  1288705 },
+    { 2, 15465, 26000,   0,   5752,  639,   575245 },
+    { 2, 15465, 26000, 128,   5752,  639,   575380 },
+    { 2, 12000, 22000,  64,  -3080,  432,  -307894 },
+    { 2, 22000, 31000, 255,  25607,  898,  2561040 },
+    { 2, 20000, 24000,   1,  17243,  535,  1724386 },
+    { 2, 16500, 27500, 200,   8744,  716,   874696 },
+};
+
+static inline void sensor_vector_calibration(SensorCalibration *cal,
+                                             const uint16_t word[SENSOR_CAL_WORDS]) {
+    MS5535_calculate_calibration_coefficents(cal, word[0], word[1], word[2], word[3]);
+}
+
+#endif
@@ -0,0 +1,126 @@
+/** @file   nmea_bench.c
+ *  @brief  NMEA encoder against the sprintf formatting it replaced
+ *
+ *          Checks nmea.c (src/) produces the same $PVRDT bytes as the
+ *          former sprintf("$PVRDT,%d, %d\r\n") and strlen() path for every
+ *          16 bit depth, the integer limits and with the checksum, then
+ *          times both paths on the host.
+ *
+ *          Host timings only show the relative cost of the two paths, the
+ *          avr has no divide instruction and its vfprintf is larger still.
+ */
+
+#include <nmea.h>
+
+#include "test.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/** Sentences formatted per timed path */
+#define BENCH_SENTENCES 1000000L
+
+/** Output buffer of the sprintf path, as in the original main() */
+static char output[128];
+
+static unsigned char sprintf_pvrdt(int depth, int temp) {
+    sprintf(output, "$PVRDT,%d, %d\r\n", depth, temp);
+    return strlen(output);
+}
+
+static unsigned char nmea_pvrdt(char *buf, int depth, int temp, char checksum) {
+    struct NmeaSentence sentence;
+
+    nmea_begin_buf(&sentence, buf, 128, "PVRDT", checksum);
+    nmea_field_int(&sentence, depth);
+    nmea_putc(&sentence, ',');
+    nmea_putc(&sentence, ' ');
+    nmea_int(&sentence, temp);
+    return nmea_end(&sentence);
+}
+
+static double elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static void check_sentence(int depth, int temp) {
+    char buf[128];
+    unsigned char len = nmea_pvrdt(buf, depth, temp, 0);
+    unsigned char ref = sprintf_pvrdt(depth, temp);
+
+    TEST_CHECK(len == ref && memcmp(buf, output, len) == 0,
+               "%d %d: \"%.*s\", expected \"%s\"", depth, temp, len, buf, output);
+}
+
+static void check_long(long value) {
+    char buf[32];
+    char ref[32];
+    struct NmeaSentence sentence;
+    unsigned char len;
+
+    nmea_begin_buf(&sentence, buf, sizeof(buf), "PVRXX", 0);
+    nmea_field_int(&sentence, value);
+    len = nmea_end(&sentence);
+    snprintf(ref, sizeof(ref), "$PVRXX,%ld\r\n", value);
+    TEST_CHECK(len == strlen(ref) && memcmp(buf, ref, len) == 0,
+               "%ld: \"%.*s\", expected \"%s\"", value, len, buf, ref);
+}
+
+static void check_checksum(int depth, int temp) {
+    char buf[128];
+    char hex[3];
+    unsigned char len = nmea_pvrdt(buf, depth, temp, 1);
+    unsigned char sum = 0;
+    unsigned char i;
+
+    for (i = 1; i < len && buf[i] != '*'; i++) {
+        sum ^= buf[i];
+    }
+    snprintf(hex, sizeof(hex), "%02X", sum);
+    TEST_CHECK(i + 5 == len && memcmp(buf + i + 1, hex, 2) == 0 &&
+               memcmp(buf + len - 2, "\r\n", 2) == 0,
+               "%d %d: \"%.*s\", checksum %s", depth, temp, len, buf, hex);
+}
+
+int main(void) {
+    static const long limits[] = {
+        0, 1, -1, 9, 10, -10, 99999, 100000, 999999999L, 1000000000L,
+        INT32_MAX, INT32_MIN + 1L, INT32_MIN
+    };
+    struct timespec start;
+    double sprintf_ns, nmea_ns;
+    unsigned long bytes = 0;
+    char buf[128];
+    long i;
+
+    for (i = -32768; i <= 32767; i++) {
+        check_sentence(i, (int)(i * 7) % 4000);
+        check_checksum(i, 2000);
+    }
+    for (i = 0; i < (long)(sizeof(limits) / sizeof(limits[0])); i++) {
+        check_long(limits[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < BENCH_SENTENCES; i++) {
+        bytes += sprintf_pvrdt(1000 + (i & 0x3FFF), 2000 + (i & 0x3FF));
+    }
+    sprintf_ns = elapsed_ns(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < BENCH_SENTENCES; i++) {
+        bytes -= nmea_pvrdt(buf, 1000 + (i & 0x3FFF), 2000 + (i & 0x3FF), 0);
+    }
+    nmea_ns = elapsed_ns(&start);
+    TEST_CHECK(bytes == 0, "paths produced different lengths");
+
+    printf("nmea_bench: sprintf %.0f ns, encoder %.0f ns per sentence, "
+           "%u byte buffer vs none\n",
+           sprintf_ns / BENCH_SENTENCES, nmea_ns / BENCH_SENTENCES, (unsigned)sizeof(output));
+    return test_result("nmea_bench");
+}
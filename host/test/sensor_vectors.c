@@ -0,0 +1,80 @@
+/** @file   sensor_vectors.c
+ *  @brief  Known answers of the compensation of the selected sensor driver
+ *
+ *          Built for the driver the platform header selects (sensor.h),
+ *          with the vectors of that driver from <driver>_vectors.h: raw
+ *          conversions and calibration words with the pressure, temperature
+ *          and fine pressure they must compensate to.  A new driver brings
+ *          its own vector header, providing
+ *  @code
+    SENSOR_VECTOR_DRIVER                    name in the report
+    sensor_vector_words[][SENSOR_CAL_WORDS] calibration words
+    sensor_vectors[]                        struct SensorVector answers
+    void sensor_vector_calibration(SensorCalibration *cal, const uint16_t word[])
+        coefficients from a set of words, as sensor_init() makes them
+    @endcode
+ */
+
+#include <sensor.h>
+
+#include "test.h"
+
+#include <stdint.h>
+
+/** The driver's completion callback, unused by the compensation */
+static void depth_sensor_done(char read) {
+    (void)read;
+}
+
+/** One known answer */
+struct SensorVector
+{
+    unsigned char cal;          ///< index into sensor_vector_words
+    sensor_raw_t d1;
+    sensor_raw_t d2;
+    unsigned char d1_frac;      ///< fraction bits of D1 for the fine pressure
+    long mBar;                  ///< sensor_compensate() pressure
+    long temp_dC;               ///< sensor_compensate() temperature
+    long fine;                  ///< sensor_compensate_fine() in mBar/100
+};
+
+#if defined(DEPTH_SENSOR_MS5541)
+#include "ms5541_vectors.h"
+#else
+#error "No compensation vectors for the selected depth sensor driver"
+#endif
+
+#define VECTORS (sizeof(sensor_vectors) / sizeof(sensor_vectors[0]))
+
+int main(void) {
+    SensorCalibration cal;
+    const struct SensorVector *v;
+    long p, t, fine;
+    unsigned int i;
+
+    for (i = 0; i < VECTORS; i++) {
+        v = &sensor_vectors[i];
+        sensor_vector_calibration(&cal, sensor_vector_words[v->cal]);
+
+        sensor_compensate(&cal, &p, &t, v->d1, v->d2);
+        TEST_CHECK(p == v->mBar && t == v->temp_dC,
+                   "vector %u: %ld mBar %ld dC, expected %ld mBar %ld dC",
+                   i, p, t, v->mBar, v->temp_dC);
+
+        /* either result may be left out */
+        p = t = 0;
+        sensor_compensate(&cal, &p, 0, v->d1, v->d2);
+        sensor_compensate(&cal, 0, &t, v->d1, v->d2);
+        TEST_CHECK(p == v->mBar && t == v->temp_dC, "vector %u: single results differ", i);
+
+        fine = sensor_compensate_fine(&cal, ((long)v->d1 << 8) + v->d1_frac, v->d2);
+        TEST_CHECK(fine == v->fine, "vector %u: fine %ld, expected %ld", i, fine, v->fine);
+
+        TEST_CHECK(SENSOR_RAW_VALID(v->d1) && SENSOR_RAW_VALID(v->d2),
+                   "vector %u: raw values taken as a stuck line", i);
+    }
+    TEST_CHECK(!SENSOR_RAW_VALID((sensor_raw_t)0) && !SENSOR_RAW_VALID((sensor_raw_t)~0),
+               "stuck data line levels taken as valid");
+
+    return test_result("sensor_vectors_" SENSOR_VECTOR_DRIVER);
+}
@@ -0,0 +1,184 @@
+/** @file   spi_chain.c
+ *  @brief  Firmware SPI driver on the simulated SPI master
+ *
+ *          Runs src/spi.c on the register model of the host simulation with
+ *          the virtual MS5541 on the bus: calibration words are read with
+ *          the polled calls and with background chains of a command and a
+ *          read, including a chain started from the completion callback and
+ *          one held off by a cleared I flag.  Checks the received words, the
+ *          enable line, the byte times and the SPIF/WCOL handling.
+ */
+
+#include "sim.h"
+#include "test.h"
+
+#include <device.h>
+#include <spi.h>
+
+#include <avr/interrupt.h>
+
+/** @name MS5541 calibration word reads */
+//@{
+#define CMD_W1  0x1D50
+#define CMD_W2  0x1D60
+#define CMD_W3  0x1D90
+//@}
+
+/** Default calibration words of the virtual MS5541 */
+static const uint16_t cal_word[3] = {0x5784, 0xE21F, 0x4B10};
+
+/** Byte time at F_CPU/128 */
+#define BYTE_US ((8 * 128 * 1000000ULL + F_CPU / 2) / F_CPU)
+
+static char command[2];
+static char word[2];
+static unsigned int done_count;
+static struct SpiTransfer *done_last;
+static char chain_again;
+
+static void chain_done(struct SpiTransfer *t);
+
+static struct SpiTransfer command_transfer = {
+    command, 0, 2, SPI_CLK_RISING, SPI_CLK_PHASE_SAMPLE_LEADING,
+    &DEPTH_ENABLE_PORT, DEPTH_ENABLE, 0, 0
+};
+static struct SpiTransfer read_transfer = {
+    0, word, 2, SPI_CLK_RISING, SPI_CLK_PHASE_SAMPLE_TRAILING,
+    &DEPTH_ENABLE_PORT, DEPTH_ENABLE, chain_done, 0
+};
+
+static void set_command(uint16_t cmd) {
+    command[0] = cmd >> 8;
+    command[1] = cmd & 0xFF;
+}
+
+static uint16_t word_read(void) {
+    return ((uint16_t)(unsigned char)word[0] << 8) | (unsigned char)word[1];
+}
+
+/** Runs in the SPI interrupt, may start the next chain like ms5541.h */
+static void chain_done(struct SpiTransfer *t) {
+    done_count++;
+    done_last = t;
+    TEST_CHECK(!(SREG & (1 << SREG_I)), "callback with interrupts enabled");
+    if (chain_again) {
+        chain_again = 0;
+        set_command(CMD_W3);
+        TEST_CHECK(spi_transfer_start(0, &command_transfer), "restart from the callback refused");
+    }
+}
+
+/** Polled command and read, the way sensor_init() reads the calibration */
+static uint16_t polled_read(uint16_t cmd) {
+    uint16_t msb, lsb;
+
+    spi_set_clock_phase(0, SPI_CLK_PHASE_SAMPLE_LEADING);
+    DEPTH_ENABLE_PORT |= DEPTH_ENABLE;
+    spi_write(0, cmd >> 8);
+    spi_write(0, cmd & 0xFF);
+    DEPTH_ENABLE_PORT &= ~DEPTH_ENABLE;
+    spi_set_clock_phase(0, SPI_CLK_PHASE_SAMPLE_TRAILING);
+
+    DEPTH_ENABLE_PORT |= DEPTH_ENABLE;
+    msb = (unsigned char)spi_read(0);
+    lsb = (unsigned char)spi_read(0);
+    DEPTH_ENABLE_PORT &= ~DEPTH_ENABLE;
+    return (msb << 8) | lsb;
+}
+
+static void test_polled(void) {
+    uint64_t start = sim_time_us();
+    uint16_t w;
+
+    w = polled_read(CMD_W1);
+    TEST_CHECK(w == cal_word[0], "polled W1 0x%04X, expected 0x%04X", w, cal_word[0]);
+    TEST_CHECK(sim_time_us() - start == 4 * BYTE_US, "4 polled bytes took %llu us, expected %llu",
+               (unsigned long long)(sim_time_us() - start), 4 * BYTE_US);
+    TEST_CHECK(!(SPSR & (1 << SPIF)), "SPIF left set by the polled calls");
+
+    /* a byte clocked with the enable line low reads all ones */
+    TEST_CHECK((unsigned char)spi_read(0) == 0xFF, "MISO not idle high with the sensor disabled");
+}
+
+static void test_chain(void) {
+    uint64_t start;
+
+    set_command(CMD_W2);
+    command_transfer.next = &read_transfer;
+    done_count = 0;
+    start = sim_time_us();
+    TEST_CHECK(spi_transfer_start(0, &command_transfer), "chain refused on an idle bus");
+    TEST_CHECK(spi_transfer_busy(0), "chain not busy after the start");
+    TEST_CHECK(!spi_transfer_start(0, &command_transfer), "second chain accepted while busy");
+    TEST_CHECK(DEPTH_ENABLE_PORT & DEPTH_ENABLE, "enable line low during the command");
+
+    sim_advance_us(4 * BYTE_US - 1);
+    TEST_CHECK(done_count == 0, "chain done before its 4 byte times");
+    sim_advance_us(1);
+    TEST_CHECK(done_count == 1 && done_last == &read_transfer,
+               "chain not done after its 4 byte times, %u callbacks", done_count);
+    TEST_CHECK(!spi_transfer_busy(0), "chain still busy when done");
+    TEST_CHECK(word_read() == cal_word[1], "chain W2 0x%04X, expected 0x%04X",
+               word_read(), cal_word[1]);
+    TEST_CHECK(!(DEPTH_ENABLE_PORT & DEPTH_ENABLE), "enable line left high");
+    TEST_CHECK(!(SPCR & (1 << SPIE)), "SPI interrupt left enabled");
+    TEST_CHECK(sim_time_us() - start == 4 * BYTE_US, "chain took %llu us",
+               (unsigned long long)(sim_time_us() - start));
+
+    /* the callback of the read starts the next chain */
+    set_command(CMD_W1);
+    chain_again = 1;
+    done_count = 0;
+    spi_transfer_start(0, &command_transfer);
+    sim_advance_us(8 * BYTE_US);
+    TEST_CHECK(done_count == 2, "%u callbacks for two chains", done_count);
+    TEST_CHECK(word_read() == cal_word[2], "restarted chain W3 0x%04X, expected 0x%04X",
+               word_read(), cal_word[2]);
+}
+
+/** A byte done while the I flag is clear is served once it is set */
+static void test_held_off(void) {
+    set_command(CMD_W1);
+    done_count = 0;
+    cli();
+    spi_transfer_start(0, &command_transfer);
+    sim_advance_us(10 * BYTE_US);
+    TEST_CHECK(done_count == 0 && spi_transfer_busy(0), "chain ran with interrupts off");
+    TEST_CHECK(SPSR & (1 << SPIF), "SPIF not set by the first byte");
+    sei();
+    sim_advance_us(4 * BYTE_US);
+    TEST_CHECK(done_count == 1 && word_read() == cal_word[0],
+               "held off chain: %u callbacks, W1 0x%04X", done_count, word_read());
+}
+
+/** Writing SPDR while a byte is shifting collides and is ignored */
+static void test_collision(void) {
+    unsigned long before = sim_spi_stats()->collisions;
+
+    spi_write_noblock(0, 0);
+    spi_write_noblock(0, 0);
+    spi_wait(0);
+    TEST_CHECK(sim_spi_stats()->collisions == before + 1, "%lu collisions counted",
+               sim_spi_stats()->collisions - before);
+    TEST_CHECK(SPSR & (1 << WCOL), "WCOL not set by the collision");
+    (void)spi_read(0);
+    TEST_CHECK(!(SPSR & (1 << WCOL)), "WCOL not cleared by reading SPSR and SPDR");
+    sim_advance_us(4 * BYTE_US);
+    TEST_CHECK(!spi_transfer_busy(0), "bus busy after the collision");
+}
+
+int main(void) {
+    sim_init();
+    DEPTH_ENABLE_PORT_DIR |= DEPTH_ENABLE;
+    spi_init();
+    sei();
+
+    test_polled();
+    test_chain();
+    test_held_off();
+    test_collision();
+
+    TEST_CHECK(sim_ms5541_stats()->protocol_errors == 0, "%lu MS5541 protocol errors",
+               sim_ms5541_stats()->protocol_errors);
+    return test_result("spi_chain");
+}
@@ -0,0 +1,103 @@
+/** @file   surface_track.c
+ *  @brief  Surface detection and reference tracking
+ *
+ *          Runs src/surface.c on pressure samples made up here, without the
+ *          rest of the firmware: the reference must be captured at the mean
+ *          of a rippled surface, a lone wave crest must not stay in it, and
+ *          a slow change of the weather must be followed without the
+ *          surface being lost.
+ */
+
+#include "sim.h"
+#include "test.h"
+
+#include <depth.h>
+#include <surface.h>
+#include <sysclk.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+/** Depth sensor sample interval, mS */
+#define SAMPLE_mS       50
+/** Surface pressure, mBar/100 */
+#define SURFACE_cmBar   101300L
+/** Ripple on the surface, amplitude in mBar/100 and period in mS */
+#define RIPPLE_cmBar    200
+#define RIPPLE_mS       4000
+/** Largest error of the reference at a steady surface, mBar/100 */
+#define ZERO_TOL_cmBar  50
+
+static unsigned long now_mS;
+
+/** Feed the samples of a span of time
+ *
+ *  @param base   pressure at the start, mBar/100
+ *  @param drift  change of the pressure over the span, mBar/100
+ *  @return number of samples the surface was not detected after
+ */
+static unsigned long feed(unsigned long span_mS, long base, long drift) {
+    unsigned long t, lost = 0;
+    long p;
+
+    for (t = 0; t < span_mS; t += SAMPLE_mS) {
+        p = base + drift * (long)t / (long)span_mS +
+            lround(RIPPLE_cmBar * sin(2 * M_PI * now_mS / RIPPLE_mS));
+        surface_update(p, SYS_CLK_MS_2_TICKS(now_mS));
+        if (!surface_detected()) {
+            lost++;
+        }
+        now_mS += SAMPLE_mS;
+    }
+    return lost;
+}
+
+/** The first hold at the surface captures its mean */
+static void test_capture(void) {
+    long err;
+
+    feed(SURFACE_HOLD_mS - 2 * SURFACE_TRACK_mS, SURFACE_cmBar, 0);
+    TEST_CHECK(!surface_detected(), "surface detected before the hold is over");
+    feed(4 * SURFACE_TRACK_mS, SURFACE_cmBar, 0);
+    TEST_CHECK(surface_detected(), "surface not detected");
+    err = depth_zero_cmBar() - SURFACE_cmBar;
+    TEST_CHECK(labs(err) <= ZERO_TOL_cmBar, "reference captured %ld off the surface", err);
+}
+
+/** One crest within the spread goes into a single step */
+static void test_crest(void) {
+    long err;
+
+    surface_update(SURFACE_cmBar + SURFACE_SPREAD_cmBar - 2 * RIPPLE_cmBar,
+                   SYS_CLK_MS_2_TICKS(now_mS));
+    now_mS += SAMPLE_mS;
+    TEST_CHECK(feed(300000, SURFACE_cmBar, 0) == 0, "surface lost after a crest");
+    err = depth_zero_cmBar() - SURFACE_cmBar;
+    TEST_CHECK(labs(err) <= ZERO_TOL_cmBar, "reference %ld off the surface after a crest", err);
+}
+
+/** 30 mBar of weather in half an hour, three times the spread */
+static void test_weather(void) {
+    long drift = 3 * SURFACE_SPREAD_cmBar;
+    long err;
+
+    TEST_CHECK(feed(1800000, SURFACE_cmBar, drift) == 0, "surface lost to the weather");
+    /* the reference lags the drift by about SURFACE_TRACK_DIV steps */
+    err = depth_zero_cmBar() - (SURFACE_cmBar + drift);
+    TEST_CHECK(labs(err) <= drift * SURFACE_TRACK_DIV * SURFACE_TRACK_mS / 1800000 +
+               ZERO_TOL_cmBar, "reference %ld off the surface after the drift", err);
+}
+
+int main(void) {
+    sim_init();
+    /* until the depth sensor has a reading its filter flags a reject */
+    sim_run(1000000);
+    surface_init();
+    surface_enable(1);
+
+    test_capture();
+    test_crest();
+    test_weather();
+
+    return test_result("surface_track");
+}
@@ -0,0 +1,51 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+/** @file   test.h
+ *  @brief  Checks for the host tests
+ *
+ *          Each test in test/ is a program of its own, built against the
+ *          host simulation library and run by make test.  A failed check
+ *          prints where and why and is counted, main() returns
+ *          test_result() so make stops at the first failing test.
+ *
+ * @code Example:
+         TEST_CHECK(p == ref, "D1 %u D2 %u: %ld, expected %ld", d1, d2, p, ref);
+         return test_result("ms5541_sweep");
+    @endcode
+ */
+
+#include <stdio.h>
+
+/** Failed checks printed, the rest are only counted */
+#define TEST_PRINT_LIMIT 10
+
+static unsigned long test_checks;
+static unsigned long test_failures;
+
+/** Count a check, report it if cond is false */
+#define TEST_CHECK(cond, ...) do {                                          \
+        test_checks++;                                                      \
+        if (!(cond)) {                                                      \
+            if (test_failures++ < TEST_PRINT_LIMIT) {                       \
+                fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);             \
+                fprintf(stderr, __VA_ARGS__);                               \
+                fputc('\n', stderr);                                        \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+/** Print the summary line of a test
+ *
+ *  @return exit status for main(), 0 if all checks passed
+ */
+static inline int test_result(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: FAILED %lu of %lu checks\n", name, test_failures, test_checks);
+        return 1;
+    }
+    printf("%s: %lu checks passed\n", name, test_checks);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,245 @@
+/** @file   uart_ring.c
+ *  @brief  Firmware uart driver on the simulated USART
+ *
+ *          Runs src/uart.c on the register model of the host simulation,
+ *          without the rest of the firmware: the transmit and receive rings
+ *          are filled and drained across their wrap point with
+ *          uart_write(), uart_tx_reserve()/uart_tx_commit() and uart_read(),
+ *          and the overflow counters and the rs485 transmit enable are
+ *          checked against the bytes that reached the line.  A previous
+ *          byte leaving the line just after a write asserts the rs485
+ *          transmitter must not release it under the new byte.
+ */
+
+#include "sim.h"
+#include "test.h"
+
+#include <device.h>
+#include <uart.h>
+
+#include <avr/interrupt.h>
+
+#include <string.h>
+
+#define PORT     COMM_PORT_TETHER
+#define TXE_MASK UART_0_RS485_TXE_MASK
+
+/** Ring size of the driver, holds one byte less */
+#define RING     256
+
+/** Longest the line may take to drain a ring at 115200 baud */
+#define DRAIN_US 50000ULL
+
+/** One byte on the line at 115200 baud, rounded up */
+#define BYTE_US  87
+
+/** Expected byte n of the test stream */
+static char pattern(unsigned long n) {
+    return (char)(n * 7 + (n >> 8));
+}
+
+/** Bytes sent and checked so far */
+static unsigned long tx_sent;
+static unsigned long tx_checked;
+
+static void run_until_idle(void) {
+    uint64_t start = sim_time_us();
+
+    while (!uart_tx_idle(PORT) && sim_time_us() - start < DRAIN_US) {
+        sim_advance_us(100);
+    }
+    TEST_CHECK(uart_tx_idle(PORT), "transmitter still busy after %llu us",
+               (unsigned long long)DRAIN_US);
+}
+
+/** Compare the captured line output with the stream */
+static void check_output(void) {
+    size_t len, i;
+    const char *out = sim_uart_output(PORT, &len);
+
+    TEST_CHECK(len == tx_sent - tx_checked, "%lu bytes on the line, expected %lu",
+               (unsigned long)len, tx_sent - tx_checked);
+    for (i = 0; i < len; i++) {
+        if (out[i] != pattern(tx_checked + i)) {
+            TEST_CHECK(0, "byte %lu on the line is 0x%02X, expected 0x%02X",
+                       tx_checked + (unsigned long)i, (unsigned char)out[i],
+                       (unsigned char)pattern(tx_checked + i));
+            break;
+        }
+    }
+    tx_checked = tx_sent;
+    sim_uart_clear_output(PORT);
+}
+
+/** uart_write() in uneven chunks, so the ring wraps at every position */
+static void test_write_wrap(void) {
+    char buf[RING];
+    int chunk, i, n;
+
+    for (chunk = 1; chunk < RING; chunk += 37) {
+        for (i = 0; i < chunk; i++) {
+            buf[i] = pattern(tx_sent + i);
+        }
+        n = uart_write(PORT, buf, chunk);
+        TEST_CHECK(n == chunk, "uart_write() of %d bytes took %d", chunk, n);
+        tx_sent += n;
+        TEST_CHECK(PORTA & TXE_MASK, "rs485 transmitter off while sending");
+        run_until_idle();
+        TEST_CHECK(!(PORTA & TXE_MASK), "rs485 transmitter left on when idle");
+        check_output();
+    }
+}
+
+/** Reserve and commit, the reserved span ends at the wrap point */
+static void test_reserve_wrap(void) {
+    int round, want, room, span, i;
+    char *p;
+
+    for (round = 0; round < 8; round++) {
+        want = 100 + 19 * round;
+        while (want) {
+            p = uart_tx_reserve(PORT, &room);
+            TEST_CHECK(p && room > 0, "nothing reserved with %d bytes free", uart_tx_free(PORT));
+            if (!p || room <= 0) {
+                return;
+            }
+            span = room < want ? room : want;
+            for (i = 0; i < span; i++) {
+                p[i] = pattern(tx_sent + i);
+            }
+            uart_tx_commit(PORT, span);
+            tx_sent += span;
+            want -= span;
+        }
+        run_until_idle();
+        check_output();
+    }
+}
+
+/** A full ring refuses and counts the rest, nothing is lost on the line */
+static void test_tx_overflow(void) {
+    struct UART_Stats before, after;
+    char buf[RING + 64];
+    int i, n;
+
+    uart_get_stats(PORT, &before);
+    for (i = 0; i < (int)sizeof(buf); i++) {
+        buf[i] = pattern(tx_sent + i);
+    }
+    n = uart_write(PORT, buf, sizeof(buf));
+    /* one byte goes straight to the idle data register */
+    TEST_CHECK(n == RING, "uart_write() into an empty ring took %d bytes", n);
+    tx_sent += n;
+    TEST_CHECK(uart_tx_free(PORT) == 0, "%d bytes free in a full ring", uart_tx_free(PORT));
+    TEST_CHECK(!uart_write_byte(PORT, 'x'), "uart_write_byte() into a full ring");
+
+    uart_get_stats(PORT, &after);
+    TEST_CHECK(after.tx_dropped - before.tx_dropped == sizeof(buf) - n + 1,
+               "%u bytes counted as dropped, expected %u",
+               after.tx_dropped - before.tx_dropped, (unsigned)(sizeof(buf) - n + 1));
+    run_until_idle();
+    check_output();
+}
+
+/** Times the clock was advanced between the register writes of a write */
+static int window_hits;
+
+/** Let the byte on the line finish, inside a write */
+static void finish_byte(void) {
+    sim_advance_us(2 * BYTE_US);
+    window_hits++;
+}
+
+/** Write each way with the byte before finishing right after the rs485
+ *  transmitter is asserted, its transmit complete interrupt then finds
+ *  the ring empty unless the write holds it off */
+static void test_txe_window(void) {
+    char c;
+    int way, room;
+    char *p;
+
+    for (way = 0; way < 3; way++) {
+        TEST_CHECK(uart_write_byte(PORT, pattern(tx_sent)), "uart_write_byte() refused");
+        tx_sent++;
+        sim_advance_us(BYTE_US / 4);
+
+        c = pattern(tx_sent);
+        sim_io_on_write(&PORTA, finish_byte);
+        if (way == 0) {
+            TEST_CHECK(uart_write_byte(PORT, c), "uart_write_byte() refused");
+        } else if (way == 1) {
+            TEST_CHECK(uart_write(PORT, &c, 1) == 1, "uart_write() refused");
+        } else {
+            p = uart_tx_reserve(PORT, &room);
+            TEST_CHECK(p && room > 0, "nothing reserved in an empty ring");
+            if (!p || room <= 0) {
+                return;
+            }
+            *p = c;
+            uart_tx_commit(PORT, 1);
+        }
+        tx_sent++;
+        TEST_CHECK(window_hits == way + 1, "write %d did not drive the transmit enable", way);
+        sim_advance_us(BYTE_US / 4);
+        TEST_CHECK(PORTA & TXE_MASK, "rs485 transmitter released under write %d", way);
+        run_until_idle();
+        TEST_CHECK(!(PORTA & TXE_MASK), "rs485 transmitter left on when idle");
+        check_output();
+    }
+}
+
+/** Receive in chunks across the wrap point, then overflow the ring */
+static void test_rx(void) {
+    struct UART_Stats before, after;
+    char in[RING + 64];
+    char out[RING + 64];
+    unsigned long n = 0;
+    int chunk, i, got;
+
+    for (chunk = 1; chunk < RING; chunk += 41) {
+        for (i = 0; i < chunk; i++) {
+            in[i] = pattern(n + i);
+        }
+        sim_uart_rx(PORT, in, chunk);
+        sim_advance_us(DRAIN_US);
+        TEST_CHECK(uart_rx_cnt(PORT) == chunk, "%d bytes received, expected %d",
+                   uart_rx_cnt(PORT), chunk);
+        got = uart_read(PORT, out, sizeof(out));
+        TEST_CHECK(got == chunk && memcmp(in, out, chunk) == 0,
+                   "read %d bytes, expected %d", got, chunk);
+        n += chunk;
+    }
+
+    uart_get_stats(PORT, &before);
+    for (i = 0; i < (int)sizeof(in); i++) {
+        in[i] = pattern(n + i);
+    }
+    sim_uart_rx(PORT, in, sizeof(in));
+    sim_advance_us(2 * DRAIN_US);
+    uart_get_stats(PORT, &after);
+    TEST_CHECK(after.rx_dropped - before.rx_dropped == sizeof(in) - (RING - 1),
+               "%u bytes counted as dropped, expected %u",
+               after.rx_dropped - before.rx_dropped, (unsigned)(sizeof(in) - (RING - 1)));
+    got = uart_read(PORT, out, sizeof(out));
+    TEST_CHECK(got == RING - 1 && memcmp(in, out, got) == 0,
+               "read %d bytes of a full ring, expected %d", got, RING - 1);
+    TEST_CHECK(sim_uart_stats(PORT)->rx_overruns == 0,
+               "%lu bytes overran the receiver", sim_uart_stats(PORT)->rx_overruns);
+}
+
+int main(void) {
+    sim_init();
+    uart_init();
+    sei();
+
+    test_write_wrap();
+    test_reserve_wrap();
+    test_tx_overflow();
+    test_write_wrap();
+    test_txe_window();
+    test_rx();
+
+    TEST_CHECK(sim_uart_stats(PORT)->tx_ignored == 0, "%lu UDR writes ignored",
+               sim_uart_stats(PORT)->tx_ignored);
+    return test_result("uart_ring");
+}
@@ -0,0 +1,62 @@
+#ifndef __ADC_H__
+#define __ADC_H__
+
+#include <types.h>
+
+/** @file   adc.h
+ *  @brief  Background acquisition on the MCU ADC
+ *
+ *          One channel is converted continuously in free running mode at
+ *          F_CPU/128, a conversion every 13 ADC clocks (about 8.9 kHz at
+ *          14.7456 MHz).  The conversion complete interrupt adds up
+ *          ADC_DECIMATION conversions and hands the sum over as one sample,
+ *          so the main loop sees about 140 samples per second with 16 bits
+ *          of resolution and the noise of the single conversions averaged
+ *          out.
+ *
+ *          A sample not collected with adc_read() before the next one is
+ *          complete is replaced and counted as an overrun.
+ */
+
+/** Conversions added up per sample, the sum of ADC_DECIMATION 10 bit
+ *  conversions fits in 16 bits */
+#define ADC_DECIMATION  64
+
+/** Largest sample, every conversion at full scale */
+#define ADC_SAMPLE_MAX  (ADC_DECIMATION * 1023U)
+
+/** One decimated sample */
+struct AdcSample
+{
+    uint16_t sum;           ///< sum of ADC_DECIMATION conversions
+    unsigned long time;     ///< system time the last conversion completed
+    uint16_t seq;           ///< incremented with every sample
+};
+
+/** Start converting a channel in the background, restarts the decimation
+ *
+ *  @param channel MCU ADC channel (ADC_* in the platform header), converted
+ *         against AVCC
+ */
+void adc_start(unsigned char channel);
+
+/** Stop the conversions and turn the ADC off */
+void adc_stop(void);
+
+/** @return 1 while conversions are running */
+char adc_running(void);
+
+/** Collect the latest sample
+ *
+ *  @param sample filled in with the latest sample if there is a new one
+ *  @return 1 if a new sample was collected
+ */
+char adc_read(struct AdcSample *sample);
+
+/** @return 1 if a sample is waiting to be collected */
+char adc_pending(void);
+
+/** @return Samples replaced before they were collected */
+unsigned int adc_overruns(void);
+
+#endif
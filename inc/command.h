@@ -0,0 +1,127 @@
+#ifndef __COMMAND_H__
+#define __COMMAND_H__
+
+/** @file   command.h
+ *  @brief  Incremental parser for NMEA style commands
+ *
+ *          Commands have the form "$ID,F1,F2,...*XX\r\n" where the fields
+ *          are signed decimal integers and may be left empty.  The parser is
+ *          fed one byte at a time and tokenizes as the bytes arrive, so there
+ *          is no line buffer and no string scan once the line is complete.
+ *          Every byte takes a small, fixed amount of work.
+ *
+ *          The checksum (*XX, xor of the bytes between '$' and '*') is
+ *          optional, but a line that carries one must match it.
+ *
+ *          By convention a command without fields is a query and a command
+ *          with fields changes settings; empty fields keep the current
+ *          value.  Both are acknowledged by echoing the current settings
+ *          under the command id, a refused command is answered with
+ *          "$PVRNK,ID,E" where E is the COMMAND_ERR_* code.
+ *
+ * @code Example:
+         static char command_rate(const struct CommandLine *line) { ... }
+
+         static const struct Command commands[] = {
+             { "PVRSR", command_rate },
+         };
+
+         c = command_parse(&parser, uart_read_byte(COMM_PORT_TETHER));
+         if (c == COMMAND_LINE) {
+             c = command_dispatch(commands, 1, &parser.line);
+         }
+         if (c >= COMMAND_ERR_CHECKSUM) {
+             command_nak(COMM_PORT_TETHER, &parser.line, c, 0);
+         }
+   @endcode
+ */
+
+/** Longest command id, e.g. "PVRSR" */
+#define COMMAND_ID_LEN      5
+/** Most fields per command */
+#define COMMAND_MAX_FIELDS  4
+/** Most digits per field, keeps the value within a long */
+#define COMMAND_MAX_DIGITS  9
+
+/** @name Results of command_parse() and command_dispatch() */
+//@{
+#define COMMAND_PENDING       0  ///< line not complete yet
+#define COMMAND_LINE          1  ///< a complete line is in the parser
+#define COMMAND_ACK           2  ///< command executed
+#define COMMAND_ERR_CHECKSUM  3  ///< checksum did not match
+#define COMMAND_ERR_FORMAT    4  ///< malformed or too long
+#define COMMAND_ERR_UNKNOWN   5  ///< no such command
+#define COMMAND_ERR_PARAM     6  ///< a value was out of range
+//@}
+
+/** A parsed command line */
+struct CommandLine
+{
+    char id[COMMAND_ID_LEN + 1];        ///< null terminated command id
+    unsigned char fields;               ///< number of fields, empty ones included
+    unsigned char present;              ///< bit n set if field n has a value
+    long field[COMMAND_MAX_FIELDS];     ///< field values, 0 if empty
+};
+
+/** @return True if field n of a line has a value */
+#define COMMAND_HAS(line, n)  ((line)->present & (1 << (n)))
+
+/** State of the parser */
+struct CommandParser
+{
+    char state;                 ///< position within the line
+    char error;                 ///< first COMMAND_ERR_* of the line
+    unsigned char checksum;     ///< running xor
+    unsigned char rx_checksum;  ///< checksum received after the '*'
+    unsigned char len;          ///< characters in the current token
+    char negative;              ///< current field has a minus sign
+    struct CommandLine line;    ///< the line being parsed
+};
+
+/** Handler of one command
+ *
+ *  Called with a complete, checksum verified line.  Sends the
+ *  acknowledgement itself.
+ *
+ *  @return 1 if executed, 0 if the values were refused
+ */
+typedef char (*CommandHandler)(const struct CommandLine *line);
+
+/** Dispatch table entry */
+struct Command
+{
+    const char *id;
+    CommandHandler handler;
+};
+
+/** Reset the parser, waits for the next '$' */
+void command_init(struct CommandParser *p);
+
+/** Feed one received byte to the parser
+ *
+ *  @return COMMAND_LINE when a valid line was completed and can be found in
+ *          p->line until the next call, COMMAND_ERR_* when a line was
+ *          completed with an error, otherwise COMMAND_PENDING
+ */
+char command_parse(struct CommandParser *p, char c);
+
+/** Run the handler for a line
+ *
+ *  @param table commands to choose from
+ *  @param cnt number of entries in table
+ *  @param line completed line
+ *  @return COMMAND_ACK, COMMAND_ERR_UNKNOWN or COMMAND_ERR_PARAM
+ */
+char command_dispatch(const struct Command *table, unsigned char cnt,
+                      const struct CommandLine *line);
+
+/** Send the negative acknowledgement "$PVRNK,ID,E" for a refused line
+ *
+ *  @param port uart to write to
+ *  @param line the refused line
+ *  @param error COMMAND_ERR_* code
+ *  @param use_checksum set to 1 to terminate the sentence with *XX
+ */
+void command_nak(int port, const struct CommandLine *line, char error, char use_checksum);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <types.h>
+
+/** @file   config.h
+ *  @brief  Persistent configuration in eeprom
+ *
+ *          The settings are kept as one versioned, CRC protected record.
+ *          Every save appends the record to the next slot of a journal of
+ *          CONFIG_JOURNAL_SLOTS slots (CONFIG_JOURNAL_ADDR in the platform
+ *          header) with an incremented sequence number, so each cell is
+ *          written once per CONFIG_JOURNAL_SLOTS saves.  At startup the valid
+ *          slot with the highest sequence number wins; a save cut short by a
+ *          reset fails its CRC and the previous record is used.
+ *
+ *          Writes are deferred: config_save() only records the settings and
+ *          config_service(), called from the main loop, writes one byte per
+ *          call and only when the eeprom is ready, so the ~8.5 mS eeprom
+ *          write time never stalls the acquisition.  Saves are coalesced, at
+ *          most one record is written per CONFIG_SAVE_DELAY_mS.
+ *
+ *          Each record carries its length, so a record written before
+ *          fields were appended to struct Config still loads: the fields
+ *          it holds override the defaults and the new ones keep theirs.
+ *          A longer record from a newer firmware loads the fields this one
+ *          knows.  New fields therefore go at the end and leave
+ *          CONFIG_VERSION alone; only moving or redefining a field bumps it.
+ *          A record of another CONFIG_VERSION is ignored and the settings
+ *          keep their defaults.
+ */
+
+/** Layout version of struct Config */
+#define CONFIG_VERSION        1
+
+/** Bytes per journal slot, a struct ConfigSlot must fit */
+#define CONFIG_SLOT_SIZE      64
+/** Number of journal slots */
+#define CONFIG_JOURNAL_SLOTS  (CONFIG_JOURNAL_LEN / CONFIG_SLOT_SIZE)
+
+/** Time from the first change to writing the record, later changes are
+ *  written with it */
+#define CONFIG_SAVE_DELAY_mS  2000
+
+/** The persistent settings, append only.  Wider fields sit at a multiple
+ *  of their size so the layout is the same with and without packing */
+struct Config
+{
+    int32_t zero_cmBar;             ///< surface reference, see depth_set_zero_cmBar()
+    uint32_t tether_baudrate;       ///< tether baudrate
+    uint32_t accessory_baudrate;    ///< accessory port baudrate
+    uint16_t output_period_mS;      ///< tether output schedule period
+    uint16_t output_threshold_mBar; ///< tether output schedule change threshold
+    uint16_t accessory_period_mS;   ///< accessory output schedule, see router.h
+    uint16_t accessory_threshold_mBar;
+    uint16_t fluid_density_kgm3;    ///< density of the water column
+    uint8_t output_mode;            ///< OUTPUT_MODE_*
+    uint8_t output_format;          ///< OUTPUT_FORMAT_*
+    uint8_t output_checksum;        ///< NMEA checksum on output sentences
+    uint8_t output_filtered;        ///< filtered depth output enabled
+    uint8_t filter_median;          ///< see depth_set_filter()
+    uint8_t filter_alpha;
+    uint8_t filter_beta;
+    uint8_t oversample;             ///< see depth_set_oversample()
+    int8_t latitude_deg;            ///< latitude for the gravity, see hydro.h
+    uint8_t auto_zero;              ///< automatic surface zeroing, see surface.h
+    uint8_t tether_rs485;           ///< tether RS-485 (1) or RS-232 (0)
+    uint8_t accessory_enabled;      ///< samples published on the accessory port
+    uint8_t accessory_mode;
+    uint8_t accessory_format;
+    uint8_t accessory_checksum;
+    uint8_t accessory_rs485;
+    uint8_t fusion_enabled;         ///< analog cross-check, see fusion.h
+    uint8_t reserved;               ///< aligns the fields below
+    uint16_t analog_zero;           ///< analog transducer, see fusion_set_transducer()
+    uint16_t analog_span;
+    uint16_t analog_span_mBar;
+};
+
+/** Load the latest valid record from the journal
+ *
+ *  Also positions the journal for the following saves, so it must be called
+ *  once at startup before config_service().
+ *
+ *  @param cfg the defaults on entry, the fields held by the record are
+ *             overwritten if one was found
+ *  @return 1 if a record was found
+ */
+char config_load(struct Config *cfg);
+
+/** Request the settings to be saved
+ *
+ *  Cheap, may be called on every change.  Nothing is written if the
+ *  settings equal the last record.
+ *
+ *  @param cfg settings to save
+ *  @param now current system time (get_time())
+ */
+void config_save(const struct Config *cfg, unsigned long now);
+
+/** Deferred writer, must be called on every pass of the main loop
+ *
+ *  @param now current system time (get_time())
+ */
+void config_service(unsigned long now);
+
+/** @return 1 while a save is waiting or being written */
+char config_busy(void);
+
+#endif
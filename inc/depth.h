@@ -1,12 +1,16 @@
 #ifndef __DEPTH_H__
 #define __DEPTH_H__
 
+#include <types.h>
+
 /** @file   depth.h
  *  @brief  Support reading of depth sensor
  *
  *          API for depth sensor access.
  *
- *          Currently the Intersema MS5541 is the supported pressure sensor.
+ *          The pressure sensor driver is selected by the platform header,
+ *          see sensor.h.  Currently the Intersema MS5541 is the supported
+ *          pressure sensor.
  *
  *          This depth sensor aquires temperature data as well.  This is the 
  *          temperature of the pressure sensing element, which we assume is at 
@@ -42,16 +46,267 @@ void depth_init(void);
  *  Uses the sysclk module as a timebase.  Assumes sysclk ticks are 1 mS, but would
  *  work with ticks longer than 1mS.  
  *
+ *  Once depth_acq_timer_start() has been called the sensor is read from the
+ *  timer interrupt and this function only compensates the queued samples,
+ *  one per call.
+ *
  *  @return 1 new depth data available, otherwise 0
  */ 
 char depth_acq(void);
 
+/** Drive the acquisition from Timer 3 output compare A
+ *
+ *  Each conversion is read from the interrupt as soon as it is complete and
+ *  timestamped there, giving a fixed sample spacing regardless of the main
+ *  loop.  The direct read functions must not be used while the timer runs.
+ */
+void depth_acq_timer_start(void);
+
+/** Stop timer driven acquisition and return to polling from depth_acq() */
+void depth_acq_timer_stop(void);
+
+/** @return 1 if the timer has queued samples depth_acq() has not taken yet */
+char depth_acq_pending(void);
+
+/** @return Samples dropped because depth_acq() did not keep up with the timer */
+unsigned int depth_acq_overruns(void);
+
+/** @return Depth in psi
+ *
+ *  Derived on request from the integer mBar value, this is the only place
+ *  floating point math is used for the depth reading.
+ */
 float depth_psi(void);
+
+/** @return Water temperature in degree C, derived on request */
 float water_temp_C(void);
+
+/** @return Depth in milli-psi */
 unsigned int depth_mpsi(void);
+
+/** @return Depth in mBar, calculated with the datasheet integer algorithm */
 unsigned int depth_mBar(void);
+
+/** @return Depth in mBar/100
+ *
+ *  Same reading as depth_mBar() with the fraction kept.  With a single
+ *  conversion per output the fraction is below the sensor noise, with
+ *  oversampling (depth_set_oversample()) it carries real resolution.
+ */
+long depth_cmBar(void);
+
+/** @return Water temperature in degree C/100 (0.1 C resolution) */
 unsigned int water_temp_cC(void);
 
+/** @return Raw pressure datum (D1) of the last acquisition, the rounded mean
+ *          of the window when oversampling */
+unsigned long depth_raw_last(void);
+
+/** @return Raw temperature datum (D2) of the last acquisition */
+unsigned long temp_raw_last(void);
+
+/** @name Status flags returned by depth_status() */
+//@{
+#define DEPTH_STATUS_INIT_ERROR  (1<<0)  ///< calibration words could not be read
+#define DEPTH_STATUS_REJECTED    (1<<1)  ///< last reading was rejected as an outlier
+//@}
+
+/** @return Sensor status flags (DEPTH_STATUS_*) */
+unsigned char depth_status(void);
+
+//@}
+
+/** @name Diagnostics
+ *
+ *  Counted as a side effect of the acquisition, the counters wrap at 16 bits.
+ */
+//@{
+
+/** @return Readings rejected as outliers since depth_init() */
+unsigned int depth_reject_count(void);
+
+/** @return Conversions read as all zeros or all ones, a sign of a stuck
+ *          SPI data line or an unpowered sensor */
+unsigned int depth_read_errors(void);
+
+/** @return CRC-16/CCITT (init 0xFFFF) of the four calibration words as read
+ *          at depth_init(), most significant byte first.  The MS5541 has
+ *          no CRC of its own; the value is fixed for a given sensor, so a
+ *          change from the one recorded at commissioning means a bad read. */
+unsigned int depth_calibration_crc(void);
+
+/** Shortest and longest time between samples since the last call
+ *
+ *  The average is depth_sample_period().
+ *
+ *  @param min set to the shortest time in system ticks, 0 if none
+ *  @param max set to the longest time in system ticks, 0 if none
+ */
+void depth_cycle_times(unsigned long *min, unsigned long *max);
+
+//@}
+
+/** @name Raw capture
+ *
+ *  Everything needed to redo the compensation and filtering offline: the
+ *  calibration words and every conversion as read, before oversampling.
+ */
+//@{
+
+#define DEPTH_RAW_BITS_MAX   24  ///< widest raw conversion of a sensor driver
+#define DEPTH_CAL_WORDS_MAX  8   ///< most calibration words of a sensor driver
+
+/** One conversion as read from the sensor */
+struct DepthConversion
+{
+    uint32_t d1;                ///< raw pressure
+    uint32_t d2;                ///< raw temperature, reused if temp_age > 0
+    unsigned char temp_age;     ///< see depth_temp_age()
+    unsigned long time;         ///< system time the pressure conversion was read
+    uint16_t seq;               ///< incremented with every conversion
+};
+
+/** @return The last conversion depth_acq() took in, the seq field changes
+ *          when there is a new one */
+const struct DepthConversion *depth_last_conversion(void);
+
+/** Copy the calibration words as read at depth_init(), 0 for a word that
+ *  could not be read and for those past the driver's
+ *
+ *  @return number of calibration words of the sensor driver
+ */
+unsigned char depth_calibration_words(uint16_t word[DEPTH_CAL_WORDS_MAX]);
+
+//@}
+
+/** @name Acquisition rate
+ *
+ *  Water temperature changes slowly, so the temperature conversion can be
+ *  made only every N pressure conversions with the last temperature datum
+ *  reused in between.  With N = 1 (default) every pressure sample has its
+ *  own temperature conversion, larger N approach twice the sample rate.
+ */
+//@{
+
+/** depth_temp_age() value before the first temperature conversion */
+#define DEPTH_TEMP_AGE_NONE 0xFF
+
+/** Set the number of pressure conversions per temperature conversion
+ *
+ *  @param n 1 to 255, 0 is treated as 1
+ */
+void depth_set_temp_interval(unsigned char n);
+
+/** @return Pressure conversions per temperature conversion */
+unsigned char depth_get_temp_interval(void);
+
+/** @return Number of samples the current temperature datum has been reused
+ *          for, 0 if the latest sample had a fresh temperature conversion */
+unsigned char depth_temp_age(void);
+
+/** @return System time at which the latest sample's pressure conversion
+ *          was read, the last one of the window when oversampling */
+unsigned long depth_sample_time(void);
+
+/** @return Sequence number of the latest sample, incremented by every
+ *          output of depth_acq() and wrapping at 16 bits.  A gap between
+ *          two outputs carrying it counts the samples not sent. */
+unsigned int depth_sample_seq(void);
+
+/** @return Measured time between samples in system time ticks (see sysclk.h),
+ *          0 until two samples have been taken */
+unsigned long depth_sample_period(void);
+
+/** @return System time ticks of one conversion of the sensor, the pressure
+ *          of a sample is that of the middle of the conversion ending at
+ *          depth_sample_time() */
+unsigned long depth_conversion_time(void);
+
+/** @return Measured sample rate in Hz/100, the effective output rate when
+ *          oversampling */
+unsigned int depth_sample_rate_cHz(void);
+
+/** Longest oversampling window */
+#define DEPTH_OVERSAMPLE_MAX 64
+
+/** Set the number of pressure conversions averaged into each output
+ *
+ *  Trades sample rate for resolution: n conversions are summed and the
+ *  output is compensated from their mean with 8 fraction bits, lowering the
+ *  noise by about sqrt(n).  depth_acq() reports new data once per window.
+ *
+ *  @param n 1 (no oversampling) to DEPTH_OVERSAMPLE_MAX
+ *  @return 1 if accepted
+ */
+char depth_set_oversample(unsigned char n);
+
+/** @return Pressure conversions averaged into each output */
+unsigned char depth_get_oversample(void);
+
+//@}
+
+/** @name Filtered output
+ *
+ *  Every accepted reading is run through a running median and an alpha-beta
+ *  tracker (see filter.h) at the full acquisition rate.  Rejected readings
+ *  are not fed to the filter.
+ */
+//@{
+
+/** Configure the filter, it restarts with the next sample
+ *
+ *  @param median_len running median length, 1, 3 or 5
+ *  @param alpha depth gain, Q8 (0 for 1.0, i.e. no smoothing)
+ *  @param beta rate gain, Q8
+ *  @return 1 if the settings were accepted
+ */
+char depth_set_filter(unsigned char median_len, unsigned char alpha, unsigned char beta);
+
+/** @return Current filter settings, see depth_set_filter() */
+unsigned char depth_filter_median(void);
+unsigned char depth_filter_alpha(void);
+unsigned char depth_filter_beta(void);
+
+/** @return Filtered depth in mBar/100 */
+long depth_filtered_cmBar(void);
+
+/** @return Filtered rate of change of depth in mBar/100 per second,
+ *          positive when descending */
+long depth_rate_cmBar_s(void);
+
+//@}
+
+/** @name Surface reference
+ *
+ *  Pressure at the surface (zero offset), subtracted from the absolute
+ *  pressure to give the pressure of the water column alone.
+ */
+//@{
+
+/** Standard atmosphere, used until a reference is set */
+#define DEPTH_ZERO_DEFAULT_cmBar  101325L
+/** Range accepted for the reference */
+#define DEPTH_ZERO_MIN_cmBar      50000L
+#define DEPTH_ZERO_MAX_cmBar      150000L
+
+/** Set the surface reference
+ *
+ *  @param zero reference in mBar/100, DEPTH_ZERO_MIN_cmBar to
+ *         DEPTH_ZERO_MAX_cmBar
+ *  @return 1 if accepted
+ */
+char depth_set_zero_cmBar(long zero);
+
+/** @return Surface reference in mBar/100 */
+long depth_zero_cmBar(void);
+
+/** @return Pressure above the surface reference in mBar/100, see depth_cmBar() */
+long depth_gauge_cmBar(void);
+
+/** @return Depth below the surface reference in mm, with the fluid density
+ *          and latitude set in hydro.h */
+long depth_mm(void);
+
 //@}
 
 /** @name Direct Read API
@@ -75,14 +330,14 @@ void depth_psi_and_temp(float *depth_psi, float *temp_c);
  *
  * @return raw pressure value in device specific units
  */
-unsigned int depth_raw(void);
+unsigned long depth_raw(void);
 
 /** Read and calculate the temperature compensated calibrated depth in mBar  
  *
  * @return pressure value in mbar
  */
 
-unsigned int temp_raw(void);
+unsigned long temp_raw(void);
 
 //@}
 #endif
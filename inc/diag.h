@@ -0,0 +1,64 @@
+#ifndef __DIAG_H__
+#define __DIAG_H__
+
+/** @file   diag.h
+ *  @brief  Health diagnostics and the $PVRST status sentence
+ *
+ *          The counters live with the code they count (depth.h, uart.h,
+ *          sched.h) and cost an increment each in the acquisition and
+ *          interrupt paths.  Nothing is gathered or formatted until a status
+ *          sentence is asked for, by command or on the status period.
+ *
+ *          Status sentence:
+ *  @code
+    $PVRST,RC,CV,CC,RJ,RE,QO,TN,TA,TX,TD,RX,RD,LE,ID,FS
+    @endcode
+ *          RC   reset cause, MCUCSR at startup (DIAG_RESET_*)
+ *          CV   1 if the calibration words were read, 0 if not
+ *          CC   CRC of the calibration words, see depth_calibration_crc()
+ *          RJ   readings rejected as outliers
+ *          RE   conversions read as all zeros or all ones
+ *          QO   samples dropped because the main loop fell behind the timer
+ *          TN   shortest time between samples in mS since the last sentence
+ *          TA   average time between samples in mS
+ *          TX   longest time between samples in mS since the last sentence
+ *          TD   tether bytes dropped because the transmit buffer was full
+ *          RX   tether bytes received with framing, overrun or parity errors
+ *          RD   tether bytes dropped because the receive buffer was full
+ *          LE   tether status register of the last bad byte since the last
+ *               sentence, 0 if none
+ *          ID   percentage of the time spent asleep
+ *          FS   analog cross-check status, FUSION_STATUS_* of fusion.h
+ *
+ *          The counters count from startup and wrap at 65535, the host
+ *          watches their increments.
+ */
+
+/** @name Reset cause bits, as in MCUCSR */
+//@{
+#define DIAG_RESET_POWER_ON  (1<<0)
+#define DIAG_RESET_EXTERNAL  (1<<1)
+#define DIAG_RESET_BROWN_OUT (1<<2)
+#define DIAG_RESET_WATCHDOG  (1<<3)
+#define DIAG_RESET_JTAG      (1<<4)
+//@}
+
+/** Longest status sentence, with checksum */
+#define DIAG_STATUS_MAX_LEN  104
+
+/** Record and clear the reset cause, must run first in system_init() */
+void diag_init(void);
+
+/** @return Reset cause bits (DIAG_RESET_*) */
+unsigned char diag_reset_cause(void);
+
+/** Gather the counters and write the status sentence
+ *
+ *  Restarts the min/max cycle time window.
+ *
+ *  @param port uart to write to
+ *  @param use_checksum append the NMEA checksum
+ */
+void diag_write_status(int port, char use_checksum);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+/** @file   filter.h
+ *  @brief  Integer depth filter: running median followed by an alpha-beta tracker
+ *
+ *          The median stage removes single sample spikes the outlier reject
+ *          in depth.c lets through.  The alpha-beta stage smooths the depth
+ *          and estimates its rate of change:
+ *  @code
+        predicted = depth + rate * dt
+        residual  = measured - predicted
+        depth     = predicted + alpha * residual
+        rate      = rate + beta * residual / dt
+    @endcode
+ *          alpha and beta are Q8 fractions (256 == 1.0).  A critically damped
+ *          tracker uses beta = alpha^2 / (2 - alpha).  alpha = 256 with
+ *          beta = 0 and a median of 1 passes the input straight through.
+ *
+ *          Depth is reported in mBar/100 and rate in mBar/100 per second.
+ *          Internally both carry FILTER_FRAC_BITS more so slow rates are not
+ *          lost to truncation; all arithmetic fits 32 bits for any depth the
+ *          sensor can measure.
+ */
+
+/** Extra fraction bits of the internal state */
+#define FILTER_FRAC_BITS      4
+
+/** Longest running median supported */
+#define FILTER_MEDIAN_MAX     5
+
+/** Residual (mBar/100) beyond which the tracker restarts from the measurement
+ *  instead of slewing towards it */
+#define FILTER_RESYNC_cmBar   50000L
+/** Longest gap between samples the tracker bridges, it restarts after a
+ *  longer one */
+#define FILTER_MAX_DT_mS      1000
+/** Rate estimate limit (mBar/100 per second), about 10 m/s */
+#define FILTER_MAX_RATE_cmBar_s 100000L
+
+/** @name Defaults, critically damped for alpha = 0.25 */
+//@{
+#define FILTER_DEFAULT_MEDIAN 3
+#define FILTER_DEFAULT_ALPHA  64
+#define FILTER_DEFAULT_BETA   9
+//@}
+
+/** State of one depth filter */
+struct DepthFilter
+{
+    unsigned char median_len;          ///< 1, 3 or 5 samples
+    unsigned char alpha;               ///< Q8, 1 to 255, 0 means 256
+    unsigned char beta;                ///< Q8
+    unsigned char count;               ///< samples in the median window
+    unsigned char next;                ///< median window write index
+    long window[FILTER_MEDIAN_MAX];    ///< last inputs, mBar/100
+    long depth;                        ///< filtered depth, mBar/100 << FILTER_FRAC_BITS
+    long rate;                         ///< filtered rate, mBar/100 per second << FILTER_FRAC_BITS
+};
+
+/** Initialize a filter, invalid settings fall back to the defaults */
+void filter_init(struct DepthFilter *f, unsigned char median_len,
+                 unsigned char alpha, unsigned char beta);
+
+/** Change the filter settings, the filter restarts with the next sample
+ *
+ *  @param median_len 1, 3 or 5
+ *  @param alpha Q8 fraction, 0 stands for 1.0 (no smoothing)
+ *  @param beta Q8 fraction
+ *  @return 1 if the settings were accepted
+ */
+char filter_set(struct DepthFilter *f, unsigned char median_len,
+                unsigned char alpha, unsigned char beta);
+
+/** Forget the history, the next sample initializes the filter */
+void filter_reset(struct DepthFilter *f);
+
+/** Run one sample through the filter
+ *
+ *  @param depth_cmBar measured depth in mBar/100
+ *  @param dt_mS time since the previous sample
+ */
+void filter_update(struct DepthFilter *f, long depth_cmBar, unsigned int dt_mS);
+
+/** @return Filtered depth in mBar/100 */
+long filter_depth_cmBar(const struct DepthFilter *f);
+
+/** @return Filtered rate of change of depth in mBar/100 per second,
+ *          positive when descending */
+long filter_rate_cmBar_s(const struct DepthFilter *f);
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef __FUSION_H__
+#define __FUSION_H__
+
+#include <types.h>
+
+/** @file   fusion.h
+ *  @brief  Cross-check of the depth sensor against the analog pressure
+ *          channel
+ *
+ *          The analog transducer on ADC_PRESSURE is sampled in the
+ *          background (adc.h) about every 7 mS, the depth sensor (depth.h)
+ *          gives a sample every 35 to 70 mS.  The depth sensor is the
+ *          reference: each of its samples is compared with the latest
+ *          analog one and the difference, the bias of the analog channel,
+ *          is tracked with a gain of 1/2^FUSION_BIAS_SHIFT.  Between depth
+ *          sensor samples the fused pressure is the analog pressure plus
+ *          the bias, so the output rate is that of the ADC with the
+ *          accuracy of the depth sensor.
+ *
+ *          The zero and span of the transducer are those of the part
+ *          fitted and must be set with fusion_set_transducer() ($PVRAT).
+ *          Until they are the ADC is not started and the stage stays off,
+ *          flagged with FUSION_STATUS_UNSET.  The span of a part is only
+ *          known to a few percent, so a span correction is tracked along
+ *          with the bias, about the pressure the bias was first set at:
+ *          the difference left on a depth sample at that pressure goes to
+ *          the bias, one more than FUSION_SPAN_RANGE_cmBar away from it is
+ *          divided by the distance and goes to the span with a gain of
+ *          1/2^FUSION_SPAN_SHIFT, and one in between is shared in
+ *          proportion.  An offset drifting while the vehicle stays deep is
+ *          taken up by the span, the fused pressure is right at that depth
+ *          and both are put right again on the way back.
+ *
+ *          A difference more than FUSION_DISAGREE_cmBar away from the bias
+ *          on FUSION_DISAGREE_COUNT depth samples in a row flags a
+ *          disagreement.  The bias is not tracked and the analog samples are
+ *          not used while it lasts, the fused pressure holds the depth
+ *          sensor's.  Which of the two is wrong cannot be told from two
+ *          sensors, the flag is for the host to act on.  An analog reading
+ *          outside the range of the transducer (open or shorted), a bias
+ *          larger than FUSION_BIAS_MAX_cmBar and a span correction beyond
+ *          1/2^FUSION_SPAN_MAX_SHIFT are flagged as well.
+ *
+ *          The first depth sample taken with the analog channel running
+ *          sets the bias outright.  Depth samples are skipped while the
+ *          depth.c outlier filter rejects readings.
+ *
+ *          Fused output sentence (OUTPUT_FORMAT_FUSED, see router.h):
+ *  @code
+    $PVRDX,FF,AA,ST,TS,SQ,AG
+    @endcode
+ *          FF   fused pressure in mBar/100
+ *          AA   analog pressure with the bias and span correction in
+ *               mBar/100, the analog channel on its own
+ *          ST   status bits, FUSION_STATUS_*
+ *          TS   node time in mS the sample was fused at, in the order the
+ *               samples are sent
+ *          SQ   fused sample sequence number
+ *          AG   age in mS of the reading the sample was fused from at TS,
+ *               the analog sample or the pressure read of the depth sensor
+ */
+
+/** @name Cross-check */
+//@{
+#define FUSION_BIAS_SHIFT       4       ///< bias gain 1/16 per depth sample
+#define FUSION_DISAGREE_cmBar   5000L   ///< largest difference accepted (50 mBar)
+#define FUSION_DISAGREE_COUNT   3       ///< depth samples in a row to flag it
+#define FUSION_BIAS_MAX_cmBar   50000L  ///< largest bias of a good transducer
+#define FUSION_SPAN_SHIFT       5       ///< span gain 1/32 per depth sample
+#define FUSION_SPAN_RANGE_cmBar 20000L  ///< distance the span takes all the difference at (200 mBar)
+#define FUSION_SPAN_MAX_SHIFT   4       ///< largest span correction of a good transducer, 1/16
+//@}
+
+/** @name Transducer limits, counts of one 10 bit conversion */
+//@{
+#define FUSION_SPAN_MIN_COUNTS  64      ///< smallest span accepted
+#define FUSION_SCALE_MIN_mBar   1       ///< smallest pressure per count accepted
+#define FUSION_SCALE_MAX_mBar   80      ///< largest pressure per count accepted
+//@}
+
+/** @name Status bits */
+//@{
+#define FUSION_STATUS_UNLOCKED  (1<<0)  ///< off, or no bias yet
+#define FUSION_STATUS_DISAGREE  (1<<1)  ///< analog and depth sensor disagree
+#define FUSION_STATUS_ANALOG    (1<<2)  ///< analog reading out of range
+#define FUSION_STATUS_BIAS      (1<<3)  ///< bias beyond FUSION_BIAS_MAX_cmBar
+#define FUSION_STATUS_UNSET     (1<<4)  ///< transducer zero and span not set
+#define FUSION_STATUS_SPAN      (1<<5)  ///< span correction beyond 1/2^FUSION_SPAN_MAX_SHIFT
+//@}
+
+/** Turn the fusion stage on or off, it is off after reset
+ *
+ *  Turning it on starts the ADC on ADC_PRESSURE, once the transducer is
+ *  set, and clears the bias and the span correction, so it also restarts
+ *  the cross-check after a disagreement.
+ */
+void fusion_enable(char on);
+
+/** @return 1 if the fusion stage is on */
+char fusion_enabled(void);
+
+/** Set the transducer on ADC_PRESSURE, restarts the cross-check
+ *
+ *  @param zero        counts of a conversion at 0 mBar absolute
+ *  @param span_counts counts from zero to span_mBar, 0 to clear the setting
+ *  @param span_mBar   pressure of the span
+ *  @return 0 if the span is under FUSION_SPAN_MIN_COUNTS, ends above 1023
+ *          counts or is not FUSION_SCALE_MIN_mBar to FUSION_SCALE_MAX_mBar
+ *          per count
+ */
+char fusion_set_transducer(uint16_t zero, uint16_t span_counts, uint16_t span_mBar);
+
+/** @name Transducer set, all 0 while unset */
+//@{
+uint16_t fusion_transducer_zero(void);
+uint16_t fusion_transducer_span(void);
+uint16_t fusion_transducer_span_mBar(void);
+//@}
+
+/** Collect the latest analog sample and cross-check new depth samples,
+ *  call on every pass of the main loop
+ *
+ *  @param new_sample return value of depth_acq()
+ *  @return 1 if a new fused sample was produced
+ */
+char fusion_acq(char new_sample);
+
+/** @return Fused pressure in mBar/100 */
+long fusion_cmBar(void);
+
+/** @return Analog pressure with the bias and span correction applied, in
+ *          mBar/100 */
+long fusion_analog_cmBar(void);
+
+/** @return Tracked bias of the analog channel in mBar/100, depth sensor
+ *          minus analog */
+long fusion_bias_cmBar(void);
+
+/** @return Tracked span correction of the analog channel in 0.01 % of the
+ *          set span, positive when the transducer reads low */
+int fusion_span_correction(void);
+
+/** @return Status bits, FUSION_STATUS_* */
+unsigned char fusion_status(void);
+
+/** @return Number of disagreements flagged since startup */
+unsigned int fusion_disagree_count(void);
+
+/** @return System time the last fused sample was produced at, the order
+ *          the samples come in */
+unsigned long fusion_sample_time(void);
+
+/** @return System ticks from the reading the last fused sample was made
+ *          from to fusion_sample_time() */
+unsigned long fusion_sample_age(void);
+
+/** @return Incremented with every fused sample */
+unsigned int fusion_sample_seq(void);
+
+#endif
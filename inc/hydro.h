@@ -0,0 +1,75 @@
+#ifndef __HYDRO_H__
+#define __HYDRO_H__
+
+/** @file   hydro.h
+ *  @brief  Pressure to depth conversion
+ *
+ *          Depth is the gauge pressure (absolute pressure less the surface
+ *          reference, see depth_gauge_cmBar()) divided by the weight of the
+ *          water column:
+ *  @code
+        depth = P / (rho * g(latitude))
+    @endcode
+ *          with a configurable fluid density rho and the normal gravity of
+ *          the UNESCO 1983 depth formula:
+ *  @code
+        g = 9.780318 * (1 + 5.2788e-3 * sin^2(lat) + 2.36e-5 * sin^4(lat))
+    @endcode
+ *          The small pressure term of the UNESCO gravity (1.092e-6 per dbar)
+ *          and the compressibility of the water are neglected, below 2e-5 of
+ *          the depth over the sensor range.  For open ocean water the UNESCO
+ *          formula corresponds to a density of about 1028 kg/m^3; with that
+ *          density both agree within 0.05% down to 140 m.
+ *
+ *          All integer: 1 mBar/100 is 1 Pa, and the divide is replaced by a
+ *          multiply with a 32 bit reciprocal that is only recomputed when the
+ *          density or the latitude change.
+ */
+
+/** @name Fluid density presets, kg/m^3 */
+//@{
+#define HYDRO_DENSITY_FRESH   1000
+#define HYDRO_DENSITY_SALT    1025
+//@}
+
+/** Range of densities accepted */
+#define HYDRO_DENSITY_MIN     900
+#define HYDRO_DENSITY_MAX     1100
+
+/** Latitude used until one is set, degrees */
+#define HYDRO_LATITUDE_DEFAULT 45
+
+/** Set the defaults, fresh water at HYDRO_LATITUDE_DEFAULT */
+void hydro_init(void);
+
+/** Set the density of the water column
+ *
+ *  @param kgm3 density in kg/m^3, HYDRO_DENSITY_MIN to HYDRO_DENSITY_MAX
+ *  @return 1 if accepted
+ */
+char hydro_set_density(unsigned int kgm3);
+
+/** @return Density of the water column in kg/m^3 */
+unsigned int hydro_density(void);
+
+/** Set the latitude for the gravity
+ *
+ *  @param deg latitude in degrees, -90 to 90
+ *  @return 1 if accepted
+ */
+char hydro_set_latitude(signed char deg);
+
+/** @return Latitude in degrees */
+signed char hydro_latitude(void);
+
+/** @return Gravity at the set latitude in 1e-5 m/s^2 */
+unsigned long hydro_gravity(void);
+
+/** Convert a gauge pressure to depth
+ *
+ *  @param gauge_Pa pressure above the surface in Pa (mBar/100)
+ *  @return depth in mm, negative above the surface
+ */
+long hydro_depth_mm(long gauge_Pa);
+
+#endif
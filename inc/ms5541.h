@@ -0,0 +1,253 @@
+#ifndef __MS5541_H__
+#define __MS5541_H__
+
+/** @file   ms5541.h
+ *  @brief  Intersema MS5541 pressure sensor driver, see sensor.h
+ *
+ *          The sensor is read over the SPI port using the 3-wire Intersema
+ *          protocol.  The 16-bit commands are clocked out with data setup on
+ *          the leading edge, results are clocked in on the trailing edge.
+ *
+ *          Compensation is done entirely in integer arithmetic following the
+ *          datasheet algorithm.  With the calibration words 0x5784 0xE21F
+ *          0x4B10 0x7D32 (C1-C6 = 2800, 5000, 300, 250, 2000, 50), D1 15465
+ *          and D2 26000 compensate to 1999 mBar at 20.0 deg C, the defaults
+ *          of the host simulation.
+ *
+ *          Only to be included through sensor.h.
+ */
+
+#include <spi.h>
+
+#include <util/delay.h>
+
+//@{
+/** @name Sensor commands */
+#define MS5535_CMD_D1       0x0F40  ///< start pressure conversion
+#define MS5535_CMD_D2       0x0F20  ///< start temperature conversion
+#define MS5535_CMD_W1       0x1D50  ///< read calibration word 1
+#define MS5535_CMD_W2       0x1D60  ///< read calibration word 2
+#define MS5535_CMD_W3       0x1D90  ///< read calibration word 3
+#define MS5535_CMD_W4       0x1DA0  ///< read calibration word 4
+//@}
+
+/** Sensor adc conversion time per channel */
+#define SENSOR_CONVERSION_mS 35
+
+/** Calibration words W1-W4 */
+#define SENSOR_CAL_WORDS     4
+
+#define SENSOR_RAW_BITS      16
+typedef uint16_t sensor_raw_t;
+
+/** A stuck data line reads all zeros or all ones */
+#define SENSOR_RAW_VALID(d)  ((d) != 0 && (d) != 0xFFFF)
+
+/** Calibration coefficients C1-C6 as extracted from the calibration words */
+typedef struct InterSema_calibration_data_t {
+    int c[6];
+} InterSema_calibration_data;
+
+typedef InterSema_calibration_data SensorCalibration;
+
+static inline void MS5535_calculate_calibration_coefficents(InterSema_calibration_data *caldata,
+                                                             uint16_t w1, uint16_t w2,
+                                                             uint16_t w3, uint16_t w4) {
+    caldata->c[0] = w1 >> 3;
+    caldata->c[1] = ((w1 & 0x0007) << 10) | (w2 >> 6);
+    caldata->c[2] = w3 >> 6;
+    caldata->c[3] = w4 >> 7;
+    caldata->c[4] = ((w2 & 0x003F) << 6) | (w3 & 0x003F);
+    caldata->c[5] = w4 & 0x007F;
+}
+
+/** Datasheet integer compensation
+ *
+ *  All intermediate terms fit in 32 bits for the full 16-bit D1/D2 range,
+ *  the right shifts are the datasheet's divisions by powers of two.
+ *
+ *  @param pressure compensated pressure in mBar, may be 0 if not needed
+ *  @param temperature compensated temperature in deg C/10, may be 0 if not needed
+ */
+static inline void sensor_compensate(const SensorCalibration *cal,
+                                     long *pressure, long *temperature,
+                                     sensor_raw_t d1, sensor_raw_t d2) {
+    long dt = (long)d2 - (8L * cal->c[4] + 10000);
+
+    if (pressure) {
+        long off  = cal->c[1] + ((((long)cal->c[3] - 250) * dt) >> 12) + 10000;
+        long sens = (cal->c[0] >> 1) + ((((long)cal->c[2] + 200) * dt) >> 13) + 3000;
+        *pressure = ((sens * ((long)d1 - off)) >> 11) + 1000;
+    }
+
+    if (temperature) {
+        *temperature = 200 + ((dt * ((long)cal->c[5] + 100)) >> 11);
+    }
+}
+
+/** Compensated pressure from a fractional D1, as produced by oversampling
+ *
+ *  Same algorithm as sensor_compensate() but D1 carries 8 fraction bits and
+ *  the result is in mBar/100.  sens * (D1 - off) no longer fits 32 bits
+ *  with the fraction, so the product is split on the fraction bits:
+ *  with diff = hi * 256 + lo and a = sens * hi,
+ *  (a * 256 + sens * lo) >> 11 == (a >> 3) + (((a & 7) << 8) + sens * lo) >> 11
+ *  which is exact and keeps every term within 32 bits.
+ *
+ *  @param d1_q8 pressure datum << 8
+ *  @return compensated pressure in mBar/100
+ */
+static inline long sensor_compensate_fine(const SensorCalibration *cal,
+                                          unsigned long d1_q8, sensor_raw_t d2) {
+    long dt = (long)d2 - (8L * cal->c[4] + 10000);
+    long off  = cal->c[1] + ((((long)cal->c[3] - 250) * dt) >> 12) + 10000;
+    long sens = (cal->c[0] >> 1) + ((((long)cal->c[2] + 200) * dt) >> 13) + 3000;
+    long diff = (long)d1_q8 - (off << 8);
+    long a = sens * (diff >> 8);
+    long p_q8 = (a >> 3) + ((((a & 7) << 8) + sens * (diff & 0xFF)) >> 11);
+
+    return (p_q8 >> 8) * 100 + (((p_q8 & 0xFF) * 100) >> 8) + 100000L;
+}
+
+/** @name Blocking access, start up and direct reads only */
+//@{
+static inline uint16_t MS5535_read_word(void) {
+    uint16_t msb, lsb;
+
+    DEPTH_ENABLE_PORT |= DEPTH_ENABLE;
+    msb = (unsigned char)spi_read(DEPTH_PORT);
+    lsb = (unsigned char)spi_read(DEPTH_PORT);
+    DEPTH_ENABLE_PORT &= ~DEPTH_ENABLE;
+
+    return (msb << 8) | lsb;
+}
+
+static inline void MS5535_send_command(uint16_t cmd) {
+    spi_set_clock_phase(DEPTH_PORT, SPI_CLK_PHASE_SAMPLE_LEADING);
+    DEPTH_ENABLE_PORT |= DEPTH_ENABLE;
+    spi_write(DEPTH_PORT, cmd >> 8);
+    spi_write(DEPTH_PORT, cmd & 0xFF);
+    DEPTH_ENABLE_PORT &= ~DEPTH_ENABLE;
+    spi_set_clock_phase(DEPTH_PORT, SPI_CLK_PHASE_SAMPLE_TRAILING);
+}
+
+static inline void MS5535_reset(void) {
+    spi_set_clock_phase(DEPTH_PORT, SPI_CLK_PHASE_SAMPLE_LEADING);
+    DEPTH_ENABLE_PORT |= DEPTH_ENABLE;
+    spi_write(DEPTH_PORT, 0x15);
+    spi_write(DEPTH_PORT, 0x55);
+    spi_write(DEPTH_PORT, 0x40);
+    DEPTH_ENABLE_PORT &= ~DEPTH_ENABLE;
+}
+
+/** Reset the sensor and read the four calibration words
+ *
+ *  Each word is read repeatedly until the same non-trivial value has been seen
+ *  GOOD_COUNT_LIMIT times in a row.  If that does not happen within
+ *  TOTAL_COUNT_LIMIT reads the word is zeroed and the read fails.
+ *
+ *  @return 0 if a word could not be read
+ */
+static inline char sensor_init(SensorCalibration *cal, uint16_t word[SENSOR_CAL_WORDS]) {
+    const int GOOD_COUNT_LIMIT = 10;
+    const int TOTAL_COUNT_LIMIT = 100;
+    const uint16_t cmd[4] = {MS5535_CMD_W1, MS5535_CMD_W2, MS5535_CMD_W3, MS5535_CMD_W4};
+    uint16_t last_read, current_read;
+    int good_count, total_count;
+    char ok = 1;
+    int i;
+
+    DEPTH_ENABLE_PORT_DIR |= DEPTH_ENABLE;
+    DEPTH_ENABLE_PORT |= DEPTH_ENABLE;
+
+    MS5535_reset();
+
+    for (i = 0; i < 4; i++) {
+        last_read = 0;
+        good_count = 0;
+        total_count = 0;
+        do {
+            MS5535_send_command(cmd[i]);
+            current_read = MS5535_read_word();
+            if (current_read != 0 && current_read != 0xFFFF) {
+                if (current_read == last_read) {
+                    good_count++;
+                } else {
+                    last_read = current_read;
+                    good_count = 0;
+                }
+            }
+            total_count++;
+        } while (good_count < GOOD_COUNT_LIMIT && total_count < TOTAL_COUNT_LIMIT);
+
+        if (good_count >= GOOD_COUNT_LIMIT && total_count < TOTAL_COUNT_LIMIT) {
+            word[i] = current_read;
+        } else {
+            word[i] = 0;
+            ok = 0;
+        }
+    }
+
+    MS5535_calculate_calibration_coefficents(cal, word[0], word[1], word[2], word[3]);
+    return ok;
+}
+
+static inline sensor_raw_t sensor_read_blocking(unsigned char channel) {
+    MS5535_send_command(channel == SENSOR_PRESSURE ? MS5535_CMD_D1 : MS5535_CMD_D2);
+    _delay_ms(SENSOR_CONVERSION_mS);
+    return MS5535_read_word();
+}
+//@}
+
+/** @name Background access, a read chained with the next command */
+//@{
+static void ms5541_spi_done(struct SpiTransfer *t);
+
+static char ms5541_word[2];
+static char ms5541_cmd[2];
+static volatile char ms5541_pending;    ///< chain in progress
+static char ms5541_reading;             ///< the chain started with a read
+
+static struct SpiTransfer ms5541_command = {
+    ms5541_cmd, 0, 2, SPI_CLK_RISING, SPI_CLK_PHASE_SAMPLE_LEADING,
+    &DEPTH_ENABLE_PORT, DEPTH_ENABLE, ms5541_spi_done, 0
+};
+static struct SpiTransfer ms5541_read = {
+    0, ms5541_word, 2, SPI_CLK_RISING, SPI_CLK_PHASE_SAMPLE_TRAILING,
+    &DEPTH_ENABLE_PORT, DEPTH_ENABLE, 0, &ms5541_command
+};
+
+/** End of a chain, runs in the SPI interrupt */
+static void ms5541_spi_done(struct SpiTransfer *t) {
+    (void)t;
+    ms5541_pending = 0;
+    depth_sensor_done(ms5541_reading);
+}
+
+static inline char sensor_start(char read, unsigned char channel) {
+    uint16_t cmd = channel == SENSOR_PRESSURE ? MS5535_CMD_D1 : MS5535_CMD_D2;
+
+    if (ms5541_pending) {
+        return 0;
+    }
+    ms5541_cmd[0] = cmd >> 8;
+    ms5541_cmd[1] = cmd & 0xFF;
+    ms5541_reading = read;
+    ms5541_pending = 1;
+    if (!spi_transfer_start(DEPTH_PORT, read ? &ms5541_read : &ms5541_command)) {
+        ms5541_pending = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static inline char sensor_busy(void) {
+    return ms5541_pending;
+}
+
+static inline sensor_raw_t sensor_result(void) {
+    return ((uint16_t)(unsigned char)ms5541_word[0] << 8) | (unsigned char)ms5541_word[1];
+}
+//@}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __NMEA_H__
+#define __NMEA_H__
+
+/** @file   nmea.h
+ *  @brief  Allocation free NMEA style sentence encoder
+ *
+ *          Sentences are built field by field directly in space reserved in
+ *          the uart transmit buffer, so there is no intermediate buffer, no
+ *          copy, no printf and no strlen pass.  The optional NMEA checksum
+ *          (*XX) is accumulated as the bytes are written.  The sentence is
+ *          committed for transmission by nmea_end(), or in two parts when it
+ *          wraps around the end of the transmit buffer.
+ *
+ *          Only one sentence per port may be in progress at a time.  Check
+ *          uart_tx_free() first to avoid sentences cut short by a full
+ *          buffer.
+ *
+ *          nmea_begin_buf() encodes into memory instead, for a sentence that
+ *          is sent out more than one port.
+ *
+ * @code Example:
+         struct NmeaSentence s;
+         nmea_begin(&s, COMM_PORT_TETHER, "PVRDT", 0);
+         nmea_field_int(&s, depth_mBar());
+         nmea_field_int(&s, water_temp_cC());
+         nmea_end(&s);
+   @endcode
+ */
+
+/** State of a sentence being encoded */
+struct NmeaSentence
+{
+    int port;                ///< uart the sentence is written to, NMEA_PORT_NONE for memory
+    unsigned char checksum;  ///< running xor of the bytes after the '$'
+    char use_checksum;       ///< append *XX before the line terminator
+    unsigned char len;       ///< bytes queued so far
+    unsigned char dropped;   ///< bytes the uart could not accept
+    char *buf;               ///< next free byte of the reserved span
+    unsigned char room;      ///< bytes left in the reserved span
+    unsigned char pending;   ///< bytes written but not yet committed
+};
+
+/** struct NmeaSentence port of a sentence encoded into memory */
+#define NMEA_PORT_NONE  (-1)
+
+/** Start a sentence, writes the '$' and the talker/sentence id
+ *
+ *  @param s sentence state
+ *  @param port uart to write to
+ *  @param id talker and sentence id, e.g. "PVRDT"
+ *  @param use_checksum set to 1 to terminate the sentence with *XX
+ */
+void nmea_begin(struct NmeaSentence *s, int port, const char *id, char use_checksum);
+
+/** Start a sentence in memory, otherwise as nmea_begin()
+ *
+ *  Bytes beyond size are dropped.
+ *
+ *  @param s sentence state
+ *  @param buf where to write the sentence, not null terminated
+ *  @param size bytes available at buf, at most 255
+ *  @param id talker and sentence id
+ *  @param use_checksum set to 1 to terminate the sentence with *XX
+ */
+void nmea_begin_buf(struct NmeaSentence *s, char *buf, unsigned char size,
+                    const char *id, char use_checksum);
+
+/** Write a single character */
+void nmea_putc(struct NmeaSentence *s, char c);
+
+/** Write a string, not including the terminating null */
+void nmea_puts(struct NmeaSentence *s, const char *str);
+
+/** Write a signed integer in decimal, without a field separator */
+void nmea_int(struct NmeaSentence *s, long value);
+
+/** Write a field separator followed by a signed decimal integer */
+void nmea_field_int(struct NmeaSentence *s, long value);
+
+/** Finish the sentence, writes the optional checksum and "\r\n"
+ *
+ *  @return number of bytes in the sentence
+ */
+int nmea_end(struct NmeaSentence *s);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+/** @file   output.h
+ *  @brief  Output scheduler, decides when a sample is published
+ *
+ *          Publishing can be driven by the acquisition itself (every new
+ *          sample), by time (fixed period) or by the data (depth changed by
+ *          more than a threshold).  Each output owns a struct OutputSchedule
+ *          so several outputs can run independent schedules.
+ */
+
+/** @name Scheduling modes */
+//@{
+#define OUTPUT_MODE_SAMPLE    0  ///< publish every new sample
+#define OUTPUT_MODE_PERIODIC  1  ///< publish every period_mS
+#define OUTPUT_MODE_CHANGE    2  ///< publish when depth moved by threshold_mBar,
+                                 ///< or at least every period_mS as a heartbeat
+//@}
+
+/** Shortest period accepted by the scheduler */
+#define OUTPUT_MIN_PERIOD_mS  10
+
+/** State of one output schedule */
+struct OutputSchedule
+{
+    char mode;                    ///< OUTPUT_MODE_*
+    unsigned int period_mS;       ///< output (or heartbeat) period
+    unsigned int threshold_mBar;  ///< change needed in OUTPUT_MODE_CHANGE
+    unsigned long last_time;      ///< system time of the last output
+    unsigned int last_mBar;       ///< depth at the last output
+};
+
+/** Initialize a schedule
+ *
+ *  @param sched schedule to initialize
+ *  @param mode OUTPUT_MODE_*
+ *  @param period_mS output period, heartbeat period in OUTPUT_MODE_CHANGE
+ *  @param threshold_mBar depth change that triggers an output in OUTPUT_MODE_CHANGE
+ */
+void output_sched_init(struct OutputSchedule *sched, char mode,
+                       unsigned int period_mS, unsigned int threshold_mBar);
+
+/** Change the settings of a running schedule
+ *
+ *  @return 1 if the settings were accepted, 0 if they were out of range
+ */
+char output_sched_set(struct OutputSchedule *sched, char mode,
+                      unsigned int period_mS, unsigned int threshold_mBar);
+
+/** Check if an output is due, must be called on every pass of the main loop
+ *
+ *  When 1 is returned the schedule assumes the output is made.
+ *
+ *  @param sched schedule to check
+ *  @param new_sample return value of depth_acq()
+ *  @param depth_mBar current depth
+ *  @param now current system time (get_time())
+ *  @return 1 if the sample should be published
+ */
+char output_sched_due(struct OutputSchedule *sched, char new_sample,
+                      unsigned int depth_mBar, unsigned long now);
+
+#endif
@@ -21,7 +21,8 @@
 /* For reference:
  *  Timer 0 is used for PWM control of lights.
  *  Timer 1 is used to drive the servos via a decade counter
- *  Timer 2 & 3 are currently not used 
+ *  Timer 2 drives the system clock (sysclk)
+ *  Timer 3 output compare A paces the depth sensor acquisition
  */
  
 /* Various IO Port defines used by the lower level drivers */
@@ -30,6 +31,10 @@
 #define UART_RS485_TXE_PORT_DIR DDRA
 #define UART_0_RS485_TXE_MASK (1<<1)
 #define UART_1_RS485_TXE_MASK (1<<0)
+#define UART_RS485_RXE_PORT PORTA
+#define UART_RS485_RXE_PORT_DIR DDRA
+#define UART_1_RS485_RS232_SW (1<<2) //Device RS-485/RS-232 Switch (1=RS485,0=RS232)
+#define UART_1_RS485_RXE_MASK (1<<3) //Device RS-485 Receive Enable
 
 #define LIGHTS_PORT     PORTB
 #define LIGHTS_PORT_DIR DDRB
@@ -67,6 +72,9 @@
 #define DEPTH_ENABLE_PORT_DIR DDRE
 #define DEPTH_ENABLE          (1<<2)
 
+/* Pressure sensor driver on DEPTH_PORT, see sensor.h */
+#define DEPTH_SENSOR_MS5541
+
 /* Predefined SERVO Channels */
 #define SERVO_THRUSTER_PORT      0
 #define SERVO_THRUSTER_STARBOARD 1
@@ -86,6 +94,9 @@
 #define ADC_TEMP_POWER     5  
 #define ADC_PRESSURE       6
 
+/* ADC_PRESSURE transducer, ratiometric on AVCC.  Its zero and span depend
+   on the part fitted and are set with $PVRAT, see fusion_set_transducer() */
+
 
 
 #define COMM_PORT_TETHER     0
@@ -97,6 +108,11 @@
 
 #define HARDWARE_CONFIG_ADDR		((char*) 0x20)
 
+/* Eeprom area of the persistent configuration journal (config.h), clear of
+ * the hardware config */
+#define CONFIG_JOURNAL_ADDR		((char*) 0x200)
+#define CONFIG_JOURNAL_LEN		0x400
+
 /** get the device hardware configuration data
  *  @param buf buffer for data
  *  @field data field to read
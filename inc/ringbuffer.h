@@ -2,52 +2,106 @@
 #define __RINGBUFFER_H__
 
 /** @file   ringbuffer.h
- *  @brief  Support for arbitrary size ringbuffers
+ *  @brief  Lock free single producer, single consumer byte ringbuffers
+ *
+ *          The storage size must be a power of 2, up to RINGBUF_MAX_SIZE, so
+ *          indices wrap with a mask.  One byte of storage is kept free to
+ *          tell a full buffer from an empty one, a 256 byte buffer holds 255.
+ *
+ *          The producer only ever writes head and the consumer only ever
+ *          writes tail.  Both are single bytes, so reads and writes of them
+ *          are atomic on the AVR and neither side has to disable interrupts,
+ *          as long as there is exactly one producer (e.g. the main loop for a
+ *          transmit buffer) and one consumer (e.g. the uart interrupt).
  */
 
-/** Stucture supporting ring byte buffers 
+/** Largest supported storage size */
+#define RINGBUF_MAX_SIZE 256
+
+/** Stucture supporting ring byte buffers
 */
 struct RingBuffer
 {
-    char *buf;          ///< pointer to data storage
-    unsigned int size;  ///< size of data storage
-    volatile unsigned int cnt;   ///< count of bytes in buffer
-    volatile unsigned int rp;    ///< read pointer  (index)
-    volatile unsigned int wp;    ///< write pointer (index) 
+    char *buf;                    ///< pointer to data storage
+    unsigned char mask;           ///< size of data storage - 1
+    volatile unsigned char head;  ///< write index, only changed by the producer
+    volatile unsigned char tail;  ///< read index, only changed by the consumer
 };
 /** Initialize a ring buffer
- *  
+ *
  *  This function will initialize the various fields of the struct RingBuffer.
+ *  Neither side may use the buffer while it is initialized.
  *
  *  @param rb pointer to ringbuffer to initialize
  *  @param buf pointer to the storage buffer the ringbuffer should use
- *  @param size of the storage buffer (buf)  
+ *  @param size of the storage buffer (buf), a power of 2 up to
+ *         RINGBUF_MAX_SIZE
  */
 void ringbuf_init(struct RingBuffer *rb, char *buf, int size);
-/** Flush a ring buffer */
+
+/** Flush a ring buffer, consumer side only */
 void ringbuf_flush(struct RingBuffer *rb);
 
 /** @return Number of bytes in buffer */
 unsigned int ringbuf_cnt(struct RingBuffer *rb);
 
+/** @return Number of bytes that can still be put into the buffer */
+unsigned int ringbuf_free(struct RingBuffer *rb);
+
 /** @return True if no space left in buffer */
 int ringbuf_full(struct RingBuffer *rb);
 
 /** @return True if buffer is empty */
 int ringbuf_empty(struct RingBuffer *rb);
 
-/** @return A byte out of the buffer */
+//@{
+/** @name Consumer side */
+
+/** @return A byte out of the buffer, 0 if the buffer is empty */
 unsigned char ringbuf_get(struct RingBuffer *rb);
 
+/** Get up to cnt bytes out of the buffer
+ *
+ *  Copies at most two contiguous spans and moves the tail once.
+ *
+ *  @return number of bytes copied to b
+ */
+unsigned int ringbuf_get_block(struct RingBuffer *rb, char *b, unsigned int cnt);
+//@}
+
+//@{
+/** @name Producer side */
+
 /** Put a byte into the buffer
  *  @return False if buffer is full
  */
 int ringbuf_put(struct RingBuffer *rb, unsigned char b);
 
-/** Put bytes directly into the buffer, not checking for overruns or overwrites
+/** Put up to cnt bytes into the buffer
+ *
+ *  Copies at most two contiguous spans and moves the head once, so the
+ *  consumer sees either none or all of the bytes.  Bytes that do not fit
+ *  are not queued.
+ *
+ *  @return number of bytes queued
+ */
+unsigned int ringbuf_put_block(struct RingBuffer *rb, const char *b, unsigned int cnt);
+
+/** Get the contiguous free space at the head, to be filled in place
+ *
+ *  Nothing is visible to the consumer until ringbuf_commit().  More space
+ *  may be free past the end of the storage, reserve again after committing.
+ *
+ *  @param len set to the number of bytes that may be written
+ *  @return where the next byte goes
  */
-void ringbuf_put_direct(struct RingBuffer *rb, char *b, int cnt);
+char *ringbuf_reserve(struct RingBuffer *rb, unsigned int *len);
 
+/** Publish cnt bytes written to the span from ringbuf_reserve()
+ *
+ *  @param cnt bytes written, no more than the reserved length
+ */
+void ringbuf_commit(struct RingBuffer *rb, unsigned int cnt);
 //@}
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,107 @@
+#ifndef __ROUTER_H__
+#define __ROUTER_H__
+
+#include <output.h>
+#include <uart.h>
+
+/** @file   router.h
+ *  @brief  Sample output to several uarts
+ *
+ *          Each uart is an output port with its own schedule (output.h),
+ *          format, checksum, baudrate and RS-485/RS-232 mode.  When a new
+ *          sample is due on more than one port, it is encoded once for
+ *          each distinct format and checksum combination.  That encoding is
+ *          then copied to every port that wants it.
+ *
+ *          ASCII output is the $PVRDT sentence:
+ *  @code
+    $PVRDT,DD, TT,MM,TS,SQ
+    @endcode
+ *          DD is the pressure in mBar and TT the temperature in degree C/100.
+ *          MM is the depth below the surface reference in mm (hydro.h).
+ *          TS is the node time in mS at which the pressure conversion
+ *          completed, and SQ the sample sequence number (depth_sample_seq()).
+ *          When the filtered output is on, it is followed by:
+ *  @code
+    $PVRDF,FF,RR,SQ
+    @endcode
+ *          FF is the filtered depth in mBar/100 and RR the depth rate in
+ *          mBar/100 per second, positive descending.  Binary output is the
+ *          telemetry frames of telemetry.h.
+ *
+ *          Raw capture (OUTPUT_FORMAT_RAW) ignores the schedule and sends
+ *          every conversion as it is read, with a setup frame when the
+ *          capture starts and every TELEMETRY_SETUP_INTERVAL conversions.  A
+ *          conversion is skipped while the port has no room, which shows as
+ *          a gap in the sequence numbers.  sim/replay.cpp feeds a capture
+ *          back through the firmware.
+ *
+ *          Fused output (OUTPUT_FORMAT_FUSED) is the $PVRDX sentence of
+ *          fusion.h.  It follows the schedule with the fused samples, which
+ *          come at the ADC rate, as the new samples.  The fusion stage must be
+ *          on ($PVRFU) with its transducer set ($PVRAT), otherwise the last
+ *          fused sample is repeated.
+ */
+
+/** Worst case bytes per output, the $PVRDT and $PVRDF sentences with
+ *  checksums.  A port is skipped while it has less room, so its next output
+ *  carries the latest sample instead of a sentence cut short. */
+#define ROUTER_MAX_LEN  96
+
+/** Settings of one output port */
+struct RouterPort
+{
+    char enabled;               ///< samples are published on this port
+    char format;                ///< OUTPUT_FORMAT_*
+    char checksum;              ///< NMEA checksum on sentences
+    char rs485;                 ///< RS-485 (1) or RS-232 (0), see uart_enable_rs485()
+    unsigned long baudrate;     ///< see router_set_baudrate()
+    char baudrate_pending;      ///< baudrate waits for the port to go idle
+    struct OutputSchedule schedule;
+    char last_format;           ///< format of the last output, restarts raw capture
+    uint16_t raw_seq;           ///< conversion of the last raw frame sent, or
+                                ///< the last fused sample seen
+    unsigned int setup_countdown; ///< raw frames until the next setup frame
+};
+
+/** The ports, indexed by uart id.  Settings may be changed directly
+ *  between calls to router_publish(), except for rs485 and baudrate. */
+extern struct RouterPort router_ports[MAX_UARTS];
+
+/** Follow every ASCII sentence with $PVRDF, every binary depth frame with a
+ *  filter frame, on all ports */
+extern char router_filtered;
+
+/** Set the defaults: the tether on, ASCII every 500 mS, the accessory off */
+void router_init(void);
+
+/** Apply the baudrates and RS-485 modes to the uarts, once settings are
+ *  loaded */
+void router_start(void);
+
+/** Switch a port between RS-485 and RS-232 */
+void router_set_rs485(int port, char on);
+
+/** Change the baudrate of a port
+ *
+ *  The change is made by router_service() once everything queued on the
+ *  port has been sent, so an acknowledgement goes out at the old rate.
+ *
+ *  @return 0 if the baudrate is not supported
+ */
+char router_set_baudrate(int port, unsigned long baudrate);
+
+/** @return 1 if the baudrate is supported */
+char router_baudrate_valid(unsigned long baudrate);
+
+/** Apply pending baudrate changes, call on every pass of the main loop */
+void router_service(void);
+
+/** Publish the latest sample on every port it is due on
+ *
+ *  @param new_sample return value of depth_acq()
+ *  @param now current system time (get_time())
+ */
+void router_publish(char new_sample, unsigned long now);
+
+#endif
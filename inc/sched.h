@@ -0,0 +1,41 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+/** @file   sched.h
+ *  @brief  Main loop idle handling and cpu load accounting
+ *
+ *          Instead of spinning, the main loop calls sched_idle() once it has
+ *          serviced everything.  The cpu is put in the AVR idle sleep mode
+ *          until the next interrupt: the 1 mS sysclk tick, a uart byte or the
+ *          depth acquisition timer.  While the background ADC (adc.h) runs, its
+ *          conversions are slept through until a decimated sample is ready,
+ *          so they do not run the main loop thousands of times a second.
+ *          The watchdog is serviced here, so a loop
+ *          that stops reaching sched_idle() still resets the part.
+ *
+ *          The time spent asleep is measured with the system clock and
+ *          reported as an idle/busy percentage over SCHED_LOAD_WINDOW_mS.
+ */
+
+/** Length of the load measurement window */
+#define SCHED_LOAD_WINDOW_mS  1000
+
+/** Start the load accounting */
+void sched_init(void);
+
+/** Service the watchdog and sleep until an interrupt, unless work is pending
+ *
+ *  Pending work (a queued depth sample, an ADC sample or received tether
+ *  bytes) is checked with interrupts disabled and the sleep is entered
+ *  atomically, so an event arriving in between cannot be missed until the
+ *  next tick.
+ */
+void sched_idle(void);
+
+/** @return Percentage of the last window spent asleep, 0 to 100 */
+unsigned char sched_idle_percent(void);
+
+/** @return Percentage of the last window spent running, 0 to 100 */
+unsigned char sched_busy_percent(void);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __SENSOR_H__
+#define __SENSOR_H__
+
+/** @file   sensor.h
+ *  @brief  Pressure sensor driver interface
+ *
+ *          depth.c runs the acquisition, oversampling, outlier rejection and
+ *          filtering for any pressure sensor, the driver selected by the
+ *          platform header (DEPTH_SENSOR_* in pro4.h) talks to the part and
+ *          compensates its readings.  The driver is a header of static
+ *          inline functions included only by depth.c, so the sample path
+ *          compiles to direct, inlined code with no function pointers.
+ *
+ *          A driver provides:
+ *  @code
+    SENSOR_CONVERSION_mS   conversion time of one channel
+    SENSOR_CAL_WORDS       16 bit calibration words exported
+    SENSOR_RAW_BITS        bits of a raw conversion
+    sensor_raw_t           unsigned type holding a raw conversion
+    SENSOR_RAW_VALID(d)    0 if a raw value shows a stuck data line
+    SensorCalibration      compensation coefficients
+
+    char sensor_init(SensorCalibration *cal, uint16_t word[SENSOR_CAL_WORDS])
+        reset the part and read its calibration, blocking, 0 on failure
+    sensor_raw_t sensor_read_blocking(unsigned char channel)
+        convert and read a channel, blocking
+    char sensor_start(char read, unsigned char channel)
+        in the background, read the finished conversion if read is set and
+        start a conversion of channel, 0 if still busy.  The driver calls
+        depth_sensor_done(read) from the interrupt when done.
+    char sensor_busy(void)
+    sensor_raw_t sensor_result(void)
+        conversion read by the last sensor_start()
+    void sensor_compensate(cal, long *mBar, long *temp_dC, d1, d2)
+        pressure in mBar and temperature in deg C/10, either may be 0
+    long sensor_compensate_fine(cal, unsigned long d1_q8, d2)
+        pressure in mBar/100 from a pressure datum with 8 fraction bits
+    @endcode
+ *
+ *          depth.c sums DEPTH_OVERSAMPLE_MAX conversions and keeps their
+ *          mean with 8 fraction bits in an unsigned long, and the raw
+ *          capture (telemetry.h) carries DEPTH_RAW_BITS_MAX bits per
+ *          conversion and DEPTH_CAL_WORDS_MAX calibration words, so those
+ *          bound SENSOR_RAW_BITS and SENSOR_CAL_WORDS.  depth.c checks them
+ *          at compile time.
+ *
+ *          Each driver comes with compensation vectors for the host tests,
+ *          host/test/<driver>_vectors.h, see host/test/sensor_vectors.c.
+ */
+
+#include <device.h>
+
+/** @name Conversion channels */
+//@{
+#define SENSOR_PRESSURE 0   ///< D1
+#define SENSOR_TEMP     1   ///< D2
+//@}
+
+/** Completion of sensor_start(), defined by the includer (depth.c)
+ *
+ *  @param read 1 if the chain read a conversion, see sensor_result()
+ */
+static void depth_sensor_done(char read);
+
+#if defined(DEPTH_SENSOR_MS5541)
+#include <ms5541.h>
+#else
+#error "The platform must select a depth sensor driver!"
+#endif
+
+#endif
@@ -6,9 +6,14 @@
  *
  *          Handles control of SPI port 
  *
- *          Currently SPI is always used in polled mode and does not
- *          make use of interupts for data transmission or reception.
+ *          Single bytes are sent and received in polled mode, the calls
+ *          wait for the byte to be shifted out.  Longer exchanges run in the
+ *          background from the SPI interrupt as a chain of transfers, see
+ *          spi_transfer_start().  The polled calls must not be used while a
+ *          transfer is in progress.
  */
+
+#include <types.h>
  
  /** Maximum number of supported SPI Ports */
 #define MAX_SPI 1
@@ -31,6 +36,31 @@
 #define SPI_MISO (1<<3)
 //@}
 
+struct SpiTransfer;
+
+/** Completion callback of a transfer, runs in the SPI interrupt */
+typedef void (*SpiCallback)(struct SpiTransfer *transfer);
+
+/** One transfer of a chain
+ *
+ *  The clock polarity and phase and the device enable line are set for
+ *  each transfer, so a chain can switch the clocking between a command and
+ *  a read as the MS5541 needs.  The descriptor and its buffers must stay
+ *  valid until the transfer has completed.
+ */
+struct SpiTransfer
+{
+    const char *tx;                 ///< bytes to send, 0 sends null bytes
+    char *rx;                       ///< received bytes, 0 to drop them
+    unsigned char len;              ///< bytes to transfer, at least 1
+    char falling_edge;              ///< clock polarity, see spi_set_clock_polarity()
+    char sample_on_trailing_edge;   ///< clock phase, see spi_set_clock_phase()
+    volatile uint8_t *enable_port;  ///< port of the device enable line, 0 for none
+    uint8_t enable_mask;            ///< enable line, driven high for the transfer
+    SpiCallback done;               ///< called when the transfer completes, may be 0
+    struct SpiTransfer *next;       ///< started when this one completes, 0 ends the chain
+};
+
 /** Initialize the serial peripheral interface subsystem 
  */ 
 void spi_init(void);
@@ -86,4 +116,20 @@ void spi_set_clock_polarity(int port, char falling_edge);
  *         or rising edge depends upon the polatity of the clock signal.
  */
 void spi_set_clock_phase(int port, char sample_on_trailing_edge);
+
+/** Start a chain of transfers in the background
+ *
+ *  Returns at once, the bytes are exchanged from the SPI interrupt.  Each
+ *  transfer of the chain calls its callback as it completes, after the next
+ *  one has been started, so the last callback may start a new chain.  May be
+ *  called from an interrupt.
+ *
+ *  @param port SPI port
+ *  @param transfer first transfer of the chain
+ *  @return 0 if a chain is already in progress
+ */
+char spi_transfer_start(int port, struct SpiTransfer *transfer);
+
+/** @return 1 while a chain of transfers is in progress */
+char spi_transfer_busy(int port);
 #endif
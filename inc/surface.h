@@ -0,0 +1,73 @@
+#ifndef __SURFACE_H__
+#define __SURFACE_H__
+
+/** @file   surface.h
+ *  @brief  Automatic surface zeroing and atmospheric drift tracking
+ *
+ *          The pressure is taken in steps of SURFACE_TRACK_mS, the level
+ *          of a step is the mean of its samples.  The vehicle is taken to
+ *          be at the surface when the absolute pressure is in the
+ *          atmospheric range, the reject filter of depth.c has settled
+ *          (DEPTH_STATUS_REJECTED clear), the pressure has stayed within
+ *          SURFACE_SPREAD_cmBar in every step and the levels of the steps
+ *          within SURFACE_SPREAD_cmBar of the first for SURFACE_HOLD_mS.
+ *          After that only a jump of the level from one step to the next
+ *          counts as leaving, so the weather can drift.  Once the surface
+ *          reference has been captured, it must also be within
+ *          SURFACE_BAND_cmBar of the reference, so hovering just below the
+ *          surface is not mistaken for a change in the weather.
+ *
+ *          Off by default: a unit powered up in a pressure housing or
+ *          below a shallow surface would otherwise take that pressure as
+ *          the surface.  Once enabled, the first time the surface is seen
+ *          after power up, normally on deck, the reference is captured
+ *          outright as the mean level over the hold.  After that it follows
+ *          the step levels with a time constant of about SURFACE_TRACK_DIV
+ *          steps of surface time.  This takes out the
+ *          drift of the atmospheric pressure over a long mission.
+ *
+ *          surface_update() reports when the reference has moved far
+ *          enough to be saved.  Saves are throttled to SURFACE_PERSIST_mS so
+ *          the eeprom journal (config.h) sees only a few writes per hour.
+ */
+
+/** @name Surface detection */
+//@{
+#define SURFACE_MIN_cmBar     80000L  ///< lowest atmospheric pressure accepted
+#define SURFACE_MAX_cmBar     105000L ///< highest atmospheric pressure accepted
+#define SURFACE_BAND_cmBar    2000L   ///< largest distance from the reference (20 cm)
+#define SURFACE_SPREAD_cmBar  1000L   ///< largest spread in a step, and of the steps while held (waves)
+#define SURFACE_HOLD_mS       10000   ///< time to be stable at the surface
+//@}
+
+/** @name Tracking */
+//@{
+#define SURFACE_TRACK_mS      1000    ///< length of a step, the interval between tracking steps
+#define SURFACE_TRACK_DIV     64      ///< fraction of the error taken per step
+#define SURFACE_PERSIST_cmBar 20L     ///< change worth saving (2 mm)
+#define SURFACE_PERSIST_mS    600000UL ///< shortest interval between saves
+//@}
+
+/** Reset the detection, the next surface seen is captured outright */
+void surface_init(void);
+
+/** Turn automatic zeroing on or off, it is off until enabled ($PVRAZ) */
+void surface_enable(char on);
+
+/** @return 1 if automatic zeroing is on */
+char surface_enabled(void);
+
+/** Feed every new sample
+ *
+ *  Updates the surface reference with depth_set_zero_cmBar().
+ *
+ *  @param pressure_cmBar absolute pressure in mBar/100 (depth_cmBar())
+ *  @param now system time of the sample (depth_sample_time())
+ *  @return 1 if the reference should be saved
+ */
+char surface_update(long pressure_cmBar, unsigned long now);
+
+/** @return 1 while the vehicle is detected at the surface */
+char surface_detected(void);
+
+#endif
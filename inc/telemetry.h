@@ -0,0 +1,199 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+/** @file   telemetry.h
+ *  @brief  Compact binary telemetry frames
+ *
+ *          Alternative to the ASCII $PVRDT/$PVRDF sentences for hosts that
+ *          want to avoid text parsing.  All multi-byte fields are little
+ *          endian.  Every frame starts with the same 4 byte header and ends
+ *          with a CRC of everything after the sync bytes.  Raw data fields
+ *          are 24 bits wide, enough for any sensor driver (sensor.h).
+ *
+ *          Depth frame layout:
+ *  @code
+    offset size field
+         0    1 sync 1 (0xA5)
+         1    1 sync 2 (0x5A)
+         2    1 frame type (TELEMETRY_TYPE_DEPTH)
+         3    1 payload length (bytes 4 up to the crc)
+         4    2 sample sequence number (depth_sample_seq())
+         6    4 sample time, get_time() format (depth_sample_time())
+        10    3 raw pressure datum D1
+        13    3 raw temperature datum D2
+        16    2 pressure in mBar
+        18    2 temperature in degree C/100, signed
+        20    1 status flags (DEPTH_STATUS_*)
+        21    4 depth below the surface reference in mm, signed (hydro.h)
+        25    2 CRC-16/CCITT (poly 0x1021, init 0xFFFF) of bytes 2 to 24
+    @endcode
+ *
+ *          Filter frame layout, sent after the depth frame of the same
+ *          sample and carrying its sequence number:
+ *  @code
+    offset size field
+         0    2 sync
+         2    1 frame type (TELEMETRY_TYPE_FILTER)
+         3    1 payload length
+         4    2 sequence number
+         6    4 sample time, get_time() format
+        10    4 filtered depth in mBar/100, signed
+        14    4 depth rate in mBar/100 per second, signed, positive descending
+        18    2 CRC-16/CCITT of bytes 2 to 17
+    @endcode
+ *
+ *          Raw capture (OUTPUT_FORMAT_RAW) sends a raw frame for every
+ *          conversion instead, see depth_last_conversion():
+ *  @code
+    offset size field
+         0    2 sync
+         2    1 frame type (TELEMETRY_TYPE_RAW)
+         3    1 payload length
+         4    2 conversion sequence number
+         6    4 time the pressure conversion was read, get_time() format
+        10    3 raw pressure datum D1
+        13    3 raw temperature datum D2
+        16    1 conversions D2 has been reused for, 0 if fresh
+        17    2 CRC-16/CCITT of bytes 2 to 16
+    @endcode
+ *
+ *          preceded, when the capture starts and every
+ *          TELEMETRY_SETUP_INTERVAL raw frames after, by a setup frame with
+ *          what is needed to redo the compensation and filtering:
+ *  @code
+    offset size field
+         0    2 sync
+         2    1 frame type (TELEMETRY_TYPE_SETUP)
+         3    1 payload length
+         4    2 conversion sequence number of the raw frame that follows
+         6    4 time, get_time() format
+        10    1 calibration words of the sensor driver
+        11   16 calibration words, TELEMETRY_CAL_WORDS of them, 0 past
+                the driver's
+        27    1 oversampling, see depth_set_oversample()
+        28    1 running median length
+        29    1 alpha, Q8
+        30    1 beta, Q8
+        31    4 surface reference in mBar/100, signed
+        35    2 fluid density in kg/m^3
+        37    1 latitude in degrees, signed
+        38    1 pressure conversions per temperature conversion
+        39    2 CRC-16/CCITT of bytes 2 to 38
+    @endcode
+ *
+ *          This header only depends on the C language so it can be shared
+ *          with host side decoders.
+ */
+
+/** @name Output formats */
+//@{
+#define OUTPUT_FORMAT_ASCII   0  ///< $PVRDT sentence
+#define OUTPUT_FORMAT_BINARY  1  ///< binary telemetry frame
+#define OUTPUT_FORMAT_RAW     2  ///< raw capture frames
+#define OUTPUT_FORMAT_FUSED   3  ///< $PVRDX sentence, see fusion.h
+//@}
+
+/** @name Frame definition */
+//@{
+#define TELEMETRY_SYNC1           0xA5
+#define TELEMETRY_SYNC2           0x5A
+#define TELEMETRY_TYPE_DEPTH      0x01
+#define TELEMETRY_TYPE_FILTER     0x02
+#define TELEMETRY_TYPE_RAW        0x03
+#define TELEMETRY_TYPE_SETUP      0x04
+#define TELEMETRY_HEADER_LEN      4
+#define TELEMETRY_CRC_LEN         2
+#define TELEMETRY_DEPTH_PAYLOAD   21
+#define TELEMETRY_DEPTH_FRAME_LEN (TELEMETRY_HEADER_LEN + TELEMETRY_DEPTH_PAYLOAD + TELEMETRY_CRC_LEN)
+#define TELEMETRY_FILTER_PAYLOAD  14
+#define TELEMETRY_FILTER_FRAME_LEN (TELEMETRY_HEADER_LEN + TELEMETRY_FILTER_PAYLOAD + TELEMETRY_CRC_LEN)
+#define TELEMETRY_RAW_PAYLOAD     13
+#define TELEMETRY_RAW_FRAME_LEN   (TELEMETRY_HEADER_LEN + TELEMETRY_RAW_PAYLOAD + TELEMETRY_CRC_LEN)
+#define TELEMETRY_SETUP_PAYLOAD   35
+#define TELEMETRY_SETUP_FRAME_LEN (TELEMETRY_HEADER_LEN + TELEMETRY_SETUP_PAYLOAD + TELEMETRY_CRC_LEN)
+#define TELEMETRY_MAX_FRAME_LEN   TELEMETRY_SETUP_FRAME_LEN
+#define TELEMETRY_SETUP_INTERVAL  256
+#define TELEMETRY_CAL_WORDS       8
+#define TELEMETRY_CRC_INIT        0xFFFF
+//@}
+
+/** @name Depth frame field offsets */
+//@{
+#define TELEMETRY_OFS_TYPE        2
+#define TELEMETRY_OFS_LEN         3
+#define TELEMETRY_OFS_SEQ         4
+#define TELEMETRY_OFS_TIME        6
+#define TELEMETRY_OFS_RAW_D1      10
+#define TELEMETRY_OFS_RAW_D2      13
+#define TELEMETRY_OFS_PRESSURE    16
+#define TELEMETRY_OFS_TEMP        18
+#define TELEMETRY_OFS_STATUS      20
+#define TELEMETRY_OFS_DEPTH_MM    21
+#define TELEMETRY_OFS_CRC         25
+//@}
+
+/** @name Filter frame field offsets, header, sequence and time as above */
+//@{
+#define TELEMETRY_OFS_FILTER_DEPTH 10
+#define TELEMETRY_OFS_FILTER_RATE  14
+#define TELEMETRY_OFS_FILTER_CRC   18
+//@}
+
+/** @name Raw frame field offsets */
+//@{
+#define TELEMETRY_OFS_RAW_FRAME_D1 10
+#define TELEMETRY_OFS_RAW_FRAME_D2 13
+#define TELEMETRY_OFS_RAW_TEMP_AGE 16
+#define TELEMETRY_OFS_RAW_CRC      17
+//@}
+
+/** @name Setup frame field offsets */
+//@{
+#define TELEMETRY_OFS_SETUP_CAL_COUNT  10
+#define TELEMETRY_OFS_SETUP_CAL        11
+#define TELEMETRY_OFS_SETUP_OVERSAMPLE 27
+#define TELEMETRY_OFS_SETUP_MEDIAN     28
+#define TELEMETRY_OFS_SETUP_ALPHA      29
+#define TELEMETRY_OFS_SETUP_BETA       30
+#define TELEMETRY_OFS_SETUP_ZERO       31
+#define TELEMETRY_OFS_SETUP_DENSITY    35
+#define TELEMETRY_OFS_SETUP_LATITUDE   37
+#define TELEMETRY_OFS_SETUP_TEMP_INTERVAL 38
+#define TELEMETRY_OFS_SETUP_CRC        39
+//@}
+
+/** Encode a depth frame with the latest sample
+ *
+ *  The sequence number is that of the sample, so a gap tells the host how
+ *  many samples were not sent, by the output schedule or lost on the way.
+ *
+ *  @param frame TELEMETRY_DEPTH_FRAME_LEN bytes to fill
+ *  @return TELEMETRY_DEPTH_FRAME_LEN
+ */
+int telemetry_encode_depth(char *frame);
+
+/** Encode a filter frame with the latest filtered depth and rate
+ *
+ *  Carries the same sample sequence number as the depth frame so the host
+ *  can pair them.
+ *
+ *  @param frame TELEMETRY_FILTER_FRAME_LEN bytes to fill
+ *  @return TELEMETRY_FILTER_FRAME_LEN
+ */
+int telemetry_encode_filter(char *frame);
+
+/** Encode a raw frame with the last conversion
+ *
+ *  @param frame TELEMETRY_RAW_FRAME_LEN bytes to fill
+ *  @return TELEMETRY_RAW_FRAME_LEN
+ */
+int telemetry_encode_raw(char *frame);
+
+/** Encode a setup frame with the calibration and processing settings
+ *
+ *  @param frame TELEMETRY_SETUP_FRAME_LEN bytes to fill
+ *  @return TELEMETRY_SETUP_FRAME_LEN
+ */
+int telemetry_encode_setup(char *frame);
+
+#endif
@@ -26,6 +26,36 @@ void uart_init(void);
 
 /** Enable rs485 on a device that supports multiple serial physical layers*/
 void uart_enable_rs485(int uart_device_id, int on_off);
+
+/** Drive the rs485 transmitter of a port, no effect unless rs485 is enabled
+ *
+ *  Done by the driver around every transmission.
+ */
+void uart_rs485_tx_enable(int uart_device_id, int on_off);
+
+/** Queue received bytes with framing, overrun or parity errors instead of
+ *  dropping them */
+void uart_allow_bad_bytes(int uart_device_id, int allow);
+
+/** Status register of the last byte received with an error, cleared on read
+ *  @param uart_device_id id of specific uart port
+ *  @return 0 if there was no error since the last call
+ */
+unsigned char uart_get_last_error(int uart_device_id);
+
+/** Error counters of a port, counted since uart_init() and wrapping */
+struct UART_Stats
+{
+    unsigned int tx_dropped;    ///< bytes refused because the transmit buffer was full
+    unsigned int rx_errors;     ///< bytes received with framing, overrun or parity errors
+    unsigned int rx_dropped;    ///< bytes lost because the receive buffer was full
+};
+
+/** Copy the error counters of a port
+ *  @param uart_device_id id of specific uart port
+ *  @param stats filled in
+ */
+void uart_get_stats(int uart_device_id, struct UART_Stats *stats);
  
 /** Manually set the baudrate for a specific device 
  *  
@@ -86,6 +116,40 @@ int uart_write(int uart_device_id, char *buf, int cnt);
  */
 int uart_write_byte(int uart_device_id, char data);
 
+/** Returns the number of bytes the transmit buffer can still take
+ *
+ *  Lets producers drop or coalesce output instead of having it cut short.
+ *
+ *  @param uart_device_id id of specific uart port
+ */
+int uart_tx_free(int uart_device_id);
+
+/** Reserve space in the transmit buffer to write into directly
+ *
+ *  Returns the contiguous part of the free space, which may be less than
+ *  uart_tx_free() when the space wraps around the end of the buffer.  Fill
+ *  it, then call uart_tx_commit().  Only one reservation per port may be
+ *  open at a time.
+ *
+ *  @param uart_device_id id of specific uart port
+ *  @param len set to the number of bytes that may be written, 0 if full
+ *  @return where to write the next byte
+ */
+char *uart_tx_reserve(int uart_device_id, int *len);
+
+/** Queue bytes written to a reserved span and start transmission
+ *
+ *  @param uart_device_id id of specific uart port
+ *  @param cnt number of bytes written, no more than the reserved length
+ */
+void uart_tx_commit(int uart_device_id, int cnt);
+
+/** Returns true once everything written has left the port, including the
+ *  last stop bit, e.g. before changing the baudrate
+ *  @param uart_device_id id of specific uart port
+ */
+int uart_tx_idle(int uart_device_id);
+
 /** Wait for the uart ringbuffer and transmit register to be empty 
  *
  *  This functions insures that there are no further bytes to be transmitted 
@@ -97,6 +161,16 @@ void uart_wait_write(int uart_device_id);
  *  @param uart_device_id id of specific uart port
  */
 int uart_rx_cnt(int uart_device_id);
+
+/** Returns number of bytes waiting in the transmit buffer
+ *  @param uart_device_id id of specific uart port
+ */
+int uart_tx_cnt(int uart_device_id);
+
+/** Returns true if the transmit data register can take a byte
+ *  @param uart_device_id id of specific uart port
+ */
+int uart_txempty(int uart_device_id);
 //@}
 
 
@@ -15,12 +15,17 @@
 //@{
 #define mBAR_2_PSI(x) (x * 0.014503773773)
 #define PSI_2_mBAR(x) (x/mBAR_2_PSI)
+/** Integer only mBar to milli-psi, valid for 0 to 65535 mBar */
+#define mBAR_2_mPSI_INT(x) (((unsigned long)(x) * 14504UL) / 1000UL)
+/** mBar/100 is exactly a Pascal */
+#define cmBAR_2_PA(x) (x)
 //@}
 
 /** @name Length */
 //@{
 #define FT_2_M(x)  (x * 0.3048)
 #define M_2_FT(x)  (x/FT_2_M)
+#define MM_2_M(x)  (x / 1000.0)
 //@}
  
 
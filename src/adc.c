@@ -0,0 +1,87 @@
+/** @file   adc.c
+ *  @brief  Background acquisition on the MCU ADC
+ */
+
+#include <device.h>
+#include <adc.h>
+#include <sysclk.h>
+
+/** Decimation window, only touched by the ISR once started */
+static uint16_t adc_sum;
+static unsigned char adc_cnt;
+
+/** Latest sample, written by the ISR */
+static volatile struct AdcSample adc_sample;
+static volatile char adc_new;
+static volatile unsigned int adc_overrun_cnt;
+static char adc_on;
+
+void adc_start(unsigned char channel) {
+    CRITICAL_region_begin();
+
+    adc_sum = 0;
+    adc_cnt = 0;
+    adc_new = 0;
+    adc_on = 1;
+    ADMUX = (1 << REFS0) | (channel & 0x07);
+    ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADFR) | (1 << ADIF) | (1 << ADIE) |
+             (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);   // clk/128
+
+    CRITICAL_region_end();
+}
+
+void adc_stop(void) {
+    ADCSRA = 0;
+    adc_on = 0;
+    adc_new = 0;
+}
+
+char adc_running(void) {
+    return adc_on;
+}
+
+/** Conversion complete, add it to the window and hand over a full one */
+ISR(ADC_vect) {
+    adc_sum += ADC;
+    if (++adc_cnt < ADC_DECIMATION) {
+        return;
+    }
+
+    if (adc_new) {
+        adc_overrun_cnt++;
+    }
+    adc_sample.sum = adc_sum;
+    adc_sample.time = get_time();
+    adc_sample.seq++;
+    adc_new = 1;
+    adc_sum = 0;
+    adc_cnt = 0;
+}
+
+char adc_read(struct AdcSample *sample) {
+    char new_sample;
+
+    CRITICAL_region_begin();
+    new_sample = adc_new;
+    if (new_sample) {
+        sample->sum = adc_sample.sum;
+        sample->time = adc_sample.time;
+        sample->seq = adc_sample.seq;
+        adc_new = 0;
+    }
+    CRITICAL_region_end();
+    return new_sample;
+}
+
+char adc_pending(void) {
+    return adc_new;
+}
+
+unsigned int adc_overruns(void) {
+    unsigned int overruns;
+
+    CRITICAL_region_begin();
+    overruns = adc_overrun_cnt;
+    CRITICAL_region_end();
+    return overruns;
+}
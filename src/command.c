@@ -0,0 +1,182 @@
+/** @file   command.c
+ *  @brief  Incremental parser for NMEA style commands
+ */
+
+#include <command.h>
+#include <nmea.h>
+
+#include <string.h>
+
+/** @name Parser states */
+//@{
+#define PARSE_IDLE      0  ///< waiting for '$'
+#define PARSE_ID        1  ///< command id
+#define PARSE_FIELD     2  ///< a numeric field
+#define PARSE_CHECKSUM  3  ///< the two hex digits after '*'
+//@}
+
+void command_init(struct CommandParser *p) {
+    p->state = PARSE_IDLE;
+}
+
+/** Start a new line */
+static void command_start(struct CommandParser *p) {
+    p->state = PARSE_ID;
+    p->error = 0;
+    p->checksum = 0;
+    p->rx_checksum = 0;
+    p->len = 0;
+    memset(&p->line, 0, sizeof(p->line));
+}
+
+/** Keep the first error of the line */
+static void command_error(struct CommandParser *p, char error) {
+    if (!p->error) {
+        p->error = error;
+    }
+}
+
+/** Apply the sign once a field is complete */
+static void command_close_field(struct CommandParser *p) {
+    struct CommandLine *line = &p->line;
+
+    if (p->state == PARSE_FIELD && p->negative && line->fields) {
+        line->field[line->fields - 1] = -line->field[line->fields - 1];
+    }
+}
+
+/** Start the next field */
+static void command_open_field(struct CommandParser *p) {
+    command_close_field(p);
+    p->state = PARSE_FIELD;
+    p->len = 0;
+    p->negative = 0;
+    if (p->line.fields == COMMAND_MAX_FIELDS) {
+        command_error(p, COMMAND_ERR_FORMAT);
+        return;
+    }
+    p->line.fields++;
+}
+
+/** @return value of a hex digit, 0xFF if c is none */
+static unsigned char command_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return 0xFF;
+}
+
+/** A field character */
+static void command_field_char(struct CommandParser *p, char c) {
+    struct CommandLine *line = &p->line;
+    unsigned char n = line->fields - 1;
+
+    if (p->error) {
+        return;
+    }
+    if (c == '-' && p->len == 0 && !p->negative) {
+        p->negative = 1;
+    } else if (c >= '0' && c <= '9' && p->len < COMMAND_MAX_DIGITS) {
+        line->field[n] = line->field[n] * 10 + (c - '0');
+        line->present |= 1 << n;
+        p->len++;
+    } else {
+        command_error(p, COMMAND_ERR_FORMAT);
+    }
+}
+
+/** End of line */
+static char command_finish(struct CommandParser *p) {
+    char state = p->state;
+
+    command_close_field(p);
+    p->state = PARSE_IDLE;
+
+    if (state == PARSE_CHECKSUM) {
+        if (p->len != 2) {
+            command_error(p, COMMAND_ERR_FORMAT);
+        } else if (p->rx_checksum != p->checksum) {
+            return COMMAND_ERR_CHECKSUM;
+        }
+    }
+    if (p->line.id[0] == 0) {
+        command_error(p, COMMAND_ERR_FORMAT);
+    }
+    return p->error ? p->error : COMMAND_LINE;
+}
+
+char command_parse(struct CommandParser *p, char c) {
+    unsigned char digit;
+
+    if (c == '$') {
+        command_start(p);
+        return COMMAND_PENDING;
+    }
+    if (p->state == PARSE_IDLE) {
+        return COMMAND_PENDING;
+    }
+    if (c == '\r' || c == '\n') {
+        return command_finish(p);
+    }
+
+    if (p->state == PARSE_CHECKSUM) {
+        digit = command_hex(c);
+        if (digit == 0xFF || p->len == 2) {
+            command_error(p, COMMAND_ERR_FORMAT);
+        } else {
+            p->rx_checksum = (p->rx_checksum << 4) | digit;
+            p->len++;
+        }
+        return COMMAND_PENDING;
+    }
+
+    if (c == '*') {
+        command_close_field(p);
+        p->state = PARSE_CHECKSUM;
+        p->len = 0;
+        return COMMAND_PENDING;
+    }
+
+    p->checksum ^= c;
+
+    if (c == ',') {
+        command_open_field(p);
+    } else if (p->state == PARSE_ID) {
+        if (p->len < COMMAND_ID_LEN) {
+            p->line.id[p->len++] = c;
+        } else {
+            command_error(p, COMMAND_ERR_FORMAT);
+        }
+    } else {
+        command_field_char(p, c);
+    }
+    return COMMAND_PENDING;
+}
+
+char command_dispatch(const struct Command *table, unsigned char cnt,
+                      const struct CommandLine *line) {
+    unsigned char i;
+
+    for (i = 0; i < cnt; i++) {
+        if (strcmp(table[i].id, line->id) == 0) {
+            return table[i].handler(line) ? COMMAND_ACK : COMMAND_ERR_PARAM;
+        }
+    }
+    return COMMAND_ERR_UNKNOWN;
+}
+
+void command_nak(int port, const struct CommandLine *line, char error, char use_checksum) {
+    struct NmeaSentence s;
+
+    nmea_begin(&s, port, "PVRNK", use_checksum);
+    nmea_putc(&s, ',');
+    nmea_puts(&s, line->id);
+    nmea_field_int(&s, error);
+    nmea_end(&s);
+}
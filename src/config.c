@@ -0,0 +1,170 @@
+/** @file   config.c
+ *  @brief  Persistent configuration in eeprom
+ */
+
+#include <device.h>
+#include <config.h>
+#include <sysclk.h>
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#define CONFIG_CRC_INIT  0xFFFF
+
+/** A journal slot as stored in eeprom
+ *
+ *  The record is len bytes long and the CRC follows it directly, so a
+ *  record written by another firmware sits at the same place with its
+ *  CRC behind its own length.
+ */
+struct ConfigSlot
+{
+    uint16_t seq;           ///< incremented with every save
+    uint8_t version;        ///< CONFIG_VERSION
+    uint8_t len;            ///< sizeof(struct Config)
+    struct Config config;
+    uint16_t crc;           ///< CRC-16/CCITT of everything above
+};
+
+/** Compile time check that a slot fits CONFIG_SLOT_SIZE */
+typedef char config_slot_fits[sizeof(struct ConfigSlot) <= CONFIG_SLOT_SIZE ? 1 : -1];
+/** Compile time check that the CRC follows the record without padding */
+typedef char config_crc_follows[offsetof(struct ConfigSlot, crc) ==
+                                offsetof(struct ConfigSlot, config) + sizeof(struct Config) ? 1 : -1];
+
+/** Last record loaded or written, saves equal to it are skipped */
+static struct Config config_stored;
+/** Latest settings requested by config_save() */
+static struct Config config_request;
+static char config_dirty;
+static unsigned long config_dirty_time;
+
+/** Slot being written, written up to config_write_pos */
+static struct ConfigSlot config_write;
+static unsigned char config_write_pos;
+static char config_writing;
+
+/** Where the next save goes */
+static unsigned char config_next_slot;
+static uint16_t config_next_seq;
+
+static uint8_t *config_slot_addr(unsigned char slot) {
+    return (uint8_t *)CONFIG_JOURNAL_ADDR + (unsigned int)slot * CONFIG_SLOT_SIZE;
+}
+
+static uint16_t config_crc(const struct ConfigSlot *s) {
+    const uint8_t *p = (const uint8_t *)s;
+    uint16_t crc = CONFIG_CRC_INIT;
+    unsigned char i;
+
+    for (i = 0; i < offsetof(struct ConfigSlot, crc); i++) {
+        crc = _crc_xmodem_update(crc, p[i]);
+    }
+    return crc;
+}
+
+/** Check the CRC of a slot holding a len byte record, read from eeprom */
+static char config_slot_valid(const uint8_t *addr, uint8_t len) {
+    uint16_t crc = CONFIG_CRC_INIT;
+    uint16_t stored;
+    unsigned char i, n = offsetof(struct ConfigSlot, config) + len;
+
+    for (i = 0; i < n; i++) {
+        crc = _crc_xmodem_update(crc, eeprom_read_byte(addr + i));
+    }
+    eeprom_read_block(&stored, addr + n, sizeof(stored));
+    return stored == crc;
+}
+
+char config_load(struct Config *cfg) {
+    struct ConfigSlot s;
+    unsigned char slot, len = 0;
+    char found = 0;
+
+    config_next_slot = 0;
+    config_next_seq = 0;
+
+    for (slot = 0; slot < CONFIG_JOURNAL_SLOTS; slot++) {
+        eeprom_read_block(&s, config_slot_addr(slot), offsetof(struct ConfigSlot, config));
+        if (s.version != CONFIG_VERSION ||
+            s.len > CONFIG_SLOT_SIZE - offsetof(struct ConfigSlot, config) - sizeof(s.crc) ||
+            !config_slot_valid(config_slot_addr(slot), s.len)) {
+            continue;
+        }
+        /* sequence numbers wrap, compare by difference */
+        if (!found || (int16_t)(s.seq - config_next_seq) >= 0) {
+            len = s.len < sizeof(struct Config) ? s.len : sizeof(struct Config);
+            config_next_seq = s.seq + 1;
+            config_next_slot = slot + 1 < CONFIG_JOURNAL_SLOTS ? slot + 1 : 0;
+            found = 1;
+        }
+    }
+
+    if (found) {
+        /* the fields the record holds over the defaults */
+        slot = config_next_slot ? config_next_slot - 1 : CONFIG_JOURNAL_SLOTS - 1;
+        eeprom_read_block(cfg, config_slot_addr(slot) + offsetof(struct ConfigSlot, config), len);
+        config_stored = *cfg;
+    } else {
+        /* nothing stored yet, make sure the first save is written */
+        memset(&config_stored, 0xFF, sizeof(config_stored));
+    }
+    return found;
+}
+
+void config_save(const struct Config *cfg, unsigned long now) {
+    config_request = *cfg;
+    if (memcmp(&config_request, &config_stored, sizeof(config_request)) == 0) {
+        config_dirty = 0;
+        return;
+    }
+    if (!config_dirty) {
+        config_dirty = 1;
+        config_dirty_time = now;
+    }
+}
+
+/** Write one byte of the slot, skipping bytes the cell already holds */
+static void config_write_byte(void) {
+    uint8_t *addr = config_slot_addr(config_next_slot) + config_write_pos;
+    uint8_t b = ((const uint8_t *)&config_write)[config_write_pos];
+
+    if (eeprom_read_byte(addr) != b) {
+        eeprom_write_byte(addr, b);
+    }
+    config_write_pos++;
+}
+
+void config_service(unsigned long now) {
+    if (config_writing) {
+        if (!eeprom_is_ready()) {
+            return;
+        }
+        config_write_byte();
+        if (config_write_pos == sizeof(config_write)) {
+            config_writing = 0;
+            config_next_seq++;
+            config_next_slot = config_next_slot + 1 < CONFIG_JOURNAL_SLOTS ? config_next_slot + 1 : 0;
+        }
+        return;
+    }
+
+    if (config_dirty && now - config_dirty_time >= SYS_CLK_MS_2_TICKS(CONFIG_SAVE_DELAY_mS)) {
+        config_write.seq = config_next_seq;
+        config_write.version = CONFIG_VERSION;
+        config_write.len = sizeof(struct Config);
+        config_write.config = config_request;
+        config_write.crc = config_crc(&config_write);
+        config_stored = config_request;
+        config_dirty = 0;
+        config_write_pos = 0;
+        config_writing = 1;
+    }
+}
+
+char config_busy(void) {
+    return config_dirty || config_writing;
+}
@@ -0,0 +1,640 @@
+/** @file   depth.c
+ *  @brief  Pressure sensor (depth) acquisition
+ *
+ *          The sensor itself is handled by the driver the platform selects,
+ *          see sensor.h.  Its calls are inlined here, the sample path has no
+ *          indirect calls.
+ *
+ *          Compensation is done entirely in integer arithmetic, so no
+ *          soft-float library code is pulled in for the acquisition path.
+ *          Floating point values are only derived when a caller asks for
+ *          them (depth_psi(), water_temp_C()).
+ *
+ *          Acquisition is either polled from depth_acq() or, after
+ *          depth_acq_timer_start(), driven by the Timer 3 output compare A
+ *          interrupt.  In timer mode the ISR reads each conversion as it
+ *          completes and queues the raw datum with its timestamp, depth_acq()
+ *          then only compensates the queued samples.
+ *
+ *          Either way the conversion is read and the next one started in
+ *          the background (sensor_start()), so nothing
+ *          on the sample path waits for the bus.  The blocking reads are only
+ *          left for the calibration at start up and depth_raw()/temp_raw().
+ */
+
+#include <device.h>
+#include <depth.h>
+#include <filter.h>
+#include <hydro.h>
+#include <sensor.h>
+#include <sysclk.h>
+#include <units.h>
+
+#include <util/crc16.h>
+
+#include <stdlib.h>
+
+/** Timer 3 runs at F_CPU/256, one compare period covers a conversion with
+ *  1 mS of margin */
+#define DEPTH_TIMER_COUNTS   ((F_CPU / 256) * (SENSOR_CONVERSION_mS + 1) / 1000)
+
+/** Raw sample queue between the timer ISR and depth_acq(), must be a power of 2 */
+#define DEPTH_QUEUE_SIZE     8
+#define DEPTH_QUEUE_MASK     (DEPTH_QUEUE_SIZE - 1)
+
+/** Maximum change between samples before a reading is considered an outlier
+ *  (mBar and deg C/10 respectively) */
+#define DEPTH_REJECT_DELTA   100
+/** Temperature above which a reading is considered bad (deg C/10) */
+#define DEPTH_REJECT_TEMP    1500
+/** Number of consecutive rejected readings before a reading is forced through */
+#define DEPTH_REJECT_LIMIT   50
+
+/** Compile time checks of the driver against the raw capture, see sensor.h */
+typedef char depth_raw_fits[SENSOR_RAW_BITS <= DEPTH_RAW_BITS_MAX ? 1 : -1];
+typedef char depth_cal_fits[SENSOR_CAL_WORDS <= DEPTH_CAL_WORDS_MAX ? 1 : -1];
+/** Compile time check that the oversample sum of the widest raw value fits */
+typedef char depth_sum_fits[(1UL << DEPTH_RAW_BITS_MAX) - 1 <=
+                            0xFFFFFFFFUL / DEPTH_OVERSAMPLE_MAX ? 1 : -1];
+
+typedef enum {
+    DEPTH_REQUEST_PRESSURE,
+    DEPTH_READ_PRESSURE,
+    DEPTH_REQUEST_TEMP,
+    DEPTH_READ_TEMP
+} DEPTH_ACQ_STATE;
+
+SensorCalibration calibration;
+char depth_init_error;
+int measure_reject_count = DEPTH_REJECT_LIMIT;
+
+/** Raw D1/D2 words of the last completed acquisition */
+static sensor_raw_t Datum_pressure;
+static sensor_raw_t Datum_temp;
+
+/** Pressure conversions per temperature conversion */
+static unsigned char temp_interval = 1;
+/** Pressure samples computed with the current D2, DEPTH_TEMP_AGE_NONE until
+ *  the first temperature conversion */
+static unsigned char temp_age = DEPTH_TEMP_AGE_NONE;
+
+/** Pressure conversions averaged per output, and the running window */
+static unsigned char oversample = 1;
+static unsigned char oversample_cnt;
+static unsigned long oversample_sum;
+
+/** Last accepted pressure in mBar/100 */
+static long depth_sensor_cmBar;
+
+/** Diagnostics, see depth_reject_count() and friends */
+static unsigned int reject_total;
+static unsigned int read_errors;
+static uint16_t calibration_crc;
+static uint16_t calibration_words[SENSOR_CAL_WORDS];
+
+/** Last conversion before oversampling, for raw capture */
+static struct DepthConversion conversion;
+static unsigned long cycle_min;
+static unsigned long cycle_max;
+
+/** Surface reference in mBar/100 */
+static long depth_zero = DEPTH_ZERO_DEFAULT_cmBar;
+
+/** Median and alpha-beta stage run on every accepted reading */
+static struct DepthFilter depth_filter;
+/** Time of the last reading run through depth_filter, system ticks.  Unlike
+ *  sample_time it does not advance on rejected readings. */
+static unsigned long filter_time;
+
+/** Time of the last sample and smoothed time between samples, system ticks */
+static unsigned long sample_time;
+static unsigned long sample_period;
+/** Incremented with every output of depth_acq() */
+static uint16_t sample_seq;
+
+/** A conversion pair as read by the timer ISR */
+struct DepthSample
+{
+    sensor_raw_t d1;           ///< raw pressure
+    sensor_raw_t d2;           ///< raw temperature, possibly reused
+    unsigned long time;        ///< system time the pressure conversion completed
+    unsigned char temp_age;    ///< samples d2 has been reused for
+};
+
+/** Single producer (ISR) single consumer (depth_acq) queue.  Each index is
+ *  only written by one side and is a single byte, so no locking is needed. */
+static volatile struct DepthSample depth_queue[DEPTH_QUEUE_SIZE];
+static volatile unsigned char depth_queue_head;   ///< written by the ISR
+static volatile unsigned char depth_queue_tail;   ///< written by depth_acq()
+static volatile unsigned int depth_queue_overruns;
+
+/** Timer driven acquisition state, only touched by the ISR once started */
+static volatile char depth_timer_running;
+static DEPTH_ACQ_STATE depth_timer_state;
+static sensor_raw_t depth_timer_d1;
+static sensor_raw_t depth_timer_d2;
+static unsigned char depth_timer_temp_age;
+static unsigned long depth_timer_time;     ///< compare time, the conversion read completed
+static unsigned long depth_timer_d1_time;  ///< depth_timer_time of the pressure read, the sample time
+
+/** Last accepted pressure (mBar) and temperature (deg C/10) */
+long depth_sensor_std;
+long temp_sensor_std;
+long depth_sensor_std_prev;
+long temp_sensor_std_prev;
+
+void depth_init(void) {
+    unsigned char i;
+
+    depth_sensor_std_prev = 0;
+    temp_sensor_std_prev = 0;
+
+    depth_init_error = !sensor_init(&calibration, calibration_words);
+
+    calibration_crc = 0xFFFF;
+    for (i = 0; i < SENSOR_CAL_WORDS; i++) {
+        calibration_crc = _crc_xmodem_update(calibration_crc, calibration_words[i] >> 8);
+        calibration_crc = _crc_xmodem_update(calibration_crc, calibration_words[i] & 0xFF);
+    }
+
+    filter_init(&depth_filter, FILTER_DEFAULT_MEDIAN, FILTER_DEFAULT_ALPHA,
+                FILTER_DEFAULT_BETA);
+}
+
+/** Accept or reject a new compensated reading
+ *
+ *  Readings that jump by more than DEPTH_REJECT_DELTA from the last accepted
+ *  one are discarded, unless DEPTH_REJECT_LIMIT readings in a row have been
+ *  discarded in which case the new reading is taken as the truth.
+ */
+static void depth_update(long depth_sense, long temp_sense) {
+    if ((labs(depth_sense - depth_sensor_std_prev) < DEPTH_REJECT_DELTA &&
+         labs(temp_sense - temp_sensor_std_prev) < DEPTH_REJECT_DELTA &&
+         temp_sense < DEPTH_REJECT_TEMP) ||
+        measure_reject_count >= DEPTH_REJECT_LIMIT) {
+        depth_sensor_std = depth_sense;
+        temp_sensor_std = temp_sense;
+        measure_reject_count = 0;
+    } else {
+        measure_reject_count++;
+        reject_total++;
+    }
+
+    if (depth_init_error) {
+        depth_sensor_std = 0;
+        temp_sensor_std = 111;
+    }
+
+    depth_sensor_std_prev = depth_sensor_std;
+    temp_sensor_std_prev = temp_sensor_std;
+}
+
+/** Track the time between samples, averaged over about 8 samples */
+static void depth_sample_timing(unsigned long now) {
+    unsigned long dt = now - sample_time;
+
+    if (sample_time) {
+        sample_period = sample_period ? (7 * sample_period + dt) >> 3 : dt;
+        if (!cycle_min || dt < cycle_min) {
+            cycle_min = dt;
+        }
+        if (dt > cycle_max) {
+            cycle_max = dt;
+        }
+    }
+    sample_time = now;
+    sample_seq++;
+}
+
+/** Compensate the pressure conversion in Datum_pressure
+ *
+ *  With oversampling the conversion is added to the decimation window and
+ *  only every oversample'th call produces an output, from the mean of the
+ *  window with 8 fraction bits.  Datum_pressure is then replaced by the
+ *  rounded mean.
+ *
+ *  @return 1 if a new output was produced
+ */
+static char depth_compensate(unsigned long time) {
+    long depth_fine, depth_sense, temp_sense;
+    unsigned long d1_q8, rest;
+    unsigned long dt;
+
+    if (!SENSOR_RAW_VALID(Datum_pressure)) {
+        read_errors++;
+    }
+    if (temp_age == 0 && !SENSOR_RAW_VALID(Datum_temp)) {
+        read_errors++;
+    }
+
+    conversion.d1 = Datum_pressure;
+    conversion.d2 = Datum_temp;
+    conversion.temp_age = temp_age;
+    conversion.time = time;
+    conversion.seq++;
+
+    oversample_sum += Datum_pressure;
+    if (++oversample_cnt < oversample) {
+        return 0;
+    }
+    /* the sum of wide conversions has no 8 bits to spare, shift the
+     * quotient and divide the remainder apart */
+    d1_q8 = oversample_sum / oversample_cnt;
+    rest = oversample_sum % oversample_cnt;
+    d1_q8 = (d1_q8 << 8) + ((rest << 8) + (oversample_cnt >> 1)) / oversample_cnt;
+    oversample_sum = 0;
+    oversample_cnt = 0;
+    Datum_pressure = (d1_q8 + 0x80) >> 8;
+
+    depth_fine = sensor_compensate_fine(&calibration, d1_q8, Datum_temp);
+    depth_sense = depth_fine / 100;
+    sensor_compensate(&calibration, 0, &temp_sense, 0, Datum_temp);
+    depth_update(depth_sense, temp_sense);
+    if (!measure_reject_count) {
+        depth_sensor_cmBar = depth_init_error ? 0 : depth_fine;
+        if (!depth_init_error) {
+            dt = (time - filter_time) >> 8;
+            filter_update(&depth_filter, depth_sensor_cmBar,
+                          dt > FILTER_MAX_DT_mS ? FILTER_MAX_DT_mS + 1 : dt);
+            filter_time = time;
+        }
+    }
+    depth_sample_timing(time);
+    return 1;
+}
+
+static void depth_queue_put(unsigned long time) {
+    unsigned char head = depth_queue_head;
+    unsigned char next = (head + 1) & DEPTH_QUEUE_MASK;
+
+    if (next == depth_queue_tail) {
+        depth_queue_overruns++;
+        return;
+    }
+    depth_queue[head].d1 = depth_timer_d1;
+    depth_queue[head].d2 = depth_timer_d2;
+    depth_queue[head].time = time;
+    depth_queue[head].temp_age = depth_timer_temp_age;
+    depth_queue_head = next;
+}
+
+/** Conversion complete, runs every DEPTH_TIMER_COUNTS once started
+ *
+ *  Mirrors the polled state machine in depth_acq(): read the finished
+ *  conversion and immediately start the next one, so the sensor is never
+ *  idle and the sample spacing does not depend on the main loop.  The bus
+ *  work is left to the SPI interrupt, a conversion missed because the bus
+ *  was still busy counts as an overrun.
+ */
+ISR(TIMER3_COMPA_vect) {
+    unsigned char channel = SENSOR_PRESSURE;
+
+    if (depth_timer_state == DEPTH_READ_PRESSURE && depth_timer_temp_age + 1 >= temp_interval) {
+        channel = SENSOR_TEMP;
+    }
+    depth_timer_time = get_time();
+    if (!sensor_start(1, channel)) {
+        depth_queue_overruns++;
+    }
+}
+
+/** The conversion read at the timer compare is in and the next one started,
+ *  queue a sample once a pressure has a temperature to go with it */
+static void depth_timer_read_done(void) {
+    if (depth_timer_state == DEPTH_READ_PRESSURE) {
+        depth_timer_d1 = sensor_result();
+        depth_timer_d1_time = depth_timer_time;
+        if (depth_timer_temp_age + 1 >= temp_interval) {
+            depth_timer_state = DEPTH_READ_TEMP;
+            return;
+        }
+        depth_timer_temp_age++;
+    } else {
+        depth_timer_d2 = sensor_result();
+        depth_timer_temp_age = 0;
+        depth_timer_state = DEPTH_READ_PRESSURE;
+    }
+
+    /* a temperature read one compare later must not move the sample time */
+    depth_queue_put(depth_timer_d1_time);
+}
+
+/** End of a background sensor_start(), runs in the driver's interrupt */
+static void depth_sensor_done(char read) {
+    if (depth_timer_running && read) {
+        depth_timer_read_done();
+    }
+}
+
+void depth_acq_timer_start(void) {
+    CRITICAL_region_begin();
+
+    depth_queue_head = 0;
+    depth_queue_tail = 0;
+    depth_timer_temp_age = DEPTH_TEMP_AGE_NONE;
+    depth_timer_state = DEPTH_READ_PRESSURE;
+    sensor_start(0, SENSOR_PRESSURE);
+
+    TCCR3A = 0;
+    TCNT3 = 0;
+    OCR3A = DEPTH_TIMER_COUNTS;
+    TCCR3B = (1<<WGM32) | (1<<CS32);    // CTC on OCR3A, clk/256
+    ETIFR = (1<<OCF3A);
+    ETIMSK |= (1<<OCIE3A);
+    depth_timer_running = 1;
+
+    CRITICAL_region_end();
+}
+
+void depth_acq_timer_stop(void) {
+    ETIMSK &= ~(1<<OCIE3A);
+    TCCR3B = 0;
+    depth_timer_running = 0;
+}
+
+unsigned int depth_acq_overruns(void) {
+    unsigned int overruns;
+
+    CRITICAL_region_begin();
+    overruns = depth_queue_overruns;
+    CRITICAL_region_end();
+    return overruns;
+}
+
+char depth_acq_pending(void) {
+    return depth_timer_running && depth_queue_tail != depth_queue_head;
+}
+
+/** Compensate the oldest sample queued by the timer ISR
+ *
+ *  @return 1 if the queued sample completed a new output
+ */
+static char depth_acq_queued(void) {
+    unsigned char tail = depth_queue_tail;
+    unsigned long time;
+
+    if (tail == depth_queue_head) {
+        return 0;
+    }
+
+    Datum_pressure = depth_queue[tail].d1;
+    Datum_temp = depth_queue[tail].d2;
+    temp_age = depth_queue[tail].temp_age;
+    time = depth_queue[tail].time;
+    depth_queue_tail = (tail + 1) & DEPTH_QUEUE_MASK;
+
+    return depth_compensate(time);
+}
+
+char depth_acq(void) {
+    static DEPTH_ACQ_STATE depth_acq_state = DEPTH_REQUEST_PRESSURE;
+    static unsigned long command_time;
+    static unsigned long pressure_time;
+    static char reading;    ///< a background read of the conversion is under way
+    char rval = 0;
+
+    if (depth_timer_running) {
+        return depth_acq_queued();
+    }
+    if (sensor_busy()) {
+        return 0;
+    }
+
+    switch (depth_acq_state) {
+        case DEPTH_REQUEST_PRESSURE:
+            if (sensor_start(0, SENSOR_PRESSURE)) {
+                command_time = get_time();
+                depth_acq_state = DEPTH_READ_PRESSURE;
+            }
+            break;
+
+        case DEPTH_READ_PRESSURE:
+            if (reading) {
+                /* the read is in and the next conversion started */
+                reading = 0;
+                Datum_pressure = sensor_result();
+                command_time = get_time();
+                if (temp_age + 1 >= temp_interval) {
+                    depth_acq_state = DEPTH_READ_TEMP;
+                } else {
+                    /* reuse the last D2 and go straight to the next pressure */
+                    temp_age++;
+                    rval = depth_compensate(pressure_time);
+                }
+            } else if (get_time() - command_time > SYS_CLK_MS_2_TICKS(SENSOR_CONVERSION_mS)) {
+                pressure_time = get_time();
+                reading = sensor_start(1, temp_age + 1 >= temp_interval ? SENSOR_TEMP
+                                                                        : SENSOR_PRESSURE);
+            }
+            break;
+
+        case DEPTH_READ_TEMP:
+            if (reading) {
+                reading = 0;
+                Datum_temp = sensor_result();
+                temp_age = 0;
+                rval = depth_compensate(pressure_time);
+                command_time = get_time();
+                depth_acq_state = DEPTH_READ_PRESSURE;
+            } else if (get_time() - command_time > SYS_CLK_MS_2_TICKS(SENSOR_CONVERSION_mS)) {
+                reading = sensor_start(1, SENSOR_PRESSURE);
+            }
+            break;
+
+        default:
+            depth_acq_state = DEPTH_REQUEST_PRESSURE;
+            break;
+    }
+
+    return rval;
+}
+
+float depth_psi(void) {
+    return mBAR_2_PSI((float)depth_sensor_std);
+}
+
+float water_temp_C(void) {
+    return temp_sensor_std / 10.0;
+}
+
+unsigned int depth_mpsi(void) {
+    return (unsigned int)mBAR_2_mPSI_INT(depth_sensor_std);
+}
+
+unsigned int depth_mBar(void) {
+    return (unsigned int)depth_sensor_std;
+}
+
+long depth_cmBar(void) {
+    return depth_sensor_cmBar;
+}
+
+unsigned int water_temp_cC(void) {
+    return (unsigned int)(temp_sensor_std * 10);
+}
+
+void depth_psi_and_temp(float *depth_psi, float *temp_c) {
+    long p, t;
+    sensor_raw_t d1 = depth_raw();
+    sensor_raw_t d2 = temp_raw();
+
+    sensor_compensate(&calibration, &p, &t, d1, d2);
+
+    *depth_psi = mBAR_2_PSI((float)p);
+    *temp_c = t / 10.0;
+}
+
+unsigned long depth_raw_last(void) {
+    return Datum_pressure;
+}
+
+unsigned long temp_raw_last(void) {
+    return Datum_temp;
+}
+
+void depth_set_temp_interval(unsigned char n) {
+    temp_interval = n ? n : 1;
+}
+
+unsigned char depth_get_temp_interval(void) {
+    return temp_interval;
+}
+
+unsigned char depth_temp_age(void) {
+    return temp_age;
+}
+
+char depth_set_oversample(unsigned char n) {
+    if (n < 1 || n > DEPTH_OVERSAMPLE_MAX) {
+        return 0;
+    }
+
+    oversample = n;
+    oversample_sum = 0;
+    oversample_cnt = 0;
+    sample_period = 0;
+    return 1;
+}
+
+unsigned char depth_get_oversample(void) {
+    return oversample;
+}
+
+char depth_set_filter(unsigned char median_len, unsigned char alpha, unsigned char beta) {
+    return filter_set(&depth_filter, median_len, alpha, beta);
+}
+
+unsigned char depth_filter_median(void) {
+    return depth_filter.median_len;
+}
+
+unsigned char depth_filter_alpha(void) {
+    return depth_filter.alpha;
+}
+
+unsigned char depth_filter_beta(void) {
+    return depth_filter.beta;
+}
+
+long depth_filtered_cmBar(void) {
+    return filter_depth_cmBar(&depth_filter);
+}
+
+long depth_rate_cmBar_s(void) {
+    return filter_rate_cmBar_s(&depth_filter);
+}
+
+char depth_set_zero_cmBar(long zero) {
+    if (zero < DEPTH_ZERO_MIN_cmBar || zero > DEPTH_ZERO_MAX_cmBar) {
+        return 0;
+    }
+    depth_zero = zero;
+    return 1;
+}
+
+long depth_zero_cmBar(void) {
+    return depth_zero;
+}
+
+long depth_gauge_cmBar(void) {
+    return depth_sensor_cmBar - depth_zero;
+}
+
+long depth_mm(void) {
+    return hydro_depth_mm(cmBAR_2_PA(depth_gauge_cmBar()));
+}
+
+unsigned long depth_sample_time(void) {
+    return sample_time;
+}
+
+unsigned int depth_sample_seq(void) {
+    return sample_seq;
+}
+
+unsigned long depth_sample_period(void) {
+    return sample_period;
+}
+
+unsigned long depth_conversion_time(void) {
+    return SYS_CLK_MS_2_TICKS(SENSOR_CONVERSION_mS);
+}
+
+unsigned int depth_sample_rate_cHz(void) {
+    if (sample_period == 0) {
+        return 0;
+    }
+    return (unsigned int)((100UL * SYS_CLK_MS_2_TICKS(1000) + sample_period / 2) / sample_period);
+}
+
+unsigned char depth_status(void) {
+    unsigned char status = 0;
+
+    if (depth_init_error) {
+        status |= DEPTH_STATUS_INIT_ERROR;
+    }
+    if (measure_reject_count) {
+        status |= DEPTH_STATUS_REJECTED;
+    }
+    return status;
+}
+
+unsigned int depth_reject_count(void) {
+    return reject_total;
+}
+
+unsigned int depth_read_errors(void) {
+    return read_errors;
+}
+
+unsigned int depth_calibration_crc(void) {
+    return calibration_crc;
+}
+
+void depth_cycle_times(unsigned long *min, unsigned long *max) {
+    *min = cycle_min;
+    *max = cycle_max;
+    cycle_min = 0;
+    cycle_max = 0;
+}
+
+const struct DepthConversion *depth_last_conversion(void) {
+    return &conversion;
+}
+
+unsigned char depth_calibration_words(uint16_t word[DEPTH_CAL_WORDS_MAX]) {
+    unsigned char i;
+
+    for (i = 0; i < DEPTH_CAL_WORDS_MAX; i++) {
+        word[i] = i < SENSOR_CAL_WORDS ? calibration_words[i] : 0;
+    }
+    return SENSOR_CAL_WORDS;
+}
+
+unsigned long depth_raw(void) {
+    return sensor_read_blocking(SENSOR_PRESSURE);
+}
+
+unsigned long temp_raw(void) {
+    return sensor_read_blocking(SENSOR_TEMP);
+}
@@ -13,6 +13,18 @@
 #include <sysclk.h>
 #include <depth.h>
 #include <spi.h>
+#include <nmea.h>
+#include <telemetry.h>
+#include <output.h>
+#include <filter.h>
+#include <sched.h>
+#include <command.h>
+#include <config.h>
+#include <hydro.h>
+#include <surface.h>
+#include <diag.h>
+#include <router.h>
+#include <fusion.h>
 
 #include <util/delay.h>
 
@@ -21,7 +33,6 @@
 #include <avr/wdt.h>
 #include <avr/eeprom.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 
 
@@ -32,7 +43,11 @@ void device_reset(void) {
 }
 
 
+static void settings_load(void);
+
 void system_init(void) {
+	diag_init();
+
     device_init();
 	
     led_init();
@@ -45,21 +60,574 @@ void system_init(void) {
 
 	depth_init();
 
+	hydro_init();
+
+	settings_load();
+
+	surface_init();
+
     interrupt_enable();
 	
 }
 
-//Sets the output rate
-const int OUTPUT_DELAY_mS = 500;
-char output[128];
+//Pressure conversions per temperature conversion, >1 trades temperature
+//updates for pressure sample rate
+const unsigned char TEMP_INTERVAL = 1;
+//Set to 1 to read the depth sensor from the Timer 3 interrupt instead of
+//polling it from the main loop
+const char ACQ_TIMER_DRIVEN = 1;
+//Output format, rate, checksum and mode of each port are kept by the
+//router (router.h), settable at runtime with $PVRSR, $PVRFM and $PVRPT.
+//Command replies follow the tether checksum setting.
+#define TETHER_CHECKSUM (router_ports[COMM_PORT_TETHER].checksum)
+
+//Tether command parser
+struct CommandParser command_parser;
+//Received bytes parsed per pass of the main loop, bounds the time taken
+//from acquisition and output
+#define COMMAND_BYTES_PER_PASS 16
+//System time the command being executed was parsed, for $PVRTS
+unsigned long command_time;
+//Seconds between $PVRST status sentences, 0 for none, settable with $PVRST
+unsigned char status_period_s = 0;
+unsigned long status_time;
+
+/***
+ * Gather the current settings into a record for the eeprom
+ **/
+static void settings_collect(struct Config *cfg) {
+	struct RouterPort *tether = &router_ports[COMM_PORT_TETHER];
+	struct RouterPort *accessory = &router_ports[COMM_PORT_ACCESSORY];
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->zero_cmBar = depth_zero_cmBar();
+	cfg->tether_baudrate = tether->baudrate;
+	cfg->accessory_baudrate = accessory->baudrate;
+	cfg->output_period_mS = tether->schedule.period_mS;
+	cfg->output_threshold_mBar = tether->schedule.threshold_mBar;
+	cfg->accessory_period_mS = accessory->schedule.period_mS;
+	cfg->accessory_threshold_mBar = accessory->schedule.threshold_mBar;
+	cfg->fluid_density_kgm3 = hydro_density();
+	cfg->output_mode = tether->schedule.mode;
+	cfg->output_format = tether->format;
+	cfg->output_checksum = tether->checksum;
+	cfg->output_filtered = router_filtered;
+	cfg->filter_median = depth_filter_median();
+	cfg->filter_alpha = depth_filter_alpha();
+	cfg->filter_beta = depth_filter_beta();
+	cfg->oversample = depth_get_oversample();
+	cfg->latitude_deg = hydro_latitude();
+	cfg->auto_zero = surface_enabled();
+	cfg->tether_rs485 = tether->rs485;
+	cfg->accessory_enabled = accessory->enabled;
+	cfg->accessory_mode = accessory->schedule.mode;
+	cfg->accessory_format = accessory->format;
+	cfg->accessory_checksum = accessory->checksum;
+	cfg->accessory_rs485 = accessory->rs485;
+	cfg->fusion_enabled = fusion_enabled();
+	cfg->analog_zero = fusion_transducer_zero();
+	cfg->analog_span = fusion_transducer_span();
+	cfg->analog_span_mBar = fusion_transducer_span_mBar();
+}
+
+/***
+ * Apply a stored record, a setting out of range keeps its default
+ **/
+static void settings_apply(const struct Config *cfg) {
+	struct RouterPort *tether = &router_ports[COMM_PORT_TETHER];
+	struct RouterPort *accessory = &router_ports[COMM_PORT_ACCESSORY];
+
+	depth_set_zero_cmBar(cfg->zero_cmBar);
+	if (router_baudrate_valid(cfg->tether_baudrate)) {
+		tether->baudrate = cfg->tether_baudrate;
+	}
+	if (router_baudrate_valid(cfg->accessory_baudrate)) {
+		accessory->baudrate = cfg->accessory_baudrate;
+	}
+	output_sched_set(&tether->schedule, cfg->output_mode,
+	                 cfg->output_period_mS, cfg->output_threshold_mBar);
+	output_sched_set(&accessory->schedule, cfg->accessory_mode,
+	                 cfg->accessory_period_mS, cfg->accessory_threshold_mBar);
+	hydro_set_density(cfg->fluid_density_kgm3);
+	hydro_set_latitude(cfg->latitude_deg);
+	if (cfg->output_format <= OUTPUT_FORMAT_FUSED) {
+		tether->format = cfg->output_format;
+	}
+	if (cfg->accessory_format <= OUTPUT_FORMAT_FUSED) {
+		accessory->format = cfg->accessory_format;
+	}
+	tether->checksum = cfg->output_checksum != 0;
+	tether->rs485 = cfg->tether_rs485 != 0;
+	accessory->enabled = cfg->accessory_enabled != 0;
+	accessory->checksum = cfg->accessory_checksum != 0;
+	accessory->rs485 = cfg->accessory_rs485 != 0;
+	router_filtered = cfg->output_filtered != 0;
+	depth_set_filter(cfg->filter_median, cfg->filter_alpha, cfg->filter_beta);
+	depth_set_oversample(cfg->oversample);
+	surface_enable(cfg->auto_zero != 0);
+	fusion_set_transducer(cfg->analog_zero, cfg->analog_span, cfg->analog_span_mBar);
+	fusion_enable(cfg->fusion_enabled != 0);
+}
+
+/***
+ * Set the defaults, then override them with the eeprom record if there is one
+ **/
+static void settings_load(void) {
+	struct Config cfg;
+
+	router_init();
+	/* fields a record from an older firmware lacks keep the defaults */
+	settings_collect(&cfg);
+	if (config_load(&cfg)) {
+		settings_apply(&cfg);
+	}
+}
+
+/***
+ * Queue the current settings for the eeprom, written in the background
+ **/
+static void settings_save(void) {
+	struct Config cfg;
+
+	settings_collect(&cfg);
+	config_save(&cfg, get_time());
+}
+
+/***
+ * Port a command applies to, given by field n
+ * @return the port, the tether if the field is empty, -1 if there is no
+ * such port
+ **/
+static int command_port(const struct CommandLine *line, unsigned char n) {
+	if (!COMMAND_HAS(line, n)) {
+		return COMM_PORT_TETHER;
+	}
+	if (line->field[n] < 0 || line->field[n] >= MAX_UARTS) {
+		return -1;
+	}
+	return line->field[n];
+}
+
+/***
+ * Echo the port field of a command if it was given
+ **/
+static void command_echo_port(struct NmeaSentence *sentence, const struct CommandLine *line,
+                              unsigned char n) {
+	if (COMMAND_HAS(line, n)) {
+		nmea_field_int(sentence, line->field[n]);
+	}
+}
+
+/***
+ * Output rate command
+ * The format is: "$PVRSR,M,PP,TT,P\r\n"
+ * Where M is the mode (0 every sample, 1 periodic, 2 on change), PP the
+ * period in mS, TT the change threshold in mBar and P the port (0 tether,
+ * the default, 1 accessory).  The current settings are echoed back in the
+ * same format.
+ **/
+static char command_rate(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	int port = command_port(line, 3);
+	struct OutputSchedule *schedule;
+	long mode, period, threshold;
+
+	if (port < 0) {
+		return 0;
+	}
+	schedule = &router_ports[port].schedule;
+	mode = COMMAND_HAS(line, 0) ? line->field[0] : schedule->mode;
+	period = COMMAND_HAS(line, 1) ? line->field[1] : schedule->period_mS;
+	threshold = COMMAND_HAS(line, 2) ? line->field[2] : schedule->threshold_mBar;
+
+	if (mode < 0 || period < 0 || period > 0xFFFF || threshold < 0 || threshold > 0xFFFF ||
+	    !output_sched_set(schedule, mode, period, threshold)) {
+		return 0;
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRSR", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, schedule->mode);
+	nmea_field_int(&sentence, schedule->period_mS);
+	nmea_field_int(&sentence, schedule->threshold_mBar);
+	command_echo_port(&sentence, line, 3);
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Output format command
+ * The format is: "$PVRFM,F,C,P\r\n"
+ * Where F is the format (0 $PVRDT sentences, 1 binary telemetry frames, 2
+ * raw capture of every conversion, 3 $PVRDX fused samples, see fusion.h),
+ * C enables the NMEA checksum on sentences
+ * (0/1) and P is the port as for $PVRSR.  The current settings are echoed
+ * back in the same format.
+ **/
+static char command_format(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	int port = command_port(line, 2);
+	long format, checksum;
+
+	if (port < 0) {
+		return 0;
+	}
+	format = COMMAND_HAS(line, 0) ? line->field[0] : router_ports[port].format;
+	checksum = COMMAND_HAS(line, 1) ? line->field[1] : router_ports[port].checksum;
+	if (format < OUTPUT_FORMAT_ASCII || format > OUTPUT_FORMAT_FUSED ||
+	    checksum < 0 || checksum > 1) {
+		return 0;
+	}
+	router_ports[port].format = format;
+	router_ports[port].checksum = checksum;
+
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRFM", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, router_ports[port].format);
+	nmea_field_int(&sentence, router_ports[port].checksum);
+	command_echo_port(&sentence, line, 2);
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Port command
+ * The format is: "$PVRPT,P,E,R\r\n"
+ * Where P is the port (0 tether, 1 accessory), E publishes samples on it
+ * (0/1) and R selects RS-485 (1) or RS-232 (0).  The settings of the port
+ * are echoed back in the same format.
+ **/
+static char command_port_mode(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	int port = COMMAND_HAS(line, 0) ? command_port(line, 0) : -1;
+	long enable, rs485;
+
+	if (port < 0) {
+		return 0;
+	}
+	enable = COMMAND_HAS(line, 1) ? line->field[1] : router_ports[port].enabled;
+	rs485 = COMMAND_HAS(line, 2) ? line->field[2] : router_ports[port].rs485;
+	if (enable < 0 || enable > 1 || rs485 < 0 || rs485 > 1) {
+		return 0;
+	}
+	router_ports[port].enabled = enable;
+	if (rs485 != router_ports[port].rs485) {
+		router_set_rs485(port, rs485);
+	}
+
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRPT", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, port);
+	nmea_field_int(&sentence, router_ports[port].enabled);
+	nmea_field_int(&sentence, router_ports[port].rs485);
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Filter command
+ * The format is: "$PVRFL,E,N,A,B\r\n"
+ * Where E enables the $PVRDF output (0/1), N is the running median length
+ * (1, 3 or 5), A and B the alpha-beta gains in 1/256.  The current settings
+ * are echoed back in the same format.
+ **/
+static char command_filter(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	long enable = COMMAND_HAS(line, 0) ? line->field[0] : router_filtered;
+	long median = COMMAND_HAS(line, 1) ? line->field[1] : depth_filter_median();
+	long alpha = COMMAND_HAS(line, 2) ? line->field[2] : depth_filter_alpha();
+	long beta = COMMAND_HAS(line, 3) ? line->field[3] : depth_filter_beta();
+
+	if (enable < 0 || enable > 1 || median < 0 || median > FILTER_MEDIAN_MAX ||
+	    alpha < 0 || alpha > 255 || beta < 0 || beta > 255 ||
+	    !depth_set_filter(median, alpha, beta)) {
+		return 0;
+	}
+	router_filtered = enable;
+
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRFL", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, router_filtered);
+	nmea_field_int(&sentence, depth_filter_median());
+	nmea_field_int(&sentence, depth_filter_alpha());
+	nmea_field_int(&sentence, depth_filter_beta());
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Oversampling command
+ * The format is: "$PVROS,N\r\n"
+ * Where N is the number of pressure conversions averaged per sample (1-64).
+ * The echo "$PVROS,N,RR\r\n" adds the effective sample rate RR in Hz/100,
+ * measured, so it settles a few samples after a change.
+ **/
+static char command_oversample(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+
+	if (COMMAND_HAS(line, 0) &&
+	    (line->field[0] < 1 || line->field[0] > DEPTH_OVERSAMPLE_MAX ||
+	     !depth_set_oversample(line->field[0]))) {
+		return 0;
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVROS", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, depth_get_oversample());
+	nmea_field_int(&sentence, depth_sample_rate_cHz());
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Baudrate command
+ * The format is: "$PVRBR,B,P\r\n"
+ * Where B is the baudrate (9600, 19200, 38400, 57600 or 115200) and P the
+ * port as for $PVRSR.  The echo is sent at the old rate, the new one
+ * applies after it.
+ **/
+static char command_baud(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	int port = command_port(line, 1);
+
+	if (port < 0 ||
+	    (COMMAND_HAS(line, 0) && !router_set_baudrate(port, line->field[0]))) {
+		return 0;
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRBR", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, router_ports[port].baudrate);
+	command_echo_port(&sentence, line, 1);
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Zero offset command
+ * The format is: "$PVRZO,Z\r\n"
+ * Where Z is the surface reference pressure in mBar/100, or 0 to take the
+ * current pressure as the surface.  The reference in use is echoed back.
+ **/
+static char command_zero(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+
+	if (COMMAND_HAS(line, 0) &&
+	    !depth_set_zero_cmBar(line->field[0] ? line->field[0] : depth_cmBar())) {
+		return 0;
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRZO", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, depth_zero_cmBar());
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Fluid command
+ * The format is: "$PVRDN,D,L\r\n"
+ * Where D is the density of the water in kg/m^3 (900-1100), or 0 for fresh
+ * and 1 for salt water, and L the latitude in degrees for the gravity.
+ * The settings in use are echoed back in the same format.
+ **/
+static char command_fluid(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	long density = COMMAND_HAS(line, 0) ? line->field[0] : hydro_density();
+	long latitude = COMMAND_HAS(line, 1) ? line->field[1] : hydro_latitude();
+
+	if (density == 0) {
+		density = HYDRO_DENSITY_FRESH;
+	} else if (density == 1) {
+		density = HYDRO_DENSITY_SALT;
+	}
+	if (density < HYDRO_DENSITY_MIN || density > HYDRO_DENSITY_MAX ||
+	    latitude < -90 || latitude > 90) {
+		return 0;
+	}
+	hydro_set_density(density);
+	hydro_set_latitude(latitude);
+
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRDN", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, hydro_density());
+	nmea_field_int(&sentence, hydro_latitude());
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Automatic zero command
+ * The format is: "$PVRAZ,E\r\n"
+ * Where E is 1 to track the surface reference automatically (see surface.h)
+ * and 0, the default, to keep it fixed.  Echoed back as "$PVRAZ,E,S,Z\r\n" with S 1 while
+ * the surface is detected and Z the reference in use in mBar/100.
+ **/
+static char command_auto_zero(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+
+	if (COMMAND_HAS(line, 0)) {
+		if (line->field[0] != 0 && line->field[0] != 1) {
+			return 0;
+		}
+		surface_enable(line->field[0]);
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRAZ", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, surface_enabled());
+	nmea_field_int(&sentence, surface_detected());
+	nmea_field_int(&sentence, depth_zero_cmBar());
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Time sync command
+ * The format is: "$PVRTS,H\r\n"
+ * Where H is any integer from the host, typically its own clock.  Answered
+ * with "$PVRTS,H,R,T,B\r\n" where R is the node time in mS the command was
+ * received, T the node time in mS the answer was queued and B the bytes
+ * queued ahead of it on the tether.  The node time is the 24 MSb of
+ * get_time(), the same clock as the sample times, and wraps every 2^24 mS.
+ *
+ * With H sent at host time t0 and the answer received at t3, the answer
+ * leaves the node at about T + B * 10 / baudrate, so
+ *   offset  = (R - t0 + T' - t3) / 2
+ *   latency = (t3 - t0 - (T' - R)) / 2
+ * with T' = T + B * 10 / baudrate, and node time = host time + offset.
+ **/
+static char command_time_sync(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	int backlog = uart_tx_cnt(COMM_PORT_TETHER);
+
+	if (!COMMAND_HAS(line, 0)) {
+		return 0;
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRTS", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, line->field[0]);
+	nmea_field_int(&sentence, command_time >> 8);
+	nmea_field_int(&sentence, get_time() >> 8);
+	nmea_field_int(&sentence, backlog);
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Status command
+ * The format is: "$PVRST,P\r\n"
+ * Where P is the period of the status sentence in seconds, 0 to only send
+ * it on request.  Answered with the status sentence, see diag.h.
+ **/
+static char command_status(const struct CommandLine *line) {
+	if (COMMAND_HAS(line, 0)) {
+		if (line->field[0] < 0 || line->field[0] > 255) {
+			return 0;
+		}
+		status_period_s = line->field[0];
+	}
+	status_time = get_time();
+	diag_write_status(COMM_PORT_TETHER, TETHER_CHECKSUM);
+	return 1;
+}
+
+/***
+ * Fusion command
+ * The format is: "$PVRFU,E\r\n"
+ * Where E is 1 to cross-check the depth sensor against the analog pressure
+ * channel and fill in between its samples (see fusion.h), 0 to turn the
+ * ADC off.  Setting 1 again restarts the cross-check.  Echoed back as
+ * "$PVRFU,E,ST,BB,DC,SC\r\n" with ST the status bits, BB the bias of the
+ * analog channel in mBar/100, DC the disagreements flagged since startup
+ * and SC the span correction in 0.01 %.  Nothing is fused until the
+ * transducer is set with $PVRAT.
+ **/
+static char command_fusion(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+
+	if (COMMAND_HAS(line, 0)) {
+		if (line->field[0] != 0 && line->field[0] != 1) {
+			return 0;
+		}
+		fusion_enable(line->field[0]);
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRFU", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, fusion_enabled());
+	nmea_field_int(&sentence, fusion_status());
+	nmea_field_int(&sentence, fusion_bias_cmBar());
+	nmea_field_int(&sentence, fusion_disagree_count());
+	nmea_field_int(&sentence, fusion_span_correction());
+	nmea_end(&sentence);
+	return 1;
+}
+
+/***
+ * Analog transducer command
+ * The format is: "$PVRAT,Z,S,P\r\n"
+ * Where Z is the reading of the transducer on the analog pressure channel
+ * at 0 mBar absolute in counts of the 10 bit ADC, S the counts from Z to
+ * the pressure P in mBar, from the data sheet or a calibration of the part
+ * fitted.  S 0 clears the setting, which keeps the cross-check of $PVRFU
+ * off.  Setting it restarts the cross-check.  The setting is echoed back in
+ * the same format.
+ **/
+static char command_transducer(const struct CommandLine *line) {
+	struct NmeaSentence sentence;
+	long zero = COMMAND_HAS(line, 0) ? line->field[0] : fusion_transducer_zero();
+	long span = COMMAND_HAS(line, 1) ? line->field[1] : fusion_transducer_span();
+	long span_mBar = COMMAND_HAS(line, 2) ? line->field[2] : fusion_transducer_span_mBar();
+
+	if (COMMAND_HAS(line, 0) || COMMAND_HAS(line, 1) || COMMAND_HAS(line, 2)) {
+		if (zero < 0 || zero > 1023 || span < 0 || span > 1023 ||
+		    span_mBar < 0 || span_mBar > 0xFFFF ||
+		    !fusion_set_transducer(zero, span, span_mBar)) {
+			return 0;
+		}
+	}
+	nmea_begin(&sentence, COMM_PORT_TETHER, "PVRAT", TETHER_CHECKSUM);
+	nmea_field_int(&sentence, fusion_transducer_zero());
+	nmea_field_int(&sentence, fusion_transducer_span());
+	nmea_field_int(&sentence, fusion_transducer_span_mBar());
+	nmea_end(&sentence);
+	return 1;
+}
+
+static const struct Command commands[] = {
+	{ "PVRSR", command_rate },
+	{ "PVRFM", command_format },
+	{ "PVRFL", command_filter },
+	{ "PVROS", command_oversample },
+	{ "PVRBR", command_baud },
+	{ "PVRPT", command_port_mode },
+	{ "PVRZO", command_zero },
+	{ "PVRDN", command_fluid },
+	{ "PVRAZ", command_auto_zero },
+	{ "PVRTS", command_time_sync },
+	{ "PVRST", command_status },
+	{ "PVRFU", command_fusion },
+	{ "PVRAT", command_transducer },
+};
+
+/***
+ * Parse tether bytes and execute complete commands, at most
+ * COMMAND_BYTES_PER_PASS bytes and one command per call
+ **/
+static void command_service(void) {
+	unsigned char budget = COMMAND_BYTES_PER_PASS;
+	char result;
+
+	while (budget-- && uart_rx_cnt(COMM_PORT_TETHER)) {
+		result = command_parse(&command_parser, uart_read_byte(COMM_PORT_TETHER));
+		if (result == COMMAND_PENDING) {
+			continue;
+		}
+		if (result == COMMAND_LINE) {
+			command_time = get_time();
+			result = command_dispatch(commands, sizeof(commands) / sizeof(commands[0]),
+			                          &command_parser.line);
+		}
+		if (result == COMMAND_ACK) {
+			settings_save();
+		} else {
+			command_nak(COMM_PORT_TETHER, &command_parser.line, result, TETHER_CHECKSUM);
+		}
+		break;
+	}
+}
 
 int main(void) {
-	unsigned long last_second = 0;
+	char new_sample;
 
 	//Setup everything
     system_init();
 
- 	uart_set_baudrate(COMM_PORT_TETHER,115200);
+ 	router_start();
 
     wdt_enable(WDTO_500MS);
 
@@ -67,24 +635,43 @@ int main(void) {
 	_delay_ms(250);
 	led(0);
 
-    for(;;) {  //spin forever, service the wdt, read the sensor, and output at some fixed rate
+	depth_set_temp_interval(TEMP_INTERVAL);
+	if (ACQ_TIMER_DRIVEN) {
+		depth_acq_timer_start();
+	}
+	command_init(&command_parser);
+	sched_init();
+
+    for(;;) {  //read the sensor, output as scheduled, then sleep until the next event
 
-	   wdt_reset();
+	   new_sample = depth_acq();
 
-	   depth_acq();
+	   //cross-check against the analog channel and fill in from it, off
+	   //unless enabled with $PVRFU
+	   fusion_acq(new_sample);
+
+	   if (new_sample && surface_update(depth_cmBar(), depth_sample_time())) {
+		   settings_save();
+	   }
+
+	   command_service();
+
+	   config_service(get_time());
 	   
-	   /***
-  	    * Output the data sentence
-	    * Here we use an nmea like sentence
-	    * VRDT (videoray depth temp)
-	    * The format is: "$PVRDT, DD, TT\r\n"
-		* Where DD is the pressure in mBar and TT is the temp in Deg C/100
-        **/
-  	    if (get_time()-last_second>SYS_CLK_MS_2_TICKS(OUTPUT_DELAY_mS)) {
-		   last_second = get_time();
-		   sprintf(output,"$PVRDT,%d, %d\r\n",depth_mBar(), water_temp_cC()); 
-		   uart_write(COMM_PORT_TETHER,output,strlen(output));
-		}
+	   router_service();
+
+	   //publish on every port as scheduled, formats are described in router.h
+	   router_publish(new_sample, get_time());
+
+	   if (status_period_s &&
+		   get_time() - status_time >= SYS_CLK_MS_2_TICKS(1000UL * status_period_s) &&
+		   uart_tx_free(COMM_PORT_TETHER) >= DIAG_STATUS_MAX_LEN) {
+		   status_time = get_time();
+		   diag_write_status(COMM_PORT_TETHER, TETHER_CHECKSUM);
+	   }
+
+	   //services the wdt, wakes on the sysclk tick, a uart byte or a new sample
+	   sched_idle();
 	}
 }
 
@@ -0,0 +1,49 @@
+/** @file   diag.c
+ *  @brief  Health diagnostics and the $PVRST status sentence
+ */
+
+#include <device.h>
+#include <diag.h>
+#include <depth.h>
+#include <fusion.h>
+#include <nmea.h>
+#include <sched.h>
+#include <uart.h>
+
+static unsigned char reset_cause;
+
+void diag_init(void) {
+    reset_cause = MCUCSR;
+    MCUCSR = 0;
+}
+
+unsigned char diag_reset_cause(void) {
+    return reset_cause;
+}
+
+void diag_write_status(int port, char use_checksum) {
+    struct NmeaSentence sentence;
+    struct UART_Stats stats;
+    unsigned long cycle_min, cycle_max;
+
+    depth_cycle_times(&cycle_min, &cycle_max);
+    uart_get_stats(port, &stats);
+
+    nmea_begin(&sentence, port, "PVRST", use_checksum);
+    nmea_field_int(&sentence, reset_cause);
+    nmea_field_int(&sentence, !(depth_status() & DEPTH_STATUS_INIT_ERROR));
+    nmea_field_int(&sentence, depth_calibration_crc());
+    nmea_field_int(&sentence, depth_reject_count());
+    nmea_field_int(&sentence, depth_read_errors());
+    nmea_field_int(&sentence, depth_acq_overruns());
+    nmea_field_int(&sentence, cycle_min >> 8);
+    nmea_field_int(&sentence, depth_sample_period() >> 8);
+    nmea_field_int(&sentence, cycle_max >> 8);
+    nmea_field_int(&sentence, stats.tx_dropped);
+    nmea_field_int(&sentence, stats.rx_errors);
+    nmea_field_int(&sentence, stats.rx_dropped);
+    nmea_field_int(&sentence, uart_get_last_error(port));
+    nmea_field_int(&sentence, sched_idle_percent());
+    nmea_field_int(&sentence, fusion_status());
+    nmea_end(&sentence);
+}
@@ -0,0 +1,104 @@
+/** @file   filter.c
+ *  @brief  Integer depth filter: running median followed by an alpha-beta tracker
+ */
+
+#include <filter.h>
+
+#include <stdlib.h>
+
+void filter_init(struct DepthFilter *f, unsigned char median_len,
+                 unsigned char alpha, unsigned char beta) {
+    f->median_len = FILTER_DEFAULT_MEDIAN;
+    f->alpha = FILTER_DEFAULT_ALPHA;
+    f->beta = FILTER_DEFAULT_BETA;
+
+    filter_set(f, median_len, alpha, beta);
+    filter_reset(f);
+}
+
+char filter_set(struct DepthFilter *f, unsigned char median_len,
+                unsigned char alpha, unsigned char beta) {
+    if (median_len > FILTER_MEDIAN_MAX || !(median_len & 1)) {
+        return 0;
+    }
+
+    f->median_len = median_len;
+    f->alpha = alpha;
+    f->beta = beta;
+    filter_reset(f);
+    return 1;
+}
+
+void filter_reset(struct DepthFilter *f) {
+    f->count = 0;
+    f->next = 0;
+    f->rate = 0;
+}
+
+/** Median of the window, insertion sort of at most FILTER_MEDIAN_MAX values */
+static long filter_median(struct DepthFilter *f) {
+    long sorted[FILTER_MEDIAN_MAX];
+    long v;
+    unsigned char i, j;
+
+    for (i = 0; i < f->count; i++) {
+        v = f->window[i];
+        for (j = i; j > 0 && sorted[j - 1] > v; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+    return sorted[f->count >> 1];
+}
+
+void filter_update(struct DepthFilter *f, long depth_cmBar, unsigned int dt_mS) {
+    long measured, residual;
+    unsigned int alpha = f->alpha ? f->alpha : 256;
+
+    f->window[f->next] = depth_cmBar;
+    if (++f->next >= f->median_len) {
+        f->next = 0;
+    }
+    if (f->count < f->median_len) {
+        f->count++;
+    }
+    measured = filter_median(f) << FILTER_FRAC_BITS;
+
+    if (dt_mS == 0) {
+        dt_mS = 1;
+    }
+    if (f->count == 1 || dt_mS > FILTER_MAX_DT_mS) {
+        f->depth = measured;
+        f->rate = 0;
+        return;
+    }
+
+    f->depth += f->rate * (long)dt_mS / 1000;
+    residual = measured - f->depth;
+    if (labs(residual) > (FILTER_RESYNC_cmBar << FILTER_FRAC_BITS)) {
+        f->depth = measured;
+        f->rate = 0;
+        return;
+    }
+
+    f->depth += (alpha * residual) >> 8;
+    f->rate += ((f->beta * residual) >> 8) * 1000L / dt_mS;
+    if (f->rate > (FILTER_MAX_RATE_cmBar_s << FILTER_FRAC_BITS)) {
+        f->rate = FILTER_MAX_RATE_cmBar_s << FILTER_FRAC_BITS;
+    } else if (f->rate < -(FILTER_MAX_RATE_cmBar_s << FILTER_FRAC_BITS)) {
+        f->rate = -(FILTER_MAX_RATE_cmBar_s << FILTER_FRAC_BITS);
+    }
+}
+
+/** Drop the fraction bits, rounding to nearest */
+static long filter_round(long v) {
+    return (v + (1L << (FILTER_FRAC_BITS - 1))) >> FILTER_FRAC_BITS;
+}
+
+long filter_depth_cmBar(const struct DepthFilter *f) {
+    return filter_round(f->depth);
+}
+
+long filter_rate_cmBar_s(const struct DepthFilter *f) {
+    return filter_round(f->rate);
+}
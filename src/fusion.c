@@ -0,0 +1,321 @@
+/** @file   fusion.c
+ *  @brief  Cross-check of the depth sensor against the analog pressure
+ *          channel
+ */
+
+#include <device.h>
+#include <fusion.h>
+#include <adc.h>
+#include <depth.h>
+#include <sysclk.h>
+
+#include <stdlib.h>
+
+/** Top of the range of a working transducer, as an ADC sample */
+#define FUSION_ANALOG_MAX  ((uint16_t)ADC_DECIMATION * 1020)
+
+/** Analog samples kept to find the one taken with a depth sample, whose
+ *  conversion is centred about 20 mS before it comes in.  A power of 2 */
+#define FUSION_HISTORY     8
+
+static char enabled;
+static unsigned char status = FUSION_STATUS_UNLOCKED | FUSION_STATUS_UNSET;
+
+/** @name Transducer set, scale_q8 is 0 while unset */
+//@{
+static uint16_t transducer_zero;
+static uint16_t transducer_span;
+static uint16_t transducer_span_mBar;
+static long scale_q8;               ///< mBar/100 per count of an ADC sample, 8 fraction bits
+static uint16_t analog_min;         ///< bottom of the range of a working transducer
+static long span_range_counts;      ///< FUSION_SPAN_RANGE_cmBar in counts of an ADC sample
+//@}
+
+/** Recent analog samples in counts from the zero and their times, the
+ *  newest before history_head, none while history_len is 0 */
+static long history_counts[FUSION_HISTORY];
+static unsigned long history_time[FUSION_HISTORY];
+static unsigned char history_head;
+static unsigned char history_len;
+
+/** Latest analog pressure with the span correction, without the bias */
+static long analog_cmBar;
+
+/** Bias with FUSION_BIAS_SHIFT fraction bits, and rounded down */
+static long bias_frac;
+static long bias;
+
+/** Span correction in mBar/100 per count with 8 fraction bits, applied to
+ *  the counts from pivot_counts where the bias was first set.  With
+ *  FUSION_SPAN_SHIFT more fraction bits, and rounded down */
+static long pivot_counts;
+static long span_frac;
+static long span;
+
+static unsigned char disagree_run;
+static unsigned int disagree_total;
+
+static long fused_cmBar;
+static unsigned long fused_time;
+static unsigned long fused_age;
+static unsigned int fused_seq;
+
+void fusion_enable(char on) {
+    enabled = on;
+    status = FUSION_STATUS_UNLOCKED;
+    history_len = 0;
+    disagree_run = 0;
+    span_frac = 0;
+    span = 0;
+    if (!scale_q8) {
+        status |= FUSION_STATUS_UNSET;
+    }
+    if (on && scale_q8) {
+        adc_start(ADC_PRESSURE);
+    } else {
+        adc_stop();
+    }
+}
+
+char fusion_enabled(void) {
+    return enabled;
+}
+
+char fusion_set_transducer(uint16_t zero, uint16_t span_counts, uint16_t span_mBar) {
+    if (span_counts == 0) {
+        zero = 0;
+        span_mBar = 0;
+        scale_q8 = 0;
+    } else {
+        if (span_counts < FUSION_SPAN_MIN_COUNTS || (long)zero + span_counts > 1023 ||
+            span_mBar < (long)FUSION_SCALE_MIN_mBar * span_counts ||
+            span_mBar > (long)FUSION_SCALE_MAX_mBar * span_counts) {
+            return 0;
+        }
+        scale_q8 = ((unsigned long)span_mBar * 100 * 256 +
+                    (unsigned long)span_counts * ADC_DECIMATION / 2) /
+                   ((unsigned long)span_counts * ADC_DECIMATION);
+        span_range_counts = ((FUSION_SPAN_RANGE_cmBar << 8) + scale_q8 - 1) / scale_q8;
+    }
+    transducer_zero = zero;
+    transducer_span = span_counts;
+    transducer_span_mBar = span_mBar;
+    /* an open or shorted input reads well below half the zero */
+    analog_min = (uint16_t)ADC_DECIMATION * (zero / 2);
+
+    fusion_enable(enabled);
+    return 1;
+}
+
+uint16_t fusion_transducer_zero(void) {
+    return transducer_zero;
+}
+
+uint16_t fusion_transducer_span(void) {
+    return transducer_span;
+}
+
+uint16_t fusion_transducer_span_mBar(void) {
+    return transducer_span_mBar;
+}
+
+/** @return Pressure of an analog sample with the span correction, without
+ *          the bias
+ *  @param counts sample in counts from the zero */
+static long fusion_scale(long counts) {
+    return ((counts * scale_q8) >> 8) + (((counts - pivot_counts) * span) >> 8);
+}
+
+/** @return The kept analog sample taken nearest to a time, in counts from
+ *          the zero, the oldest if all are newer */
+static long fusion_analog_at(unsigned long time) {
+    unsigned char i = history_head;
+    unsigned char n;
+    long counts = 0;
+    long d, best = 0;
+
+    for (n = 0; n < history_len; n++) {
+        i = (i - 1) & (FUSION_HISTORY - 1);
+        d = labs((long)(history_time[i] - time));
+        if (n && d >= best) {
+            break;
+        }
+        counts = history_counts[i];
+        best = d;
+    }
+    return counts;
+}
+
+/** Scale an analog sample, check its range and fill in between depth
+ *  samples
+ *
+ *  @return 1 if the sample made a fused one
+ */
+static char fusion_analog(const struct AdcSample *sample) {
+    long counts;
+
+    if (sample->sum < analog_min || sample->sum > FUSION_ANALOG_MAX) {
+        status |= FUSION_STATUS_ANALOG;
+        history_len = 0;
+        return 0;
+    }
+    status &= ~FUSION_STATUS_ANALOG;
+    counts = (long)sample->sum - (long)transducer_zero * ADC_DECIMATION;
+    analog_cmBar = fusion_scale(counts);
+    history_counts[history_head] = counts;
+    history_time[history_head] = sample->time;
+    history_head = (history_head + 1) & (FUSION_HISTORY - 1);
+    if (history_len < FUSION_HISTORY) {
+        history_len++;
+    }
+
+    if (status & (FUSION_STATUS_UNLOCKED | FUSION_STATUS_DISAGREE)) {
+        return 0;
+    }
+    fused_cmBar = analog_cmBar + bias;
+    return 1;
+}
+
+/** Track the bias and the span from the difference left on a depth sample
+ *
+ *  Beyond FUSION_SPAN_RANGE_cmBar from the pivot the difference goes to the
+ *  span, divided by the distance so the step is the same at every depth.
+ *  Nearer it is shared with the square of the distance as the weight: the
+ *  noise of the analog sample moves the distance and the difference alike,
+ *  and would walk the span off next to the pivot where nothing pulls it
+ *  back.  The steps are rounded towards zero for the same reason.
+ */
+static void fusion_track(long err, long counts) {
+    long limit = (scale_q8 >> 3) << FUSION_SPAN_SHIFT;
+    long weight;
+
+    if (labs(counts) >= span_range_counts) {
+        span_frac += (err << 8) / counts;
+    } else {
+        /* square of the distance against the range, 8 fraction bits */
+        weight = (labs(counts) << 8) / span_range_counts;
+        weight = (weight * weight) >> 8;
+        bias_frac += err - err * weight / 256;
+        bias = bias_frac >> FUSION_BIAS_SHIFT;
+        if (counts) {
+            span_frac += (err << 8) / counts * weight / 256;
+        }
+    }
+    if (span_frac > limit) {
+        span_frac = limit;
+    } else if (span_frac < -limit) {
+        span_frac = -limit;
+    }
+    span = span_frac >> FUSION_SPAN_SHIFT;
+}
+
+/** Compare a depth sample with the analog one taken with it and track the
+ *  bias and span
+ *
+ *  @param time middle of the pressure conversion of the depth sample
+ */
+static void fusion_digital(long depth_cmBar, unsigned long time) {
+    long counts = fusion_analog_at(time);
+    long residual = depth_cmBar - fusion_scale(counts);
+    long err;
+
+    if (status & FUSION_STATUS_UNLOCKED) {
+        bias_frac = residual << FUSION_BIAS_SHIFT;
+        bias = residual;
+        pivot_counts = counts;
+        status &= ~FUSION_STATUS_UNLOCKED;
+    } else {
+        err = residual - bias;
+        if (labs(err) > FUSION_DISAGREE_cmBar) {
+            if (disagree_run < FUSION_DISAGREE_COUNT &&
+                ++disagree_run == FUSION_DISAGREE_COUNT) {
+                status |= FUSION_STATUS_DISAGREE;
+                disagree_total++;
+            }
+        } else {
+            disagree_run = 0;
+            status &= ~FUSION_STATUS_DISAGREE;
+            fusion_track(err, counts - pivot_counts);
+        }
+    }
+
+    if (labs(bias) > FUSION_BIAS_MAX_cmBar) {
+        status |= FUSION_STATUS_BIAS;
+    } else {
+        status &= ~FUSION_STATUS_BIAS;
+    }
+    if (labs(span) > scale_q8 >> FUSION_SPAN_MAX_SHIFT) {
+        status |= FUSION_STATUS_SPAN;
+    } else {
+        status &= ~FUSION_STATUS_SPAN;
+    }
+}
+
+char fusion_acq(char new_sample) {
+    struct AdcSample sample;
+    unsigned long read_time = 0;
+    char fused = 0;
+
+    if (!enabled || !scale_q8) {
+        return 0;
+    }
+
+    if (adc_read(&sample) && fusion_analog(&sample)) {
+        read_time = sample.time;
+        fused = 1;
+    }
+
+    if (new_sample && !(depth_status() & DEPTH_STATUS_REJECTED)) {
+        if (history_len) {
+            fusion_digital(depth_cmBar(), depth_sample_time() - depth_conversion_time() / 2);
+        }
+        fused_cmBar = depth_cmBar();
+        read_time = depth_sample_time();
+        fused = 1;
+    }
+
+    if (fused) {
+        /* the depth sample is older than the analog ones, stamp the fuse
+         * time so the output stays in order and report the age apart */
+        fused_time = get_time();
+        fused_age = fused_time - read_time;
+        fused_seq++;
+    }
+    return fused;
+}
+
+long fusion_cmBar(void) {
+    return fused_cmBar;
+}
+
+long fusion_analog_cmBar(void) {
+    return analog_cmBar + bias;
+}
+
+long fusion_bias_cmBar(void) {
+    return bias;
+}
+
+int fusion_span_correction(void) {
+    return scale_q8 ? span * 10000 / scale_q8 : 0;
+}
+
+unsigned char fusion_status(void) {
+    return status;
+}
+
+unsigned int fusion_disagree_count(void) {
+    return disagree_total;
+}
+
+unsigned long fusion_sample_time(void) {
+    return fused_time;
+}
+
+unsigned long fusion_sample_age(void) {
+    return fused_age;
+}
+
+unsigned int fusion_sample_seq(void) {
+    return fused_seq;
+}
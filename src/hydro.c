@@ -0,0 +1,111 @@
+/** @file   hydro.c
+ *  @brief  Pressure to depth conversion
+ */
+
+#include <hydro.h>
+
+#include <stdlib.h>
+
+/** Normal gravity at the equator, 1e-5 m/s^2 */
+#define HYDRO_G_EQUATOR  978032UL
+
+/** Normal gravity above the equator every 5 degrees of latitude,
+ *  1e-5 m/s^2, linearly interpolated in between (error below 1e-4 m/s^2,
+ *  1e-5 of the depth) */
+static const unsigned int hydro_g_table[] = {
+       0,   39,  155,  346,  604,  923, 1292, 1701, 2137, 2587,
+    3037, 3475, 3885, 4256, 4577, 4837, 5029, 5146, 5186
+};
+
+static unsigned int density = HYDRO_DENSITY_FRESH;
+static signed char latitude = HYDRO_LATITUDE_DEFAULT;
+static unsigned long gravity;
+
+/** 2^32 * 1e8 / (density * gravity), depth in mm per Pa as a 0.32 fraction */
+static unsigned long depth_scale;
+
+/** Recompute gravity and the reciprocal after a change */
+static void hydro_update(void) {
+    unsigned char lat = abs(latitude);
+    unsigned char i = lat / 5;
+    unsigned int g = hydro_g_table[i];
+    unsigned long weight, r;
+    unsigned char bit;
+
+    if (lat % 5) {
+        g += (hydro_g_table[i + 1] - g) * (lat % 5) / 5;
+    }
+    gravity = HYDRO_G_EQUATOR + g;
+
+    /* long division of 1e8 * 2^32 by the weight of a m^3, one quotient bit
+     * at a time.  The weight is below 2^31, so the shifted remainder fits
+     * 32 bits. */
+    weight = density * gravity;
+    r = 100000000UL;
+    depth_scale = 0;
+    for (bit = 0; bit < 32; bit++) {
+        r <<= 1;
+        depth_scale <<= 1;
+        if (r >= weight) {
+            r -= weight;
+            depth_scale |= 1;
+        }
+    }
+}
+
+void hydro_init(void) {
+    density = HYDRO_DENSITY_FRESH;
+    latitude = HYDRO_LATITUDE_DEFAULT;
+    hydro_update();
+}
+
+char hydro_set_density(unsigned int kgm3) {
+    if (kgm3 < HYDRO_DENSITY_MIN || kgm3 > HYDRO_DENSITY_MAX) {
+        return 0;
+    }
+    density = kgm3;
+    hydro_update();
+    return 1;
+}
+
+unsigned int hydro_density(void) {
+    return density;
+}
+
+char hydro_set_latitude(signed char deg) {
+    if (deg < -90 || deg > 90) {
+        return 0;
+    }
+    latitude = deg;
+    hydro_update();
+    return 1;
+}
+
+signed char hydro_latitude(void) {
+    return latitude;
+}
+
+unsigned long hydro_gravity(void) {
+    return gravity;
+}
+
+/** Rounded high 32 bits of a 32 x 32 bit product, from 16 bit partial
+ *  products so no 64 bit arithmetic is pulled in */
+static unsigned long hydro_mul_hi(unsigned long a, unsigned long b) {
+    unsigned long ah = a >> 16, al = a & 0xFFFF;
+    unsigned long bh = b >> 16, bl = b & 0xFFFF;
+    unsigned long lo = al * bl;
+    unsigned long mid1 = ah * bl;
+    unsigned long mid2 = al * bh;
+    unsigned long carry;
+
+    carry = (lo >> 16) + (mid1 & 0xFFFF) + (mid2 & 0xFFFF) + 0x8000;
+    return ah * bh + (mid1 >> 16) + (mid2 >> 16) + (carry >> 16);
+}
+
+long hydro_depth_mm(long gauge_Pa) {
+    if (gauge_Pa < 0) {
+        return -(long)hydro_mul_hi(-gauge_Pa, depth_scale);
+    }
+    return hydro_mul_hi(gauge_Pa, depth_scale);
+}
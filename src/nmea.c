@@ -0,0 +1,133 @@
+/** @file   nmea.c
+ *  @brief  Allocation free NMEA style sentence encoder
+ */
+
+#include <nmea.h>
+#include <uart.h>
+
+static const unsigned long nmea_pow10[] = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+    10000UL, 1000UL, 100UL, 10UL
+};
+
+static const char nmea_hex[] = "0123456789ABCDEF";
+
+/** Hand the bytes written so far to the uart */
+static void nmea_commit(struct NmeaSentence *s) {
+    if (s->pending && s->port != NMEA_PORT_NONE) {
+        uart_tx_commit(s->port, s->pending);
+        s->pending = 0;
+    }
+}
+
+/** Commit, then reserve the next span of the transmit buffer
+ *  @return 0 if the buffer is full */
+static char nmea_reserve(struct NmeaSentence *s) {
+    int room;
+
+    if (s->port == NMEA_PORT_NONE) {
+        return 0;
+    }
+    nmea_commit(s);
+    s->buf = uart_tx_reserve(s->port, &room);
+    s->room = room;
+    return s->room != 0;
+}
+
+/** Write a byte without touching the checksum */
+static void nmea_emit(struct NmeaSentence *s, char c) {
+    if (!s->room && !nmea_reserve(s)) {
+        s->dropped++;
+        return;
+    }
+    *s->buf++ = c;
+    s->room--;
+    s->pending++;
+    s->len++;
+}
+
+void nmea_begin(struct NmeaSentence *s, int port, const char *id, char use_checksum) {
+    s->port = port;
+    s->checksum = 0;
+    s->use_checksum = use_checksum;
+    s->len = 0;
+    s->dropped = 0;
+    s->room = 0;
+    s->pending = 0;
+
+    nmea_emit(s, '$');
+    nmea_puts(s, id);
+}
+
+void nmea_begin_buf(struct NmeaSentence *s, char *buf, unsigned char size,
+                    const char *id, char use_checksum) {
+    s->port = NMEA_PORT_NONE;
+    s->checksum = 0;
+    s->use_checksum = use_checksum;
+    s->len = 0;
+    s->dropped = 0;
+    s->buf = buf;
+    s->room = size;
+    s->pending = 0;
+
+    nmea_emit(s, '$');
+    nmea_puts(s, id);
+}
+
+void nmea_putc(struct NmeaSentence *s, char c) {
+    s->checksum ^= c;
+    nmea_emit(s, c);
+}
+
+void nmea_puts(struct NmeaSentence *s, const char *str) {
+    while (*str) {
+        nmea_putc(s, *str++);
+    }
+}
+
+/** Integer to ascii by repeated subtraction of powers of ten, which is much
+ *  cheaper than a 32-bit divide on the AVR. */
+void nmea_int(struct NmeaSentence *s, long value) {
+    unsigned long v;
+    unsigned char i;
+    char digit;
+    char started = 0;
+
+    if (value < 0) {
+        nmea_putc(s, '-');
+        v = -(unsigned long)value;
+    } else {
+        v = value;
+    }
+
+    for (i = 0; i < sizeof(nmea_pow10) / sizeof(nmea_pow10[0]); i++) {
+        digit = '0';
+        while (v >= nmea_pow10[i]) {
+            v -= nmea_pow10[i];
+            digit++;
+        }
+        if (started || digit != '0') {
+            nmea_putc(s, digit);
+            started = 1;
+        }
+    }
+    nmea_putc(s, '0' + (char)v);
+}
+
+void nmea_field_int(struct NmeaSentence *s, long value) {
+    nmea_putc(s, ',');
+    nmea_int(s, value);
+}
+
+int nmea_end(struct NmeaSentence *s) {
+    if (s->use_checksum) {
+        nmea_emit(s, '*');
+        nmea_emit(s, nmea_hex[s->checksum >> 4]);
+        nmea_emit(s, nmea_hex[s->checksum & 0x0F]);
+    }
+    nmea_emit(s, '\r');
+    nmea_emit(s, '\n');
+    nmea_commit(s);
+
+    return s->len;
+}
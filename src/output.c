@@ -0,0 +1,71 @@
+/** @file   output.c
+ *  @brief  Output scheduler, decides when a sample is published
+ */
+
+#include <output.h>
+#include <sysclk.h>
+
+void output_sched_init(struct OutputSchedule *sched, char mode,
+                       unsigned int period_mS, unsigned int threshold_mBar) {
+    sched->mode = OUTPUT_MODE_PERIODIC;
+    sched->period_mS = 500;
+    sched->threshold_mBar = 0;
+    sched->last_time = 0;
+    sched->last_mBar = 0;
+
+    output_sched_set(sched, mode, period_mS, threshold_mBar);
+}
+
+char output_sched_set(struct OutputSchedule *sched, char mode,
+                      unsigned int period_mS, unsigned int threshold_mBar) {
+    if (mode > OUTPUT_MODE_CHANGE) {
+        return 0;
+    }
+    if (mode != OUTPUT_MODE_SAMPLE && period_mS < OUTPUT_MIN_PERIOD_mS) {
+        return 0;
+    }
+
+    sched->mode = mode;
+    sched->period_mS = period_mS;
+    sched->threshold_mBar = threshold_mBar;
+    return 1;
+}
+
+char output_sched_due(struct OutputSchedule *sched, char new_sample,
+                      unsigned int depth_mBar, unsigned long now) {
+    unsigned long period = SYS_CLK_MS_2_TICKS(sched->period_mS);
+    unsigned int delta;
+    char due = 0;
+
+    switch (sched->mode) {
+        case OUTPUT_MODE_SAMPLE:
+            due = new_sample;
+            break;
+
+        case OUTPUT_MODE_PERIODIC:
+            if (now - sched->last_time >= period) {
+                /* keep the rate exact unless we fell more than a period behind */
+                if (now - sched->last_time < 2 * period) {
+                    sched->last_time += period;
+                } else {
+                    sched->last_time = now;
+                }
+                sched->last_mBar = depth_mBar;
+                return 1;
+            }
+            break;
+
+        case OUTPUT_MODE_CHANGE:
+            delta = depth_mBar > sched->last_mBar ? depth_mBar - sched->last_mBar
+                                                  : sched->last_mBar - depth_mBar;
+            due = (new_sample && delta >= sched->threshold_mBar) ||
+                  (now - sched->last_time >= period);
+            break;
+    }
+
+    if (due) {
+        sched->last_time = now;
+        sched->last_mBar = depth_mBar;
+    }
+    return due;
+}
@@ -0,0 +1,128 @@
+/** @file   ringbuffer.c
+ *  @brief  Lock free single producer, single consumer byte ringbuffers
+ */
+
+#include <ringbuffer.h>
+
+#include <string.h>
+
+/** Keep the compiler from moving buffer accesses across an index update.
+ *  The AVR has a single core, so ordering the instructions is enough. */
+#define ringbuf_barrier() __asm__ __volatile__ ("" ::: "memory")
+
+void ringbuf_init(struct RingBuffer *rb, char *buf, int size) {
+    rb->buf = buf;
+    rb->mask = size - 1;
+    rb->head = 0;
+    rb->tail = 0;
+}
+
+void ringbuf_flush(struct RingBuffer *rb) {
+    rb->tail = rb->head;
+}
+
+unsigned int ringbuf_cnt(struct RingBuffer *rb) {
+    return (unsigned char)(rb->head - rb->tail) & rb->mask;
+}
+
+unsigned int ringbuf_free(struct RingBuffer *rb) {
+    return (unsigned char)(rb->tail - rb->head - 1) & rb->mask;
+}
+
+int ringbuf_full(struct RingBuffer *rb) {
+    return ((rb->head + 1) & rb->mask) == rb->tail;
+}
+
+int ringbuf_empty(struct RingBuffer *rb) {
+    return rb->head == rb->tail;
+}
+
+unsigned char ringbuf_get(struct RingBuffer *rb) {
+    unsigned char tail = rb->tail;
+    unsigned char b;
+
+    if (tail == rb->head) {
+        return 0;
+    }
+    ringbuf_barrier();
+    b = rb->buf[tail];
+    ringbuf_barrier();
+    rb->tail = (tail + 1) & rb->mask;
+    return b;
+}
+
+unsigned int ringbuf_get_block(struct RingBuffer *rb, char *b, unsigned int cnt) {
+    unsigned char tail = rb->tail;
+    unsigned int avail = ringbuf_cnt(rb);
+    unsigned int span;
+    unsigned int done = 0;
+
+    if (cnt > avail) {
+        cnt = avail;
+    }
+    ringbuf_barrier();
+    while (done < cnt) {
+        span = rb->mask + 1 - tail;
+        if (span > cnt - done) {
+            span = cnt - done;
+        }
+        memcpy(b + done, rb->buf + tail, span);
+        done += span;
+        tail = (tail + span) & rb->mask;
+    }
+    ringbuf_barrier();
+    rb->tail = tail;
+    return cnt;
+}
+
+int ringbuf_put(struct RingBuffer *rb, unsigned char b) {
+    unsigned char head = rb->head;
+    unsigned char next = (head + 1) & rb->mask;
+
+    if (next == rb->tail) {
+        return 0;
+    }
+    rb->buf[head] = b;
+    ringbuf_barrier();
+    rb->head = next;
+    return 1;
+}
+
+unsigned int ringbuf_put_block(struct RingBuffer *rb, const char *b, unsigned int cnt) {
+    unsigned char head = rb->head;
+    unsigned int space = ringbuf_free(rb);
+    unsigned int span;
+    unsigned int done = 0;
+
+    if (cnt > space) {
+        cnt = space;
+    }
+    while (done < cnt) {
+        span = rb->mask + 1 - head;
+        if (span > cnt - done) {
+            span = cnt - done;
+        }
+        memcpy(rb->buf + head, b + done, span);
+        done += span;
+        head = (head + span) & rb->mask;
+    }
+    ringbuf_barrier();
+    rb->head = head;
+    return cnt;
+}
+
+char *ringbuf_reserve(struct RingBuffer *rb, unsigned int *len) {
+    unsigned char head = rb->head;
+    unsigned int span = rb->mask + 1 - head;
+
+    *len = ringbuf_free(rb);
+    if (*len > span) {
+        *len = span;
+    }
+    return rb->buf + head;
+}
+
+void ringbuf_commit(struct RingBuffer *rb, unsigned int cnt) {
+    ringbuf_barrier();
+    rb->head = (rb->head + cnt) & rb->mask;
+}
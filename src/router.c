@@ -0,0 +1,297 @@
+/** @file   router.c
+ *  @brief  Sample output to several uarts
+ */
+
+#include <device.h>
+#include <router.h>
+#include <depth.h>
+#include <fusion.h>
+#include <nmea.h>
+#include <telemetry.h>
+
+/** Default tether output period */
+#define ROUTER_DEFAULT_PERIOD_mS  500
+#define ROUTER_DEFAULT_BAUDRATE   115200
+
+struct RouterPort router_ports[MAX_UARTS];
+char router_filtered = 1;
+
+/** Encoding key flag of a raw frame preceded by a setup frame */
+#define ROUTER_KEY_SETUP  0x08
+
+/** One encoding of the current sample shared by several ports, an encoding
+ *  wanted by a single port is written straight into its transmit buffer */
+struct RouterEncoding
+{
+    signed char key;            ///< format, checksum and setup, -1 if unused
+    unsigned char len;
+    char buf[ROUTER_MAX_LEN];
+};
+
+static struct RouterEncoding encodings[MAX_UARTS];
+
+void router_init(void) {
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        router_ports[i].enabled = (i == COMM_PORT_TETHER);
+        router_ports[i].format = OUTPUT_FORMAT_ASCII;
+        router_ports[i].checksum = 0;
+        router_ports[i].rs485 = 1;
+        router_ports[i].baudrate = ROUTER_DEFAULT_BAUDRATE;
+        router_ports[i].baudrate_pending = 0;
+        router_ports[i].last_format = OUTPUT_FORMAT_ASCII;
+        output_sched_init(&router_ports[i].schedule, OUTPUT_MODE_PERIODIC,
+                          ROUTER_DEFAULT_PERIOD_mS, 0);
+    }
+}
+
+void router_start(void) {
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        uart_enable_rs485(i, router_ports[i].rs485);
+        uart_set_baudrate(i, router_ports[i].baudrate);
+        router_ports[i].baudrate_pending = 0;
+    }
+}
+
+void router_set_rs485(int port, char on) {
+    router_ports[port].rs485 = on;
+    uart_enable_rs485(port, on);
+}
+
+char router_baudrate_valid(unsigned long baudrate) {
+    switch (baudrate) {
+        case 9600: case 19200: case 38400: case 57600: case 115200:
+            return 1;
+    }
+    return 0;
+}
+
+char router_set_baudrate(int port, unsigned long baudrate) {
+    if (!router_baudrate_valid(baudrate)) {
+        return 0;
+    }
+    router_ports[port].baudrate = baudrate;
+    router_ports[port].baudrate_pending = 1;
+    return 1;
+}
+
+void router_service(void) {
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        if (router_ports[i].baudrate_pending && uart_tx_idle(i)) {
+            uart_set_baudrate(i, router_ports[i].baudrate);
+            router_ports[i].baudrate_pending = 0;
+        }
+    }
+}
+
+/** Start a sentence in the transmit buffer of port, or if port is
+ *  NMEA_PORT_NONE in memory after the first used of ROUTER_MAX_LEN bytes
+ *  at buf */
+static void router_begin(struct NmeaSentence *s, int port, char *buf, unsigned char used,
+                         const char *id, char checksum) {
+    if (port == NMEA_PORT_NONE) {
+        nmea_begin_buf(s, buf + used, ROUTER_MAX_LEN - used, id, checksum);
+    } else {
+        nmea_begin(s, port, id, checksum);
+    }
+}
+
+/** Encode the latest sample as $PVRDT/$PVRDF sentences, see router_begin() */
+static unsigned char router_encode_ascii(int port, char *buf, char checksum) {
+    struct NmeaSentence sentence;
+    unsigned char len;
+
+    router_begin(&sentence, port, buf, 0, "PVRDT", checksum);
+    nmea_field_int(&sentence, (int)depth_mBar());
+    nmea_putc(&sentence, ',');
+    nmea_putc(&sentence, ' ');
+    nmea_int(&sentence, (int)water_temp_cC());
+    nmea_field_int(&sentence, depth_mm());
+    nmea_field_int(&sentence, depth_sample_time() >> 8);
+    nmea_field_int(&sentence, depth_sample_seq());
+    len = nmea_end(&sentence);
+
+    if (router_filtered) {
+        router_begin(&sentence, port, buf, len, "PVRDF", checksum);
+        nmea_field_int(&sentence, depth_filtered_cmBar());
+        nmea_field_int(&sentence, depth_rate_cmBar_s());
+        nmea_field_int(&sentence, depth_sample_seq());
+        len += nmea_end(&sentence);
+    }
+    return len;
+}
+
+/** Encode the latest fused sample as a $PVRDX sentence, see router_begin() */
+static unsigned char router_encode_fused(int port, char *buf, char checksum) {
+    struct NmeaSentence sentence;
+
+    router_begin(&sentence, port, buf, 0, "PVRDX", checksum);
+    nmea_field_int(&sentence, fusion_cmBar());
+    nmea_field_int(&sentence, fusion_analog_cmBar());
+    nmea_field_int(&sentence, fusion_status());
+    nmea_field_int(&sentence, fusion_sample_time() >> 8);
+    nmea_field_int(&sentence, fusion_sample_seq());
+    nmea_field_int(&sentence, fusion_sample_age() >> 8);
+    return nmea_end(&sentence);
+}
+
+/** Encode the latest sample as telemetry frames */
+static unsigned char router_encode_binary(char *buf) {
+    unsigned char len = telemetry_encode_depth(buf);
+
+    if (router_filtered) {
+        len += telemetry_encode_filter(buf + len);
+    }
+    return len;
+}
+
+/** Encode the last conversion as a raw frame, after a setup frame if asked */
+static unsigned char router_encode_raw(char *buf, char setup) {
+    unsigned char len = 0;
+
+    if (setup) {
+        len = telemetry_encode_setup(buf);
+    }
+    return len + telemetry_encode_raw(buf + len);
+}
+
+/** Encode the latest sample in the format of a port
+ *
+ *  @param port uart to write sentences to, NMEA_PORT_NONE to write them to
+ *              buf.  Frames always go to buf.
+ *  @param buf ROUTER_MAX_LEN bytes, unused for sentences sent to a port
+ *  @return bytes encoded
+ */
+static unsigned char router_encode(const struct RouterPort *p, char setup, int port, char *buf) {
+    if (p->format == OUTPUT_FORMAT_RAW) {
+        return router_encode_raw(buf, setup);
+    } else if (p->format == OUTPUT_FORMAT_FUSED) {
+        return router_encode_fused(port, buf, p->checksum);
+    } else if (p->format == OUTPUT_FORMAT_BINARY) {
+        return router_encode_binary(buf);
+    }
+    return router_encode_ascii(port, buf, p->checksum);
+}
+
+/** @return Key of the encoding a port wants */
+static signed char router_key(const struct RouterPort *p, char setup) {
+    return p->format | (p->checksum << 2) | (setup ? ROUTER_KEY_SETUP : 0);
+}
+
+/** @return Encoding of the latest sample for a key, made on first use */
+static const struct RouterEncoding *router_encoding(const struct RouterPort *p, signed char key) {
+    struct RouterEncoding *e;
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        e = &encodings[i];
+        if (e->key == key) {
+            return e;
+        }
+        if (e->key < 0) {
+            e->key = key;
+            e->len = router_encode(p, key & ROUTER_KEY_SETUP, NMEA_PORT_NONE, e->buf);
+            return e;
+        }
+    }
+    return 0;   /* not reached, one encoding per port at most */
+}
+
+/** Encode the latest sample straight into the transmit buffer of a port
+ *
+ *  Sentences follow the free space around the end of the buffer, frames
+ *  need it in one piece.
+ *
+ *  @return 0 if the free space wraps too early for the frames
+ */
+static char router_send_direct(int port, const struct RouterPort *p, char setup) {
+    char *span;
+    int room;
+
+    if (p->format == OUTPUT_FORMAT_ASCII || p->format == OUTPUT_FORMAT_FUSED) {
+        router_encode(p, setup, port, 0);
+        return 1;
+    }
+    span = uart_tx_reserve(port, &room);
+    if (room < ROUTER_MAX_LEN) {
+        return 0;
+    }
+    uart_tx_commit(port, router_encode(p, setup, NMEA_PORT_NONE, span));
+    return 1;
+}
+
+/** @return 1 if a port should send now, sets setup for a raw capture that
+ *  is due a setup frame */
+static char router_due(struct RouterPort *p, char new_sample, unsigned long now, char *setup) {
+    uint16_t seq;
+
+    *setup = 0;
+    if (p->format != p->last_format) {
+        p->last_format = p->format;
+        p->setup_countdown = 0;
+    }
+    if (p->format == OUTPUT_FORMAT_FUSED) {
+        /* fused samples come at the ADC rate, a new one is one not seen yet */
+        seq = fusion_sample_seq();
+        new_sample = seq != p->raw_seq;
+        p->raw_seq = seq;
+        return output_sched_due(&p->schedule, new_sample, fusion_cmBar() / 100, now);
+    }
+    if (p->format != OUTPUT_FORMAT_RAW) {
+        return output_sched_due(&p->schedule, new_sample, depth_mBar(), now);
+    }
+
+    seq = depth_last_conversion()->seq;
+    if (seq == p->raw_seq) {
+        return 0;
+    }
+    p->raw_seq = seq;
+    if (p->setup_countdown == 0) {
+        p->setup_countdown = TELEMETRY_SETUP_INTERVAL;
+        *setup = 1;
+    }
+    p->setup_countdown--;
+    return 1;
+}
+
+void router_publish(char new_sample, unsigned long now) {
+    signed char key[MAX_UARTS];
+    const struct RouterEncoding *e;
+    struct RouterPort *p;
+    char setup;
+    int i, j, users;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        encodings[i].key = -1;
+        key[i] = -1;
+        p = &router_ports[i];
+        if (!p->enabled || p->baudrate_pending || uart_tx_free(i) < ROUTER_MAX_LEN ||
+            !router_due(p, new_sample, now, &setup)) {
+            continue;
+        }
+        key[i] = router_key(p, setup);
+    }
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        if (key[i] < 0) {
+            continue;
+        }
+        p = &router_ports[i];
+        users = 0;
+        for (j = 0; j < MAX_UARTS; j++) {
+            users += key[j] == key[i];
+        }
+        if (users == 1 && router_send_direct(i, p, key[i] & ROUTER_KEY_SETUP)) {
+            continue;
+        }
+        e = router_encoding(p, key[i]);
+        if (e) {
+            uart_write(i, (char *)e->buf, e->len);
+        }
+    }
+}
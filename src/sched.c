@@ -0,0 +1,79 @@
+/** @file   sched.c
+ *  @brief  Main loop idle handling and cpu load accounting
+ */
+
+#include <device.h>
+#include <sched.h>
+#include <adc.h>
+#include <depth.h>
+#include <sysclk.h>
+#include <uart.h>
+
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+static unsigned long window_start;
+static unsigned long window_idle;
+static unsigned char idle_percent;
+
+void sched_init(void) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    window_start = get_time();
+    window_idle = 0;
+    idle_percent = 0;
+}
+
+/** Close the load window once it is long enough */
+static void sched_account(unsigned long now) {
+    unsigned long elapsed = now - window_start;
+
+    if (elapsed < SYS_CLK_MS_2_TICKS(SCHED_LOAD_WINDOW_mS)) {
+        return;
+    }
+    //both are in system ticks, scale down first so 100 * idle fits
+    idle_percent = (unsigned char)((100UL * (window_idle >> 8)) / (elapsed >> 8));
+    window_start = now;
+    window_idle = 0;
+}
+
+/** @return 1 if the main loop has work waiting, call with interrupts off */
+static char sched_pending(void) {
+    return depth_acq_pending() || adc_pending() || uart_rx_cnt(COMM_PORT_TETHER);
+}
+
+void sched_idle(void) {
+    unsigned long before, after;
+
+    wdt_reset();
+
+    before = get_time();
+    cli();
+    if (sched_pending()) {
+        sei();
+        sched_account(before);
+        return;
+    }
+    sleep_enable();
+    do {
+        sei();          //the instruction after sei is always executed, so the
+        sleep_cpu();    //sleep is entered before any pending interrupt runs
+        cli();
+        //the background ADC wakes the cpu on every conversion, sleep on
+        //through those until the next tick or something to do
+    } while (adc_running() && (get_time() >> 8) == (before >> 8) && !sched_pending());
+    sleep_disable();
+    sei();
+    after = get_time();
+
+    window_idle += after - before;
+    sched_account(after);
+}
+
+unsigned char sched_idle_percent(void) {
+    return idle_percent;
+}
+
+unsigned char sched_busy_percent(void) {
+    return 100 - idle_percent;
+}
@@ -0,0 +1,125 @@
+/** @file   spi.c
+ *  @brief  Low level driver for the SPI interface
+ *
+ *          Master mode at F_CPU/128, the register setup of the library
+ *          version.  The polled calls busy-wait on SPIF.  A chain of
+ *          transfers is shifted out byte by byte from the transfer complete
+ *          interrupt, which is only enabled while a chain is in progress.
+ */
+
+#include <device.h>
+#include <spi.h>
+
+/** Transfer in progress, 0 when idle.  Written by spi_transfer_start() while
+ *  the interrupt is off and by the interrupt afterwards. */
+static struct SpiTransfer * volatile spi_current;
+/** Bytes of the current transfer exchanged so far */
+static unsigned char spi_pos;
+
+void spi_init(void) {
+    SPI_PORT = 0;
+    SPI_PORT_DIR |= SPI_SS | SPI_SCLK | SPI_MOSI;
+    SPI_PORT_DIR &= ~SPI_MISO;
+    SPCR = (1 << SPE) | (1 << MSTR) | (1 << SPR1) | (1 << SPR0);
+    SPSR = 0;
+}
+
+void spi_write(int port, char outbyte) {
+    (void)port;
+    SPDR = outbyte;
+    while (!(SPSR & (1 << SPIF)));
+}
+
+void spi_write_noblock(int port, char outbyte) {
+    (void)port;
+    SPDR = outbyte;
+}
+
+void spi_wait(int port) {
+    (void)port;
+    while (!(SPSR & (1 << SPIF)));
+}
+
+char spi_read(int port) {
+    return spi_rw(port, 0);
+}
+
+char spi_rw(int port, char outbyte) {
+    (void)port;
+    SPDR = outbyte;
+    while (!(SPSR & (1 << SPIF)));
+    return SPDR;
+}
+
+void spi_set_clock_polarity(int port, char falling_edge) {
+    (void)port;
+    if (falling_edge) {
+        SPCR |= (1 << CPOL);
+    } else {
+        SPCR &= ~(1 << CPOL);
+    }
+}
+
+void spi_set_clock_phase(int port, char sample_on_trailing_edge) {
+    (void)port;
+    if (sample_on_trailing_edge) {
+        SPCR |= (1 << CPHA);
+    } else {
+        SPCR &= ~(1 << CPHA);
+    }
+}
+
+/** Set up the clocking and enable line of a transfer and send its first byte */
+static void spi_transfer_begin(struct SpiTransfer *t) {
+    spi_pos = 0;
+    spi_set_clock_polarity(0, t->falling_edge);
+    spi_set_clock_phase(0, t->sample_on_trailing_edge);
+    if (t->enable_port) {
+        *t->enable_port |= t->enable_mask;
+    }
+    SPDR = t->tx ? t->tx[0] : 0;
+}
+
+char spi_transfer_start(int port, struct SpiTransfer *transfer) {
+    (void)port;
+    if (spi_current) {
+        return 0;
+    }
+    spi_current = transfer;
+    (void)SPSR;     /* with the SPDR write below clears a stale SPIF */
+    spi_transfer_begin(transfer);
+    SPCR |= (1 << SPIE);
+    return 1;
+}
+
+char spi_transfer_busy(int port) {
+    (void)port;
+    return spi_current != 0;
+}
+
+/** Byte shifted, store it and send the next one or move down the chain */
+ISR(SPI_STC_vect) {
+    struct SpiTransfer *t = spi_current;
+    char data = SPDR;
+
+    if (t->rx) {
+        t->rx[spi_pos] = data;
+    }
+    if (++spi_pos < t->len) {
+        SPDR = t->tx ? t->tx[spi_pos] : 0;
+        return;
+    }
+
+    if (t->enable_port) {
+        *t->enable_port &= ~t->enable_mask;
+    }
+    spi_current = t->next;
+    if (t->next) {
+        spi_transfer_begin(t->next);
+    } else {
+        SPCR &= ~(1 << SPIE);
+    }
+    if (t->done) {
+        t->done(t);
+    }
+}
@@ -0,0 +1,178 @@
+/** @file   surface.c
+ *  @brief  Automatic surface zeroing and atmospheric drift tracking
+ */
+
+#include <surface.h>
+#include <depth.h>
+#include <sysclk.h>
+
+#include <stdlib.h>
+
+/** Extra fraction bits of the tracked reference */
+#define SURFACE_FRAC_BITS 4
+
+static char enabled = 0;
+static char captured;
+static char detected;
+
+/** Samples of the current SURFACE_TRACK_mS step */
+static char step_open;
+static unsigned long step_start;
+static long step_min;
+static long step_max;
+static long step_sum;
+static unsigned int step_count;
+
+/** Stable steps in a row: the level the steps are held to, the first
+ *  step's until the surface is detected and the last one's after, and
+ *  the sum of the levels until then */
+static char holding;
+static unsigned long hold_start;
+static long hold_level;
+static long hold_sum;
+static unsigned int hold_steps;
+
+/** Tracked reference with SURFACE_FRAC_BITS fraction bits */
+static long zero_frac;
+
+/** Reference at the last save */
+static long persisted;
+static unsigned long last_persist;
+
+void surface_init(void) {
+    captured = 0;
+    detected = 0;
+    step_open = 0;
+    holding = 0;
+    persisted = depth_zero_cmBar();
+}
+
+void surface_enable(char on) {
+    enabled = on;
+    if (!on) {
+        detected = 0;
+        step_open = 0;
+        holding = 0;
+    }
+}
+
+char surface_enabled(void) {
+    return enabled;
+}
+
+char surface_detected(void) {
+    return detected;
+}
+
+/** Leave the surface, stability has to be seen again */
+static void surface_reset_window(void) {
+    step_open = 0;
+    holding = 0;
+    detected = 0;
+}
+
+/** @return 1 if the reference moved enough since the last save */
+static char surface_persist_due(unsigned long now) {
+    long moved = depth_zero_cmBar() - persisted;
+
+    if (moved < 0) {
+        moved = -moved;
+    }
+    if (moved < SURFACE_PERSIST_cmBar ||
+        now - last_persist < SYS_CLK_MS_2_TICKS(SURFACE_PERSIST_mS)) {
+        return 0;
+    }
+    persisted = depth_zero_cmBar();
+    last_persist = now;
+    return 1;
+}
+
+char surface_update(long pressure_cmBar, unsigned long now) {
+    long level, error;
+
+    if (!enabled) {
+        return 0;
+    }
+
+    /* a reading the reject filter is still arguing about is not stable */
+    if (depth_status() & DEPTH_STATUS_REJECTED) {
+        surface_reset_window();
+        return 0;
+    }
+    if (pressure_cmBar < SURFACE_MIN_cmBar || pressure_cmBar > SURFACE_MAX_cmBar) {
+        surface_reset_window();
+        return 0;
+    }
+    if (captured) {
+        error = pressure_cmBar - depth_zero_cmBar();
+        if (error > SURFACE_BAND_cmBar || error < -SURFACE_BAND_cmBar) {
+            surface_reset_window();
+            return 0;
+        }
+    }
+
+    if (!step_open) {
+        step_open = 1;
+        step_start = now;
+        step_min = step_max = pressure_cmBar;
+        step_sum = 0;
+        step_count = 0;
+    }
+    if (pressure_cmBar < step_min) {
+        step_min = pressure_cmBar;
+    }
+    if (pressure_cmBar > step_max) {
+        step_max = pressure_cmBar;
+    }
+    step_sum += pressure_cmBar;
+    step_count++;
+    if (now - step_start < SYS_CLK_MS_2_TICKS(SURFACE_TRACK_mS)) {
+        return 0;
+    }
+    step_open = 0;
+    level = step_sum / step_count;
+
+    if (step_max - step_min > SURFACE_SPREAD_cmBar ||
+        (holding && labs(level - hold_level) > SURFACE_SPREAD_cmBar)) {
+        /* moving, start over with the next step */
+        holding = 0;
+        detected = 0;
+        return 0;
+    }
+    if (!holding) {
+        holding = 1;
+        hold_start = step_start;
+        hold_level = level;
+        hold_sum = 0;
+        hold_steps = 0;
+    }
+
+    if (!detected) {
+        hold_sum += level;
+        hold_steps++;
+        if (now - hold_start < SYS_CLK_MS_2_TICKS(SURFACE_HOLD_mS)) {
+            return 0;
+        }
+        detected = 1;
+        if (!captured) {
+            level = hold_sum / hold_steps;
+            captured = 1;
+            depth_set_zero_cmBar(level);
+            zero_frac = level << SURFACE_FRAC_BITS;
+            hold_level = level;
+            persisted = level;
+            last_persist = now;
+            return 1;
+        }
+    }
+    /* follow the weather, only a jump between steps is movement */
+    hold_level = level;
+
+    /* the reference may have been set by hand in between */
+    if ((zero_frac >> SURFACE_FRAC_BITS) != depth_zero_cmBar()) {
+        zero_frac = depth_zero_cmBar() << SURFACE_FRAC_BITS;
+    }
+    zero_frac += ((level << SURFACE_FRAC_BITS) - zero_frac) / SURFACE_TRACK_DIV;
+    depth_set_zero_cmBar(zero_frac >> SURFACE_FRAC_BITS);
+    return surface_persist_due(now);
+}
@@ -0,0 +1,109 @@
+/** @file   telemetry.c
+ *  @brief  Compact binary telemetry frames
+ */
+
+#include <types.h>
+#include <telemetry.h>
+#include <depth.h>
+#include <hydro.h>
+
+#include <util/crc16.h>
+
+static void put16(char *buf, uint16_t v) {
+    buf[0] = v & 0xFF;
+    buf[1] = v >> 8;
+}
+
+static void put24(char *buf, uint32_t v) {
+    put16(buf, v & 0xFFFF);
+    buf[2] = (v >> 16) & 0xFF;
+}
+
+static void put32(char *buf, uint32_t v) {
+    put16(buf, v & 0xFFFF);
+    put16(buf + 2, v >> 16);
+}
+
+/** Compile time checks that the raw fields hold what depth.h may carry */
+typedef char telemetry_raw_fits[DEPTH_RAW_BITS_MAX <= 24 ? 1 : -1];
+typedef char telemetry_cal_fits[DEPTH_CAL_WORDS_MAX <= TELEMETRY_CAL_WORDS ? 1 : -1];
+
+/** Fill in the header, sample sequence number and sample time */
+static void telemetry_header(char *frame, char type, char payload) {
+    frame[0] = TELEMETRY_SYNC1;
+    frame[1] = TELEMETRY_SYNC2;
+    frame[TELEMETRY_OFS_TYPE] = type;
+    frame[TELEMETRY_OFS_LEN] = payload;
+    put16(frame + TELEMETRY_OFS_SEQ, depth_sample_seq());
+    put32(frame + TELEMETRY_OFS_TIME, depth_sample_time());
+}
+
+/** Append the CRC
+ *  @return len */
+static int telemetry_finish(char *frame, unsigned char len) {
+    uint16_t crc = TELEMETRY_CRC_INIT;
+    unsigned char i;
+
+    for (i = TELEMETRY_OFS_TYPE; i < len - TELEMETRY_CRC_LEN; i++) {
+        crc = _crc_xmodem_update(crc, frame[i]);
+    }
+    put16(frame + len - TELEMETRY_CRC_LEN, crc);
+    return len;
+}
+
+int telemetry_encode_depth(char *frame) {
+    telemetry_header(frame, TELEMETRY_TYPE_DEPTH, TELEMETRY_DEPTH_PAYLOAD);
+    put24(frame + TELEMETRY_OFS_RAW_D1, depth_raw_last());
+    put24(frame + TELEMETRY_OFS_RAW_D2, temp_raw_last());
+    put16(frame + TELEMETRY_OFS_PRESSURE, depth_mBar());
+    put16(frame + TELEMETRY_OFS_TEMP, water_temp_cC());
+    frame[TELEMETRY_OFS_STATUS] = depth_status();
+    put32(frame + TELEMETRY_OFS_DEPTH_MM, depth_mm());
+
+    return telemetry_finish(frame, TELEMETRY_DEPTH_FRAME_LEN);
+}
+
+int telemetry_encode_filter(char *frame) {
+    telemetry_header(frame, TELEMETRY_TYPE_FILTER, TELEMETRY_FILTER_PAYLOAD);
+    put32(frame + TELEMETRY_OFS_FILTER_DEPTH, depth_filtered_cmBar());
+    put32(frame + TELEMETRY_OFS_FILTER_RATE, depth_rate_cmBar_s());
+
+    return telemetry_finish(frame, TELEMETRY_FILTER_FRAME_LEN);
+}
+
+int telemetry_encode_raw(char *frame) {
+    const struct DepthConversion *c = depth_last_conversion();
+
+    telemetry_header(frame, TELEMETRY_TYPE_RAW, TELEMETRY_RAW_PAYLOAD);
+    put16(frame + TELEMETRY_OFS_SEQ, c->seq);
+    put32(frame + TELEMETRY_OFS_TIME, c->time);
+    put24(frame + TELEMETRY_OFS_RAW_FRAME_D1, c->d1);
+    put24(frame + TELEMETRY_OFS_RAW_FRAME_D2, c->d2);
+    frame[TELEMETRY_OFS_RAW_TEMP_AGE] = c->temp_age;
+
+    return telemetry_finish(frame, TELEMETRY_RAW_FRAME_LEN);
+}
+
+int telemetry_encode_setup(char *frame) {
+    const struct DepthConversion *c = depth_last_conversion();
+    uint16_t word[TELEMETRY_CAL_WORDS] = {0};
+    unsigned char i;
+
+    telemetry_header(frame, TELEMETRY_TYPE_SETUP, TELEMETRY_SETUP_PAYLOAD);
+    put16(frame + TELEMETRY_OFS_SEQ, c->seq);
+    put32(frame + TELEMETRY_OFS_TIME, c->time);
+    frame[TELEMETRY_OFS_SETUP_CAL_COUNT] = depth_calibration_words(word);
+    for (i = 0; i < TELEMETRY_CAL_WORDS; i++) {
+        put16(frame + TELEMETRY_OFS_SETUP_CAL + 2 * i, word[i]);
+    }
+    frame[TELEMETRY_OFS_SETUP_OVERSAMPLE] = depth_get_oversample();
+    frame[TELEMETRY_OFS_SETUP_MEDIAN] = depth_filter_median();
+    frame[TELEMETRY_OFS_SETUP_ALPHA] = depth_filter_alpha();
+    frame[TELEMETRY_OFS_SETUP_BETA] = depth_filter_beta();
+    put32(frame + TELEMETRY_OFS_SETUP_ZERO, depth_zero_cmBar());
+    put16(frame + TELEMETRY_OFS_SETUP_DENSITY, hydro_density());
+    frame[TELEMETRY_OFS_SETUP_LATITUDE] = hydro_latitude();
+    frame[TELEMETRY_OFS_SETUP_TEMP_INTERVAL] = depth_get_temp_interval();
+
+    return telemetry_finish(frame, TELEMETRY_SETUP_FRAME_LEN);
+}
@@ -0,0 +1,347 @@
+/** @file   uart.c
+ *  @brief  Low level driver for async serial communications.
+ *
+ *          Interrupt driven, with a transmit and a receive ringbuffer per
+ *          port.  The main loop is the only producer of the transmit buffers
+ *          and the only consumer of the receive buffers, the interrupts the
+ *          other side, so the buffers themselves need no critical sections.
+ *          Queueing transmit data does: the transmit complete interrupt
+ *          releases the rs485 line when it finds the buffer empty, so the
+ *          line is asserted and the data queued with interrupts off.
+ */
+
+#include <device.h>
+#include <ringbuffer.h>
+#include <uart.h>
+
+/** Size of each ringbuffer, holds one byte less */
+#define UART_BUF_SIZE 256
+
+/** Receive status bits that flag a bad byte (FE, DOR, UPE) */
+#define UART_RX_ERROR_MASK 0x1C
+
+/** Registers of one usart */
+struct UART_Regs
+{
+    volatile uint8_t *ucsra;
+    volatile uint8_t *ucsrb;
+    volatile uint8_t *ucsrc;
+    volatile uint8_t *udr;
+    volatile uint8_t *ubrrl;
+    volatile uint8_t *ubrrh;
+};
+
+/** State of one port */
+struct UART_Control
+{
+    struct RingBuffer rxbuf;
+    struct RingBuffer txbuf;
+    char rs485;                 ///< drive the rs485 transmit enable
+    char allow_bad_bytes;       ///< queue received bytes with errors
+    unsigned char last_error;   ///< receive status of the last bad byte
+    struct UART_Stats stats;    ///< rx counters are written by the interrupt
+};
+
+static const struct UART_Regs uart_regs[MAX_UARTS] = {
+    { &UCSR0A, &UCSR0B, &UCSR0C, &UDR0, &UBRR0L, &UBRR0H },
+    { &UCSR1A, &UCSR1B, &UCSR1C, &UDR1, &UBRR1L, &UBRR1H },
+};
+
+static struct UART_Control uart[MAX_UARTS];
+static char uart_buf_rx[MAX_UARTS][UART_BUF_SIZE];
+static char uart_buf_tx[MAX_UARTS][UART_BUF_SIZE];
+
+void uart_rs485_tx_enable(int uart_device_id, int on_off) {
+    if (!uart[uart_device_id].rs485) {
+        return;
+    }
+    if (uart_device_id == MCU_INTERNAL_UART_0) {
+        if (on_off) {
+            UART_RS485_TXE_PORT |= UART_0_RS485_TXE_MASK;
+        } else {
+            UART_RS485_TXE_PORT &= ~UART_0_RS485_TXE_MASK;
+        }
+    } else {
+        if (on_off) {
+            UART_RS485_RXE_PORT &= ~UART_1_RS485_RXE_MASK;
+            UART_RS485_TXE_PORT |= UART_1_RS485_TXE_MASK;
+        } else {
+            UART_RS485_RXE_PORT |= UART_1_RS485_RXE_MASK;
+            UART_RS485_TXE_PORT &= ~UART_1_RS485_TXE_MASK;
+        }
+    }
+}
+
+void uart_set_baudrate(int uart_device_id, unsigned long baudrate) {
+    const struct UART_Regs *r = &uart_regs[uart_device_id];
+    unsigned int ubrr = (F_CPU + baudrate * 8) / (baudrate * 16) - 1;
+
+    *r->ubrrh = ubrr >> 8;
+    *r->ubrrl = ubrr & 0xFF;
+}
+
+void uart_enable_rs485(int uart_device_id, int on_off) {
+    uart[uart_device_id].rs485 = on_off;
+
+    if (uart_device_id != MCU_INTERNAL_UART_1) {
+        return;
+    }
+    if (on_off) {
+        UART_RS485_RXE_PORT |= UART_1_RS485_RS232_SW;
+    } else {
+        UART_RS485_RXE_PORT |= UART_1_RS485_RXE_MASK;
+        UART_RS485_TXE_PORT |= UART_1_RS485_TXE_MASK;
+        UART_RS485_RXE_PORT &= ~UART_1_RS485_RS232_SW;
+    }
+}
+
+void uart_allow_bad_bytes(int uart_device_id, int allow) {
+    uart[uart_device_id].allow_bad_bytes = allow;
+}
+
+void uart_get_stats(int uart_device_id, struct UART_Stats *stats) {
+    CRITICAL_region_begin();
+    *stats = uart[uart_device_id].stats;
+    CRITICAL_region_end();
+}
+
+unsigned char uart_get_last_error(int uart_device_id) {
+    unsigned char error = uart[uart_device_id].last_error;
+
+    uart[uart_device_id].last_error = 0;
+    return error;
+}
+
+/** 8N1, receive interrupt on, transmit interrupts are enabled on demand */
+static void uart_init_port(int uart_device_id) {
+    const struct UART_Regs *r = &uart_regs[uart_device_id];
+
+    *r->ucsra = 0;
+    *r->ucsrb = (1 << RXCIE) | (1 << RXEN) | (1 << TXEN);
+    *r->ucsrc = (1 << UCSZ1) | (1 << UCSZ0);
+}
+
+int uart_txempty(int uart_device_id) {
+    return *uart_regs[uart_device_id].ucsra & (1 << UDRE);
+}
+
+char uart_getc(int uart_device_id) {
+    return *uart_regs[uart_device_id].udr;
+}
+
+void uart_putc(int uart_device_id, char c) {
+    *uart_regs[uart_device_id].udr = c;
+}
+
+int uart_rx_cnt(int uart_device_id) {
+    return ringbuf_cnt(&uart[uart_device_id].rxbuf);
+}
+
+int uart_tx_cnt(int uart_device_id) {
+    return ringbuf_cnt(&uart[uart_device_id].txbuf);
+}
+
+void uart_wait_write(int uart_device_id) {
+    while (!ringbuf_empty(&uart[uart_device_id].txbuf));
+    while (!uart_txempty(uart_device_id));
+}
+
+/** Turn on the data register empty interrupt, which drains the transmit
+ *  buffer.  UCSR1B is outside the bit addressable io space, so the update
+ *  must not race the interrupts changing it. */
+static void uart_tx_kick(int uart_device_id) {
+    CRITICAL_region_begin();
+    *uart_regs[uart_device_id].ucsrb |= (1 << UDRIE);
+    CRITICAL_region_end();
+}
+
+/** Assert the rs485 transmitter ahead of new data, call with interrupts
+ *  off until the data is queued.  A transmit complete left pending by the
+ *  previous data is cleared, its interrupt would release the line under
+ *  the new byte. */
+static void uart_tx_start(int uart_device_id) {
+    uart_rs485_tx_enable(uart_device_id, 1);
+    *uart_regs[uart_device_id].ucsra |= (1 << TXC);
+}
+
+/** Start sending directly if the transmitter is idle
+ *  @return 1 if the byte went to the data register */
+static char uart_tx_direct(int uart_device_id, char data) {
+    const struct UART_Regs *r = &uart_regs[uart_device_id];
+
+    if (ringbuf_empty(&uart[uart_device_id].txbuf) && (*r->ucsra & (1 << UDRE))) {
+        *r->udr = data;
+        return 1;
+    }
+    return 0;
+}
+
+int uart_write_byte(int uart_device_id, char data) {
+    char queued;
+
+    CRITICAL_region_begin();
+    uart_tx_start(uart_device_id);
+    queued = uart_tx_direct(uart_device_id, data)
+             || ringbuf_put(&uart[uart_device_id].txbuf, data);
+    if (queued) {
+        uart_tx_kick(uart_device_id);
+    }
+    CRITICAL_region_end();
+
+    if (!queued) {
+        uart[uart_device_id].stats.tx_dropped++;
+    }
+    return queued;
+}
+
+int uart_write(int uart_device_id, char *buf, int cnt) {
+    int n = 0;
+
+    if (cnt <= 0) {
+        return 0;
+    }
+    CRITICAL_region_begin();
+    uart_tx_start(uart_device_id);
+    n = uart_tx_direct(uart_device_id, buf[0]);
+    n += ringbuf_put_block(&uart[uart_device_id].txbuf, buf + n, cnt - n);
+    if (n) {
+        uart_tx_kick(uart_device_id);
+    }
+    CRITICAL_region_end();
+
+    uart[uart_device_id].stats.tx_dropped += cnt - n;
+    return n;
+}
+
+int uart_tx_free(int uart_device_id) {
+    return ringbuf_free(&uart[uart_device_id].txbuf);
+}
+
+char *uart_tx_reserve(int uart_device_id, int *len) {
+    unsigned int span;
+    char *p = ringbuf_reserve(&uart[uart_device_id].txbuf, &span);
+
+    *len = span;
+    return p;
+}
+
+void uart_tx_commit(int uart_device_id, int cnt) {
+    if (cnt <= 0) {
+        return;
+    }
+    CRITICAL_region_begin();
+    uart_tx_start(uart_device_id);
+    ringbuf_commit(&uart[uart_device_id].txbuf, cnt);
+    uart_tx_kick(uart_device_id);
+    CRITICAL_region_end();
+}
+
+/** The transmit interrupts stay enabled until the transmit complete
+ *  interrupt has seen the last byte out */
+int uart_tx_idle(int uart_device_id) {
+    return ringbuf_empty(&uart[uart_device_id].txbuf)
+           && !(*uart_regs[uart_device_id].ucsrb & ((1 << UDRIE) | (1 << TXCIE)));
+}
+
+int uart_read(int uart_device_id, char *buf, int cnt) {
+    if (cnt <= 0) {
+        return 0;
+    }
+    return ringbuf_get_block(&uart[uart_device_id].rxbuf, buf, cnt);
+}
+
+char uart_read_byte(int uart_device_id) {
+    return ringbuf_get(&uart[uart_device_id].rxbuf);
+}
+
+/* Interrupt service, the handlers below pass a constant port id so each
+ * one compiles to direct register accesses. */
+
+static inline void uart_rx_int_service(int uart_device_id) {
+    const struct UART_Regs *r = &uart_regs[uart_device_id];
+    struct UART_Control *u = &uart[uart_device_id];
+    unsigned char status = *r->ucsra;
+    char data = *r->udr;
+
+    if (status & UART_RX_ERROR_MASK) {
+        u->last_error = status;
+        u->stats.rx_errors++;
+        if (!u->allow_bad_bytes) {
+            return;
+        }
+    }
+    if (!ringbuf_put(&u->rxbuf, data)) {
+        u->stats.rx_dropped++;
+    }
+}
+
+/** Data register empty, send the next byte or wait for the last one to
+ *  leave the shift register before releasing the rs485 line */
+static inline void uart_tx_data_rdy_int_service(int uart_device_id) {
+    const struct UART_Regs *r = &uart_regs[uart_device_id];
+    struct UART_Control *u = &uart[uart_device_id];
+
+    if (ringbuf_empty(&u->txbuf)) {
+        *r->ucsrb &= ~(1 << UDRIE);
+        *r->ucsra |= (1 << TXC);
+        *r->ucsrb |= (1 << TXCIE);
+    } else {
+        *r->udr = ringbuf_get(&u->txbuf);
+    }
+}
+
+/** Transmit complete */
+static inline void uart_tx_txdone_int_service(int uart_device_id) {
+    const struct UART_Regs *r = &uart_regs[uart_device_id];
+
+    if (ringbuf_empty(&uart[uart_device_id].txbuf)) {
+        uart_rs485_tx_enable(uart_device_id, 0);
+        *r->ucsrb &= ~(1 << TXCIE);
+    } else {
+        *r->ucsrb |= (1 << UDRIE);
+    }
+}
+
+ISR(USART0_RX_vect) {
+    uart_rx_int_service(MCU_INTERNAL_UART_0);
+}
+
+ISR(USART1_RX_vect) {
+    uart_rx_int_service(MCU_INTERNAL_UART_1);
+}
+
+ISR(USART0_UDRE_vect) {
+    uart_tx_data_rdy_int_service(MCU_INTERNAL_UART_0);
+}
+
+ISR(USART1_UDRE_vect) {
+    uart_tx_data_rdy_int_service(MCU_INTERNAL_UART_1);
+}
+
+ISR(USART0_TX_vect) {
+    uart_tx_txdone_int_service(MCU_INTERNAL_UART_0);
+}
+
+ISR(USART1_TX_vect) {
+    uart_tx_txdone_int_service(MCU_INTERNAL_UART_1);
+}
+
+void uart_init(void) {
+    int i;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        ringbuf_init(&uart[i].rxbuf, uart_buf_rx[i], UART_BUF_SIZE);
+        ringbuf_init(&uart[i].txbuf, uart_buf_tx[i], UART_BUF_SIZE);
+    }
+
+    UART_RS485_TXE_PORT_DIR |= UART_0_RS485_TXE_MASK | UART_1_RS485_TXE_MASK;
+
+    for (i = 0; i < MAX_UARTS; i++) {
+        uart_enable_rs485(i, 1);
+        uart_rs485_tx_enable(i, 0);
+    }
+    for (i = 0; i < MAX_UARTS; i++) {
+        uart_init_port(i);
+        uart_set_baudrate(i, 115200);
+    }
+}